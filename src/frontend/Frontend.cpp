@@ -1,6 +1,7 @@
 // Copyright 2019-2023 hdoc
 // SPDX-License-Identifier: AGPL-3.0-only
 
+#include <charconv>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
@@ -12,19 +13,86 @@
 #include "frontend/Frontend.hpp"
 
 #include "argparse/argparse.hpp"
+#include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 #include "toml++/toml.h"
 #include "version.hpp"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/Threading.h"
 
 // These files are generated by meson at build-time using `xxd -i`
 extern uint8_t  ___site_content_oss_md[];   ///< Contents of the OSS attribution file
 extern uint64_t ___site_content_oss_md_len; ///< Length of the OSS attribution file
 
+/// @brief Parse a shard given as "K/N" into its zero-based index and the number of shards.
+/// Returns false if it isn't of that form or K isn't between 1 and N.
+static bool parseShard(const std::string& shard, uint32_t& shardIndex, uint32_t& numShards) {
+  const std::size_t slash = shard.find('/');
+  if (slash == std::string::npos) {
+    return false;
+  }
+  uint32_t   k = 0, n = 0;
+  const auto kEnd = shard.data() + slash;
+  const auto nEnd = shard.data() + shard.size();
+  if (std::from_chars(shard.data(), kEnd, k).ptr != kEnd || std::from_chars(kEnd + 1, nEnd, n).ptr != nEnd) {
+    return false;
+  }
+  if (k < 1 || k > n) {
+    return false;
+  }
+  shardIndex = k - 1;
+  numShards  = n;
+  return true;
+}
+
+/// @brief Append the files that differ between the git ref and the working tree to files, relative to the current
+/// directory. Files outside of it are left out. Returns false if git failed.
+static bool getChangedFiles(const std::string& ref, std::vector<std::string>& files) {
+  llvm::SmallString<64> tempFile;
+  if (const auto ec = llvm::sys::fs::createTemporaryFile("hdoc-changed-files", "", tempFile)) {
+    spdlog::error("Unable to create temporary file to store the changed files: {}.", ec.message());
+    return false;
+  }
+  llvm::FileRemover tempFileRemove(tempFile);
+
+  const auto gitPath = llvm::sys::findProgramByName("git");
+  if (!gitPath) {
+    spdlog::error("Unable to find git to determine the files changed since {}.", ref);
+    return false;
+  }
+
+  // Renames are listed as a deletion and an addition, since files that included the old path are affected too
+  llvm::SmallVector<llvm::StringRef> gitFlags = {
+      gitPath.get(), "diff", "--name-only", "--no-renames", "--relative", ref};
+  std::optional<llvm::StringRef> redirects[] = {std::nullopt, {tempFile}, std::nullopt}; // stdin, stdout, stderr
+
+  std::string errMsg = "";
+  int         rc     = llvm::sys::ExecuteAndWait(gitPath.get(), gitFlags, std::nullopt, redirects, 60, 0, &errMsg);
+  if (rc != 0) {
+    spdlog::error("Failed to determine the files changed since {} ({}, {}).", ref, rc, errMsg);
+    return false;
+  }
+
+  auto buf = llvm::MemoryBuffer::getFile(tempFile);
+  if (!buf) {
+    spdlog::error("Failed to read the files changed since {}.", ref);
+    return false;
+  }
+
+  llvm::SmallVector<llvm::StringRef> lines;
+  buf->get()->getBuffer().split(lines, "\n", /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (const auto line : lines) {
+    files.emplace_back(line.str());
+  }
+  return true;
+}
+
 /// @brief Parse the CLI and configuration file
 hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* cfg) {
   cfg->hdocVersion = HDOC_VERSION;
@@ -32,6 +100,54 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
   program.add_argument("--verbose").help("Whether to use verbose output").default_value(false).implicit_value(true);
   program.add_argument("--oss").help("Show open source notices").default_value(false).implicit_value(true);
 
+  // Large projects can be indexed in shards, possibly on different machines, whose partial indexes are merged later
+  argparse::ArgumentParser indexCommand("index");
+  indexCommand.add_description("Index a shard of the files in compile_commands.json and save the partial index.");
+  indexCommand.add_argument("--shard")
+      .help("Index the K-th of N equally sized shards of the files, given as K/N")
+      .default_value(std::string("1/1"));
+  indexCommand.add_argument("-o", "--output").help("Path where the partial index is saved").required();
+  program.add_subparser(indexCommand);
+
+  argparse::ArgumentParser mergeCommand("merge");
+  mergeCommand.add_description("Merge partial indexes saved by 'hdoc index' and generate documentation from them.");
+  mergeCommand.add_argument("partial_indexes").help("Paths of the partial indexes").remaining();
+  program.add_subparser(mergeCommand);
+
+  // Pull request builds only reindex the files affected by a few changes
+  argparse::ArgumentParser updateCommand("update");
+  updateCommand.add_description("Reindex the files affected by changes, merge them over partial indexes saved by "
+                                "'hdoc index', and generate documentation from them.");
+  updateCommand.add_argument("--since").help("Git ref that the working tree is compared to in order to find changes");
+  updateCommand.add_argument("--changed").help("Path of a changed file, may be given more than once").append();
+  updateCommand.add_argument("partial_indexes").help("Paths of the partial indexes to update").remaining();
+  program.add_subparser(updateCommand);
+
+  argparse::ArgumentParser watchCommand("watch");
+  watchCommand.add_description("Generate documentation, and keep updating it whenever project files change.");
+  program.add_subparser(watchCommand);
+
+  argparse::ArgumentParser serveCommand("serve");
+  serveCommand.add_description("Index the project and serve its documentation over HTTP, rendering pages on demand.");
+  serveCommand.add_argument("--host").help("Host to listen on").default_value(std::string("localhost"));
+  serveCommand.add_argument("--port").help("Port to listen on").default_value(std::string("8000"));
+  serveCommand.add_argument("--cache-size")
+      .help("Megabytes of rendered pages kept in memory")
+      .default_value(std::string("256"));
+  program.add_subparser(serveCommand);
+
+  // Editors show what the documentation of a file will look like while it's being edited
+  argparse::ArgumentParser previewCommand("preview");
+  previewCommand.add_description(
+      "Index a single file and print the HTML pages of the symbols declared in it, as a JSON object of page names.");
+  previewCommand.add_argument("file").help("Path of the file");
+  previewCommand.add_argument("--flags").help("Compiler flags to parse the file with instead of its compile command");
+  previewCommand.add_argument("--stdin")
+      .help("Read the contents of the file from stdin, like an unsaved buffer")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_subparser(previewCommand);
+
   // Parse command line arguments
   try {
     program.parse_args(argc, argv);
@@ -40,6 +156,77 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
     return;
   }
 
+  if (program.is_subcommand_used("index")) {
+    cfg->command = hdoc::types::Command::Index;
+    if (!parseShard(indexCommand.get<std::string>("--shard"), cfg->shardIndex, cfg->numShards)) {
+      spdlog::error("Invalid shard '{}'. It must be K/N, where K is between 1 and N.",
+                    indexCommand.get<std::string>("--shard"));
+      return;
+    }
+    cfg->partialIndexPath = indexCommand.get<std::string>("--output");
+  } else if (program.is_subcommand_used("merge")) {
+    cfg->command = hdoc::types::Command::Merge;
+    const auto paths = mergeCommand.present<std::vector<std::string>>("partial_indexes");
+    if (!paths || paths->empty()) {
+      spdlog::error("'hdoc merge' needs the paths of the partial indexes to merge.");
+      return;
+    }
+    cfg->partialIndexPaths.assign(paths->begin(), paths->end());
+  } else if (program.is_subcommand_used("update")) {
+    cfg->command     = hdoc::types::Command::Update;
+    const auto paths = updateCommand.present<std::vector<std::string>>("partial_indexes");
+    if (!paths || paths->empty()) {
+      spdlog::error("'hdoc update' needs the paths of the partial indexes to update.");
+      return;
+    }
+    cfg->partialIndexPaths.assign(paths->begin(), paths->end());
+    cfg->changedSinceRef = updateCommand.present("--since").value_or("");
+    if (const auto changed = updateCommand.present<std::vector<std::string>>("--changed")) {
+      cfg->changedFiles = *changed;
+    }
+    if (cfg->changedSinceRef.empty() && cfg->changedFiles.empty()) {
+      spdlog::error("'hdoc update' needs a git ref with --since or changed files with --changed.");
+      return;
+    }
+  } else if (program.is_subcommand_used("watch")) {
+    cfg->command = hdoc::types::Command::Watch;
+    if (cfg->binaryType == hdoc::types::BinaryType::Online) {
+      spdlog::error("'hdoc watch' saves documentation locally, which this version of hdoc can't do.");
+      return;
+    }
+  } else if (program.is_subcommand_used("serve")) {
+    if (cfg->binaryType == hdoc::types::BinaryType::Online) {
+      spdlog::error("'hdoc serve' serves documentation locally, which this version of hdoc can't do.");
+      return;
+    }
+    cfg->command                = hdoc::types::Command::Serve;
+    cfg->serveHost              = serveCommand.get<std::string>("--host");
+    const std::string port      = serveCommand.get<std::string>("--port");
+    const std::string cache     = serveCommand.get<std::string>("--cache-size");
+    uint64_t          cacheSize = 0;
+    if (std::from_chars(port.data(), port.data() + port.size(), cfg->servePort).ptr != port.data() + port.size() ||
+        cfg->servePort > 65535) {
+      spdlog::error("Invalid port '{}'.", port);
+      return;
+    }
+    if (std::from_chars(cache.data(), cache.data() + cache.size(), cacheSize).ptr != cache.data() + cache.size()) {
+      spdlog::error("Invalid cache size '{}'. It must be a number of megabytes.", cache);
+      return;
+    }
+    cfg->serveCacheSize = cacheSize * 1024 * 1024;
+  } else if (program.is_subcommand_used("preview")) {
+    cfg->command          = hdoc::types::Command::Preview;
+    cfg->previewPath      = std::filesystem::absolute(previewCommand.get<std::string>("file")).lexically_normal();
+    cfg->previewFromStdin = previewCommand.get<bool>("--stdin");
+    if (const auto flags = previewCommand.present("--flags")) {
+      llvm::BumpPtrAllocator             alloc;
+      llvm::StringSaver                  saver(alloc);
+      llvm::SmallVector<const char*, 32> tokens;
+      llvm::cl::TokenizeGNUCommandLine(*flags, saver, tokens);
+      cfg->previewFlags.assign(tokens.begin(), tokens.end());
+    }
+  }
+
   // Display open source attribution by dumping the contents of the OSS attribution file and exit
   if (program.get<bool>("--oss") == true) {
     spdlog::set_level(spdlog::level::info);
@@ -47,6 +234,11 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
     std::exit(0);
   }
 
+  // Previews are printed to stdout, so log messages go to stderr instead
+  if (cfg->command == hdoc::types::Command::Preview) {
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+  }
+
   // Toggle verbosity depending on state of command line switch
   if (program.get<bool>("--verbose") == true) {
     spdlog::set_level(spdlog::level::info);
@@ -61,6 +253,16 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
     return;
   }
 
+  // Changed files are matched against the files symbols were declared in, which are relative to the root directory
+  if (cfg->command == hdoc::types::Command::Update) {
+    if (!cfg->changedSinceRef.empty() && !getChangedFiles(cfg->changedSinceRef, cfg->changedFiles)) {
+      return;
+    }
+    for (auto& file : cfg->changedFiles) {
+      file = std::filesystem::absolute(file).lexically_normal().lexically_relative(cfg->rootDir).string();
+    }
+  }
+
   // Parse configuration file
   toml::table toml;
   try {
@@ -94,6 +296,137 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
     return;
   }
 
+  // The index cache is optional, and only used if a directory for it is specified
+  cfg->cacheDir = std::filesystem::path(toml["cache"]["dir"].value_or(""));
+
+  // Options that only affect how fast indexing is, not its result
+  if (const toml::value<bool>* skipIndexedFiles = toml["indexing"]["skip_indexed_files"].as_boolean()) {
+    cfg->skipIndexedFiles = skipIndexedFiles->get();
+  }
+  if (const toml::value<bool>* useSharedPCH = toml["indexing"]["shared_pch"].as_boolean()) {
+    cfg->useSharedPCH = useSharedPCH->get();
+  }
+  if (const toml::value<bool>* skipFunctionBodies = toml["indexing"]["skip_function_bodies"].as_boolean()) {
+    cfg->skipFunctionBodies = skipFunctionBodies->get();
+  }
+  if (const toml::value<bool>* reusePrebuilt = toml["indexing"]["reuse_prebuilt"].as_boolean()) {
+    cfg->reusePrebuilt = reusePrebuilt->get();
+  }
+  if (const toml::value<bool>* deduplicateCommands = toml["indexing"]["deduplicate_commands"].as_boolean()) {
+    cfg->deduplicateCommands = deduplicateCommands->get();
+  }
+  if (const toml::value<bool>* minimalTUSet = toml["indexing"]["minimal_tu_set"].as_boolean()) {
+    cfg->minimalTUSet = minimalTUSet->get();
+  }
+  const std::string schedule = toml["indexing"]["schedule"].value_or("longest_first");
+  if (schedule == "database") {
+    cfg->schedulingPolicy = hdoc::types::SchedulingPolicy::Database;
+  } else if (schedule == "longest_first") {
+    cfg->schedulingPolicy = hdoc::types::SchedulingPolicy::LongestFirst;
+  } else if (schedule == "directory") {
+    cfg->schedulingPolicy = hdoc::types::SchedulingPolicy::Directory;
+  } else {
+    spdlog::error("Invalid 'schedule' in .hdoc.toml: '{}'. It must be 'database', 'longest_first', or 'directory'.",
+                  schedule);
+    return;
+  }
+  const std::string headerOnly = toml["indexing"]["header_only"].value_or("off");
+  if (headerOnly == "off") {
+    cfg->headerOnlyMode = hdoc::types::HeaderOnlyMode::Disabled;
+  } else if (headerOnly == "per_header") {
+    cfg->headerOnlyMode = hdoc::types::HeaderOnlyMode::PerHeader;
+  } else if (headerOnly == "per_directory") {
+    cfg->headerOnlyMode = hdoc::types::HeaderOnlyMode::PerDirectory;
+  } else {
+    spdlog::error("Invalid 'header_only' in .hdoc.toml: '{}'. It must be 'off', 'per_header', or 'per_directory'.",
+                  headerOnly);
+    return;
+  }
+  if (const auto& headerDirs = toml["indexing"]["header_dirs"].as_array()) {
+    for (const auto& d : *headerDirs) {
+      std::string s = d.value_or(std::string(""));
+      if (s == "") {
+        spdlog::warn("A header directory from .hdoc.toml was malformed, ignoring it.");
+        continue;
+      }
+      cfg->headerDirs.emplace_back(s);
+    }
+  }
+  if (const toml::value<int64_t>* processes = toml["indexing"]["processes"].as_integer()) {
+    if (processes->get() < 0) {
+      spdlog::error("Number of worker processes must be a positive integer greater than or equal to 0.");
+      return;
+    }
+    cfg->numProcesses = processes->get();
+  }
+  if (const toml::value<int64_t>* maxWorkerRSS = toml["indexing"]["max_worker_rss_mb"].as_integer()) {
+    if (maxWorkerRSS->get() < 0) {
+      spdlog::error("Maximum RSS of worker processes must be a positive integer greater than or equal to 0.");
+      return;
+    }
+    cfg->maxWorkerRSS = static_cast<uint64_t>(maxWorkerRSS->get()) * 1024 * 1024;
+  }
+  if (const toml::value<int64_t>* memoryBudget = toml["indexing"]["memory_budget_mb"].as_integer()) {
+    if (memoryBudget->get() < 0) {
+      spdlog::error("Memory budget must be a positive integer greater than or equal to 0.");
+      return;
+    }
+    cfg->memoryBudget = static_cast<uint64_t>(memoryBudget->get()) * 1024 * 1024;
+  }
+  if (const auto timeout = toml["indexing"]["timeout"]) {
+    const std::optional<double> seconds = timeout.value<double>();
+    if (!seconds || *seconds < 0) {
+      spdlog::error("Timeout in .hdoc.toml must be a number of seconds greater than or equal to 0.");
+      return;
+    }
+    cfg->tuTimeout = *seconds;
+  }
+  const std::string quarantine = toml["indexing"]["quarantine"].value_or("deprioritize");
+  if (quarantine == "deprioritize") {
+    cfg->quarantinePolicy = hdoc::types::QuarantinePolicy::Deprioritize;
+  } else if (quarantine == "skip") {
+    cfg->quarantinePolicy = hdoc::types::QuarantinePolicy::Skip;
+  } else {
+    spdlog::error("Invalid 'quarantine' in .hdoc.toml: '{}'. It must be 'deprioritize' or 'skip'.", quarantine);
+    return;
+  }
+  // Files that timed out are remembered next to the index cache, unless a file of their own is given
+  cfg->quarantinePath = std::filesystem::path(toml["indexing"]["quarantine_file"].value_or(""));
+  if (cfg->quarantinePath.empty() && !cfg->cacheDir.empty()) {
+    cfg->quarantinePath = cfg->cacheDir / "quarantine";
+  }
+  if (cfg->tuTimeout > 0 && cfg->quarantinePath.empty()) {
+    spdlog::warn("Files that time out won't be remembered by later runs, since neither 'quarantine_file' in the "
+                 "'indexing' section nor 'dir' in the 'cache' section of .hdoc.toml is set.");
+  }
+  if (const toml::value<bool>* stripUnneeded = toml["arguments"]["strip_unneeded"].as_boolean()) {
+    cfg->stripArguments = stripUnneeded->get();
+  }
+  if (const auto& keepArguments = toml["arguments"]["keep"].as_array()) {
+    for (const auto& a : *keepArguments) {
+      std::string s = a.value_or(std::string(""));
+      if (s == "") {
+        spdlog::warn("An argument to keep from .hdoc.toml was malformed, ignoring it.");
+        continue;
+      }
+      cfg->keepArguments.emplace_back(s);
+    }
+  }
+  if (const auto& stripArguments = toml["arguments"]["strip"].as_array()) {
+    for (const auto& a : *stripArguments) {
+      std::string s = a.value_or(std::string(""));
+      if (s == "") {
+        spdlog::warn("An argument to strip from .hdoc.toml was malformed, ignoring it.");
+        continue;
+      }
+      cfg->extraStripArguments.emplace_back(s);
+    }
+  }
+  if (cfg->headerOnlyMode != hdoc::types::HeaderOnlyMode::Disabled && cfg->headerDirs.empty()) {
+    spdlog::error("Header-only indexing requires 'header_dirs' in the 'indexing' section of .hdoc.toml.");
+    return;
+  }
+
   // Get other arguments from the .hdoc.toml file.
   cfg->outputDir        = std::filesystem::path(toml["paths"]["output_dir"].value_or(""));
   cfg->projectName      = toml["project"]["name"].value_or("");
@@ -129,6 +462,12 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
     cfg->numThreads = rawNumThreads;
   }
 
+  // A thread can only stop parsing a file between its top-level declarations, so a file that's stuck inside of one
+  // would hold up the run regardless of the timeout. Worker processes are killed if they don't stop in time.
+  if (cfg->tuTimeout > 0 && cfg->numProcesses == 0) {
+    cfg->numProcesses = llvm::hardware_concurrency(cfg->numThreads).compute_thread_count();
+  }
+
   // Determine the compiler's builtin include paths and add them to the list
   cfg->useSystemIncludes = toml["includes"]["use_system_includes"].value_or(true);
   if (cfg->useSystemIncludes == true) {
@@ -249,6 +588,12 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
   if (const toml::value<bool>* debugDumpJSONPayload = toml["debug"]["dump_json_payload"].as_boolean()) {
     cfg->debugDumpJSONPayload = debugDumpJSONPayload->get();
   }
+  if (const toml::value<bool>* verifyMinimalTUSet = toml["debug"]["verify_minimal_tu_set"].as_boolean()) {
+    cfg->debugVerifyMinimalTUSet = verifyMinimalTUSet->get();
+  }
+  if (const toml::value<bool>* compareArguments = toml["debug"]["compare_arguments"].as_boolean()) {
+    cfg->debugCompareArguments = compareArguments->get();
+  }
 
   // Collect paths to markdown files
   cfg->homepage = std::filesystem::path(toml["pages"]["homepage"].value_or(""));
@@ -289,10 +634,43 @@ hdoc::frontend::Frontend::Frontend(int argc, char** argv, hdoc::types::Config* c
   if (cfg->binaryType != hdoc::types::BinaryType::Online) {
     spdlog::info("Output directory: {}", cfg->outputDir.string());
   }
+  if (!cfg->cacheDir.empty()) {
+    spdlog::info("Index cache directory: {}", cfg->cacheDir.string());
+  }
   spdlog::info("Project name: {}", cfg->projectName);
   spdlog::info("Project version: {}", cfg->projectVersion);
   spdlog::info("Indexing using {} threads",
                cfg->numThreads == 0 ? std::string("all") : std::to_string(cfg->numThreads));
+  if (cfg->numProcesses > 0) {
+    spdlog::info("Parsing files in {} worker processes", cfg->numProcesses);
+  }
+  if (cfg->memoryBudget > 0) {
+    spdlog::info("Parsing files within a memory budget of {} MB", cfg->memoryBudget / (1024 * 1024));
+  }
+  if (cfg->tuTimeout > 0) {
+    spdlog::info("Abandoning files that take longer than {} seconds", cfg->tuTimeout);
+  }
+  if (cfg->command == hdoc::types::Command::Index) {
+    spdlog::info(
+        "Indexing shard {} of {} into {}", cfg->shardIndex + 1, cfg->numShards, cfg->partialIndexPath.string());
+  }
+  if (cfg->command == hdoc::types::Command::Merge) {
+    spdlog::info("Merging {} partial indexes", cfg->partialIndexPaths.size());
+  }
+  if (cfg->command == hdoc::types::Command::Watch) {
+    spdlog::info("Watching project files for changes");
+  }
+  if (cfg->command == hdoc::types::Command::Preview) {
+    spdlog::info("Previewing {}", cfg->previewPath.string());
+  }
+  if (cfg->command == hdoc::types::Command::Serve) {
+    spdlog::info("Keeping up to {} MB of rendered pages in memory", cfg->serveCacheSize / (1024 * 1024));
+  }
+  if (cfg->command == hdoc::types::Command::Update) {
+    spdlog::info("Updating {} partial indexes for {} changed files",
+                 cfg->partialIndexPaths.size(),
+                 cfg->changedFiles.size());
+  }
   if (cfg->debugLimitNumIndexedFiles > 0) {
     spdlog::info("Only indexing {} files ", std::to_string(cfg->debugLimitNumIndexedFiles));
   }
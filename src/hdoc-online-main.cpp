@@ -30,7 +30,20 @@ int main(int argc, char** argv) {
 
   llvm::ThreadPool       pool(llvm::hardware_concurrency(cfg.numThreads));
   hdoc::indexer::Indexer indexer(&cfg, pool);
-  indexer.run();
+  if (cfg.command == hdoc::types::Command::Merge) {
+    for (const auto& path : cfg.partialIndexPaths) {
+      if (!indexer.loadPartialIndex(path)) {
+        return EXIT_FAILURE;
+      }
+    }
+  } else if (!indexer.run()) {
+    return EXIT_FAILURE;
+  }
+
+  // Partial indexes are saved before postprocessing, which needs all symbols
+  if (cfg.command == hdoc::types::Command::Index) {
+    return indexer.savePartialIndex(cfg.partialIndexPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
   indexer.pruneMethods();
   indexer.pruneTypeRefs();
   indexer.resolveNamespaces();
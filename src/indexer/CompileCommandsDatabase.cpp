@@ -0,0 +1,355 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/CompileCommandsDatabase.hpp"
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/reader.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+/// Absolute and normalized version of path, which may be relative to dir
+static std::string getAbsolutePath(const llvm::StringRef dir, const llvm::StringRef path) {
+  llvm::SmallString<128> absPath(path);
+  llvm::sys::fs::make_absolute(dir, absPath);
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/true);
+  return absPath.str().str();
+}
+
+/// Remove compiler wrappers like ccache from the front of args, the same way JSONCompilationDatabase does.
+/// `ccache g++ a.cpp` is compiled by g++, while `ccache a.cpp` is compiled by the default compiler and kept as it is.
+static void unwrapCompiler(std::vector<std::string>& args) {
+  while (args.size() >= 2) {
+    const llvm::StringRef wrapper = llvm::sys::path::stem(args.front());
+    if (wrapper != "ccache" && wrapper != "sccache" && wrapper != "distcc") {
+      return;
+    }
+    // Wrappers take no flags, so the next argument is a flag, an input with an extension, or a compiler without one
+    const llvm::StringRef next = llvm::StringRef(args[1]).drop_back(llvm::StringRef(args[1]).endswith(".exe") ? 4 : 0);
+    if (next.startswith("-") || llvm::sys::path::has_extension(next)) {
+      return;
+    }
+    args.erase(args.begin());
+  }
+}
+
+/// The arguments of cmd in a form that's the same for commands that parse its file the same way. Arguments that
+/// can't change declarations, like warnings, debug info, outputs, and dependency files, are left out along with the
+/// file itself. Everything else is kept, with the compiler reduced to its name, options with a value joined to it,
+/// and paths made absolute. Options that are passed on to a tool with -Xclang and the like are kept as they are.
+static std::string getDeclarationKey(const clang::tooling::CompileCommand& cmd) {
+  // Options with a value, which may be joined to the option or be the next argument if canJoin
+  struct ValueOption {
+    std::string_view name;
+    bool             isPath;
+    bool             canJoin;
+  };
+  // -include-pch is checked before -include, which is a prefix of it
+  static constexpr std::array<ValueOption, 17> valueOptions = {{
+      {"-D", false, true},
+      {"-U", false, true},
+      {"-I", true, true},
+      {"-isystem", true, true},
+      {"-iquote", true, true},
+      {"-idirafter", true, true},
+      {"-include-pch", true, false},
+      {"-include", true, true},
+      {"-imacros", true, true},
+      {"-isysroot", true, true},
+      {"-iframework", true, true},
+      {"-F", true, true},
+      {"--sysroot", true, false},
+      {"--sysroot=", true, true},
+      {"-x", false, true},
+      {"-target", false, false},
+      {"-arch", false, false},
+  }};
+  static constexpr std::array<std::string_view, 7> forwardOptions = {
+      "-Xclang", "-Xpreprocessor", "-Xassembler", "-Xlinker", "-Xarch_host", "-Xarch_device", "-mllvm"};
+  static constexpr std::array<std::string_view, 9> ignoredFlags = {
+      "-c", "-w", "-M", "-MM", "-MD", "-MMD", "-MP", "-MG", "-pipe"};
+  static constexpr std::array<std::string_view, 5> ignoredOptionsWithValue = {"-o", "-MF", "-MT", "-MQ", "-MJ"};
+
+  const auto isIgnored = [](const std::string_view arg) {
+    return std::find(ignoredFlags.begin(), ignoredFlags.end(), arg) != ignoredFlags.end() ||
+           (arg.starts_with("-W") && !arg.starts_with("-Wl,") && !arg.starts_with("-Wa,") &&
+            !arg.starts_with("-Wp,")) ||
+           arg.starts_with("-pedantic") || (arg.starts_with("-g") && !arg.starts_with("-gcc"));
+  };
+
+  const std::string file = getAbsolutePath(cmd.Directory, cmd.Filename);
+  std::string       key  = cmd.CommandLine.empty() ? "" : llvm::sys::path::filename(cmd.CommandLine.front()).str();
+  for (std::size_t i = 1; i < cmd.CommandLine.size(); i++) {
+    const std::string_view arg  = cmd.CommandLine[i];
+    const bool             last = i + 1 == cmd.CommandLine.size();
+    if (isIgnored(arg)) {
+      continue;
+    }
+    if (std::find(forwardOptions.begin(), forwardOptions.end(), arg) != forwardOptions.end()) {
+      key += '\0' + std::string(arg) + (last ? "" : '\0' + cmd.CommandLine[++i]);
+      continue;
+    }
+    const auto ignored = std::find_if(ignoredOptionsWithValue.begin(),
+                                      ignoredOptionsWithValue.end(),
+                                      [&](const std::string_view option) { return arg.starts_with(option); });
+    if (ignored != ignoredOptionsWithValue.end()) {
+      i += arg == *ignored ? 1 : 0;
+      continue;
+    }
+    if (!arg.starts_with("-")) {
+      if (getAbsolutePath(cmd.Directory, arg) != file) {
+        key += '\0' + getAbsolutePath(cmd.Directory, arg);
+      }
+      continue;
+    }
+
+    const auto option = std::find_if(valueOptions.begin(), valueOptions.end(), [&](const ValueOption& o) {
+      return arg == o.name || (o.canJoin && arg.starts_with(o.name));
+    });
+    if (option == valueOptions.end() || (arg == option->name && last)) {
+      key += '\0' + std::string(arg);
+      continue;
+    }
+    const std::string_view value = arg == option->name ? cmd.CommandLine[++i] : arg.substr(option->name.size());
+    key += '\0' + std::string(option->name.ends_with('=') ? option->name.substr(0, option->name.size() - 1)
+                                                              : option->name);
+    key += option->isPath ? getAbsolutePath(cmd.Directory, value) : std::string(value);
+  }
+  return key;
+}
+
+namespace {
+/// Builds compile commands from the events of rapidjson's streaming reader, so that only the command that's being
+/// read is kept in memory apart from the ones that were read already. The file is an array of objects with a
+/// "directory", a "file", and either a "command" or "arguments", the latter taking precedence.
+class CompileCommandsHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CompileCommandsHandler> {
+public:
+  /// onCommand receives every command that was read, and returns false to stop reading
+  CompileCommandsHandler(const std::function<bool(clang::tooling::CompileCommand&)>& onCommand)
+      : onCommand(onCommand), saver(allocator) {}
+
+  bool StartArray() {
+    if (this->depth == 1) {
+      return this->fail("compile commands must be objects");
+    }
+    if (this->depth == 2 && this->key == "arguments") {
+      this->hasArguments = true;
+    }
+    this->depth++;
+    return true;
+  }
+
+  bool EndArray(rapidjson::SizeType) {
+    this->depth--;
+    return true;
+  }
+
+  bool StartObject() {
+    if (this->depth == 0) {
+      return this->fail("expected an array of compile commands");
+    }
+    if (this->depth == 1) {
+      this->cmd = clang::tooling::CompileCommand();
+      this->command.clear();
+      this->hasDirectory = this->hasFile = this->hasCommand = this->hasArguments = false;
+    }
+    this->depth++;
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType) {
+    this->depth--;
+    return this->depth != 1 || this->finishCommand();
+  }
+
+  bool Key(const char* str, const rapidjson::SizeType length, bool) {
+    if (this->depth == 2) {
+      this->key.assign(str, length);
+    }
+    return true;
+  }
+
+  bool String(const char* str, const rapidjson::SizeType length, bool) {
+    if (this->depth == 3 && this->key == "arguments") {
+      this->cmd.CommandLine.emplace_back(str, length);
+      return true;
+    }
+    if (this->depth != 2) {
+      return this->depth > 2 || this->fail("expected an array of compile commands");
+    }
+
+    if (this->key == "directory") {
+      this->cmd.Directory.assign(str, length);
+      this->hasDirectory = true;
+    } else if (this->key == "file") {
+      this->cmd.Filename.assign(str, length);
+      this->hasFile = true;
+    } else if (this->key == "command") {
+      this->command.assign(str, length);
+      this->hasCommand = true;
+    } else if (this->key == "output") {
+      this->cmd.Output.assign(str, length);
+    }
+    return true;
+  }
+
+  /// Numbers, booleans, and null, which are only allowed in values that are ignored
+  bool Default() { return this->depth > 1 || this->fail("expected an array of compile commands"); }
+
+  /// Why reading stopped, if it wasn't because onCommand asked for it
+  const std::string& getError() const { return this->error; }
+
+private:
+  bool fail(const std::string& message) {
+    this->error = message;
+    return false;
+  }
+
+  bool finishCommand() {
+    if (!this->hasDirectory || !this->hasFile || (!this->hasCommand && !this->hasArguments)) {
+      return this->fail("compile command " + std::to_string(this->numCommands) + " is missing the " +
+                        (!this->hasDirectory ? "directory" : !this->hasFile ? "file" : "command or arguments"));
+    }
+    this->numCommands++;
+
+    // Commands are split like a shell would, which is what JSONCommandLineSyntax::AutoDetect does on this platform
+    if (!this->hasArguments) {
+      llvm::SmallVector<const char*, 64> argv;
+      llvm::cl::TokenizeGNUCommandLine(this->command, this->saver, argv);
+      this->cmd.CommandLine.assign(argv.begin(), argv.end());
+      this->allocator.Reset();
+    }
+    unwrapCompiler(this->cmd.CommandLine);
+    return this->onCommand(this->cmd);
+  }
+
+  const std::function<bool(clang::tooling::CompileCommand&)>& onCommand;
+
+  std::size_t                    depth = 0;   ///< Arrays and objects the reader is in
+  std::string                    key;         ///< Last key of the current compile command
+  clang::tooling::CompileCommand cmd;         ///< Compile command that's being read
+  std::string                    command;     ///< Its "command", which is only split once it's complete
+  bool                           hasDirectory = false;
+  bool                           hasFile      = false;
+  bool                           hasCommand   = false;
+  bool                           hasArguments = false;
+  std::size_t                    numCommands  = 0;
+  llvm::BumpPtrAllocator         allocator; ///< Holds the arguments of a command while it's split
+  llvm::StringSaver              saver;
+  std::string                    error;
+};
+} // namespace
+
+bool hdoc::indexer::CompileCommandsDatabase::load(const std::string&  path,
+                                                  std::string&        err,
+                                                  const FileFilter&   filter,
+                                                  const uint32_t      maxFiles,
+                                                  const FileCallback& onFile) {
+  // The reader stops at the null terminator, which LLVM adds after the mapped file
+  const auto buffer = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/true);
+  if (!buffer) {
+    err = "unable to read " + path + ": " + buffer.getError().message();
+    return false;
+  }
+  {
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    this->commands.clear();
+    this->indices.clear();
+    this->files.clear();
+    this->numFiltered          = 0;
+    this->numDuplicates        = 0;
+    this->numDeduplicatedFiles = 0;
+  }
+
+  // Keys of the commands that were kept, prefixed with their file
+  std::unordered_set<std::string> keys;
+  std::unordered_set<std::string> deduplicatedFiles;
+
+  std::size_t                                                numFiles = 0;
+  bool                                                       stopped  = false;
+  const std::function<bool(clang::tooling::CompileCommand&)> onCommand =
+      [&](clang::tooling::CompileCommand& cmd) {
+        const std::string file = getAbsolutePath(cmd.Directory, cmd.Filename);
+        if (filter && !filter(file)) {
+          this->numFiltered++;
+          return true;
+        }
+        if (this->deduplicate && !keys.emplace(file + '\0' + getDeclarationKey(cmd)).second) {
+          this->numDuplicates++;
+          deduplicatedFiles.emplace(file);
+          return true;
+        }
+        const bool isFirst = this->add(file, std::move(cmd));
+        if (onFile) {
+          onFile(file);
+        }
+        if (!isFirst) {
+          return true;
+        }
+        stopped = maxFiles > 0 && ++numFiles >= maxFiles;
+        return !stopped;
+      };
+
+  CompileCommandsHandler        handler(onCommand);
+  rapidjson::Reader             reader;
+  rapidjson::StringStream       stream((*buffer)->getBufferStart());
+  const rapidjson::ParseResult result = reader.Parse(stream, handler);
+  this->numDeduplicatedFiles = deduplicatedFiles.size();
+  if (result.IsError() && !stopped) {
+    err = path + ": " +
+          (handler.getError().empty() ? rapidjson::GetParseError_En(result.Code()) : handler.getError()) +
+          " at offset " + std::to_string(result.Offset());
+    return false;
+  }
+  return true;
+}
+
+bool hdoc::indexer::CompileCommandsDatabase::add(const std::string& path, clang::tooling::CompileCommand cmd) {
+  std::unique_lock<std::shared_mutex> lock(this->mutex);
+  auto&                               fileIndices = this->indices[path];
+  const bool                          isFirst     = fileIndices.empty();
+  fileIndices.emplace_back(this->commands.size());
+  this->commands.emplace_back(std::move(cmd));
+  if (isFirst) {
+    this->files.emplace_back(path);
+  }
+  return isFirst;
+}
+
+std::vector<clang::tooling::CompileCommand>
+hdoc::indexer::CompileCommandsDatabase::getCompileCommands(llvm::StringRef FilePath) const {
+  llvm::SmallString<128> path(FilePath);
+  llvm::sys::fs::make_absolute(path);
+  llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  const auto                          it = this->indices.find(path.str().str());
+  if (it == this->indices.end()) {
+    return {};
+  }
+  std::vector<clang::tooling::CompileCommand> cmds;
+  for (const std::size_t i : it->second) {
+    cmds.emplace_back(this->commands[i]);
+  }
+  return cmds;
+}
+
+std::vector<std::string> hdoc::indexer::CompileCommandsDatabase::getAllFiles() const {
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  return this->files;
+}
+
+std::vector<clang::tooling::CompileCommand> hdoc::indexer::CompileCommandsDatabase::getAllCompileCommands() const {
+  std::shared_lock<std::shared_mutex> lock(this->mutex);
+  return this->commands;
+}
@@ -0,0 +1,77 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+namespace hdoc::indexer {
+/// @brief Compilation database read from compile_commands.json with a streaming parser over the memory-mapped file.
+///
+/// Clang's JSONCompilationDatabase builds a YAML tree of the whole file before any command can be looked up, and
+/// splits a command into its arguments again every time it's looked up. Here, every command is split once while
+/// the file is read, and files can be looked up and handed out for parsing while the rest of it is still being read.
+/// Files are looked up by their absolute, normalized path.
+class CompileCommandsDatabase : public clang::tooling::CompilationDatabase {
+public:
+  /// Decides if the source file at an absolute path is kept while reading
+  using FileFilter = std::function<bool(const std::string& path)>;
+
+  /// Called with the absolute path of a file that is kept every time one of its commands was read, since files that
+  /// are handed out while reading may still gain commands further down in the file
+  using FileCallback = std::function<void(const std::string& path)>;
+
+  /// @brief Leave out the commands of a file that parse it the same way as a command of it that was read before
+  /// them, like the ones of the build configurations in a multi-configuration database. Commands are considered
+  /// the same if they only differ in arguments that can't change declarations: warnings, debug info, outputs, and
+  /// dependency files.
+  void useDeduplication(const bool deduplicate) { this->deduplicate = deduplicate; }
+
+  /// @brief Read the compile commands in the file at path, in order. Commands of files that filter rejects are left
+  /// out, and reading stops once maxFiles files were kept (0 == read all). Returns false and sets err if the file
+  /// can't be read or isn't a valid compilation database, in which case the commands read so far are kept.
+  bool load(const std::string&  path,
+            std::string&        err,
+            const FileFilter&   filter   = nullptr,
+            const uint32_t      maxFiles = 0,
+            const FileCallback& onFile   = nullptr);
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef FilePath) const override;
+  std::vector<std::string>                    getAllFiles() const override;
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override;
+
+  /// @brief Number of commands that were kept
+  std::size_t getNumCommands() const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->commands.size();
+  }
+
+  /// @brief Number of commands that filter rejected in the last call to load()
+  std::size_t getNumFilteredCommands() const { return this->numFiltered; }
+
+  /// @brief Number of commands that were left out as duplicates in the last call to load()
+  std::size_t getNumDuplicateCommands() const { return this->numDuplicates; }
+
+  /// @brief Number of files that duplicates were left out of in the last call to load()
+  std::size_t getNumDeduplicatedFiles() const { return this->numDeduplicatedFiles; }
+
+private:
+  /// Add the command of the file at the absolute path. Returns true if it's the file's first command.
+  bool add(const std::string& path, clang::tooling::CompileCommand cmd);
+
+  std::vector<clang::tooling::CompileCommand>               commands; ///< In the order they were read
+  std::unordered_map<std::string, std::vector<std::size_t>> indices;  ///< Commands of each file by absolute path
+  std::vector<std::string>                                  files;    ///< In the order of their first command
+  std::size_t               numFiltered          = 0;     ///< Commands that were left out by the filter
+  bool                      deduplicate          = false; ///< Leave out commands that parse a file the same way?
+  std::size_t               numDuplicates        = 0;     ///< Commands that were left out as duplicates
+  std::size_t               numDeduplicatedFiles = 0;     ///< Files that duplicates were left out of
+  mutable std::shared_mutex mutex; ///< Guards commands, indices, and files while the file is read
+};
+} // namespace hdoc::indexer
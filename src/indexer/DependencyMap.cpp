@@ -0,0 +1,91 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/DependencyMap.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <fstream>
+
+void hdoc::indexer::DependencyMap::add(const std::string& file, const std::vector<std::string>& dependencies) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->dependencies[file] = dependencies;
+}
+
+void hdoc::indexer::DependencyMap::extend(const std::string& file, const std::vector<std::string>& dependencies) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<std::string>&   recorded = this->dependencies[file];
+  recorded.insert(recorded.end(), dependencies.begin(), dependencies.end());
+  std::sort(recorded.begin(), recorded.end());
+  recorded.erase(std::unique(recorded.begin(), recorded.end()), recorded.end());
+}
+
+bool hdoc::indexer::DependencyMap::load(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+
+  // Every source file is on a line of its own, followed by the files it included, each on a line indented by a tab
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<std::string>*   current = nullptr;
+  std::string                 line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (line[0] != '\t') {
+      current = &this->dependencies[line];
+      current->clear();
+    } else if (current != nullptr) {
+      current->emplace_back(line.substr(1));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool hdoc::indexer::DependencyMap::save(const std::filesystem::path& path) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::ofstream               out(path);
+  for (const auto& [file, dependencies] : this->dependencies) {
+    out << file << '\n';
+    for (const auto& dep : dependencies) {
+      out << '\t' << dep << '\n';
+    }
+  }
+  if (!out) {
+    spdlog::error("Unable to save the dependencies of the indexed files to {}.", path.string());
+    return false;
+  }
+  return true;
+}
+
+std::vector<std::string>
+hdoc::indexer::DependencyMap::getAffectedFiles(const std::vector<std::string>&        files,
+                                               const std::unordered_set<std::string>& changedFiles) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  const auto                  isChanged = [&](const std::string& path) { return changedFiles.count(path) > 0; };
+
+  std::vector<std::string> affected;
+  for (const auto& file : files) {
+    // Source files that weren't indexed before only need to be indexed if they were changed themselves, since a new
+    // file is always part of the changes
+    const auto it = this->dependencies.find(file);
+    if (isChanged(std::filesystem::path(file).lexically_normal().string()) ||
+        (it != this->dependencies.end() && std::any_of(it->second.begin(), it->second.end(), isChanged))) {
+      affected.emplace_back(file);
+    }
+  }
+  return affected;
+}
+
+std::vector<std::string> hdoc::indexer::DependencyMap::getAllDependencies() const {
+  std::lock_guard<std::mutex>     lock(this->mutex);
+  std::unordered_set<std::string> all;
+  for (const auto& [file, dependencies] : this->dependencies) {
+    all.insert(dependencies.begin(), dependencies.end());
+  }
+  return std::vector<std::string>(all.begin(), all.end());
+}
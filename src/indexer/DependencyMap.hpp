@@ -0,0 +1,44 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace hdoc::indexer {
+/// @brief Thread-safe map from source files to the absolute paths of the files they included when they were indexed.
+///
+/// `hdoc index` saves it next to its partial index, so that `hdoc update` can find the source files that have to be
+/// indexed again after some files changed without parsing anything.
+class DependencyMap {
+public:
+  /// @brief Record the files that a source file included, replacing what was recorded for it before
+  void add(const std::string& file, const std::vector<std::string>& dependencies);
+
+  /// @brief Record more files that a source file included, in addition to what was recorded for it before
+  void extend(const std::string& file, const std::vector<std::string>& dependencies);
+
+  /// @brief Load a map saved by save() and add its entries. Returns false if it can't be read.
+  bool load(const std::filesystem::path& path);
+
+  /// @brief Save all entries to path. Returns false if it couldn't be written.
+  bool save(const std::filesystem::path& path) const;
+
+  /// @brief The files among files that changed themselves or included a changed file when they were recorded.
+  /// changedFiles holds absolute paths.
+  std::vector<std::string> getAffectedFiles(const std::vector<std::string>&        files,
+                                            const std::unordered_set<std::string>& changedFiles) const;
+
+  /// @brief All files that any of the recorded files included, without duplicates
+  std::vector<std::string> getAllDependencies() const;
+
+private:
+  std::map<std::string, std::vector<std::string>> dependencies; ///< Ordered so that saved maps are reproducible
+  mutable std::mutex                              mutex;
+};
+} // namespace hdoc::indexer
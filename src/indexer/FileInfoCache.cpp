@@ -0,0 +1,76 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/FileInfoCache.hpp"
+#include "spdlog/spdlog.h"
+
+#include "clang/Basic/FileManager.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+
+/// FileInfo of files without a path, like the scratch buffer or builtins
+static const hdoc::indexer::FileInfo kNoPath;
+
+const hdoc::indexer::FileInfo& hdoc::indexer::SharedFileInfoCache::get(const std::string& canonicalPath) {
+  {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    if (const auto it = this->files.find(canonicalPath); it != this->files.end()) {
+      return it->second;
+    }
+  }
+
+  FileInfo info;
+  info.hasPath = true;
+  info.relPath = std::filesystem::relative(std::filesystem::path(canonicalPath), this->cfg->rootDir).string();
+  // ".." is used as a janky way to determine if the path is outside of rootDir since the canonicalized path
+  // should not have any ".."s in it
+  info.outsideRootDir = info.relPath.find("..") != std::string::npos;
+  info.ignored = std::any_of(this->cfg->ignorePaths.begin(), this->cfg->ignorePaths.end(), [&](const std::string& s) {
+    return info.relPath.find(s) != std::string::npos;
+  });
+
+  // References to elements of an unordered_map stay valid when other elements are inserted
+  std::unique_lock<std::shared_mutex> lock(this->mutex);
+  return this->files.try_emplace(canonicalPath, std::move(info)).first->second;
+}
+
+const hdoc::indexer::FileInfo& hdoc::indexer::FileInfoCache::get(const clang::FileID fid) {
+  const auto [it, inserted] = this->files.try_emplace(fid, &kNoPath);
+  if (!inserted) {
+    return *it->second;
+  }
+
+  const clang::FileEntry* fileEntry = this->sm.getFileEntryForID(fid);
+  if (fileEntry == nullptr) {
+    return kNoPath;
+  }
+
+  // The working directory of the parser is changed during indexing, and other threads have no visibility of
+  // this, so the path is made canonical through the VFS of this TU. This is similar to what clang does.
+  clang::FileManager&    fileManager = this->sm.getFileManager();
+  llvm::SmallString<128> path        = fileEntry->getName();
+  if (!llvm::sys::path::is_absolute(path)) {
+    if (auto ec = fileManager.getVirtualFileSystem().makeAbsolute(path)) {
+      spdlog::warn("Could not turn relative path '{}' to absolute: {}", path.c_str(), ec.message().c_str());
+      return kNoPath;
+    }
+  }
+
+  std::string canonicalPath = path.str().str();
+  if (auto dir = fileManager.getDirectoryRef(llvm::sys::path::parent_path(path))) {
+    llvm::SmallString<128> realPath;
+    llvm::sys::path::append(realPath, fileManager.getCanonicalName(dir.get()), llvm::sys::path::filename(path));
+    canonicalPath = realPath.str().str();
+  }
+
+  it->second = &this->shared.get(canonicalPath);
+  return *it->second;
+}
+
+const hdoc::indexer::FileInfo& hdoc::indexer::FileInfoCache::get(const clang::Decl* d) {
+  return this->get(this->sm.getFileID(this->sm.getFileLoc(d->getLocation())));
+}
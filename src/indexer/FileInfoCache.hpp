@@ -0,0 +1,55 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include "types/Config.hpp"
+
+namespace hdoc::indexer {
+/// @brief Where a file is relative to the project, and whether its declarations are ignored because of it.
+struct FileInfo {
+  bool        hasPath        = false; ///< Could the canonical path of the file be determined?
+  std::string relPath;                ///< Path relative to cfg->rootDir
+  bool        outsideRootDir = false; ///< Is the file outside of cfg->rootDir?
+  bool        ignored        = false; ///< Does the path match one of cfg->ignorePaths?
+};
+
+/// @brief FileInfo of every file seen by any thread, keyed by canonical path.
+class SharedFileInfoCache {
+public:
+  SharedFileInfoCache(const hdoc::types::Config* cfg) : cfg(cfg) {}
+
+  /// @brief FileInfo of the file at canonicalPath, computed the first time it's requested
+  const FileInfo& get(const std::string& canonicalPath);
+
+private:
+  const hdoc::types::Config*                cfg;
+  std::unordered_map<std::string, FileInfo> files;
+  std::shared_mutex                         mutex;
+};
+
+/// @brief FileInfo of the files in a single TU, keyed by FileID, in front of a SharedFileInfoCache.
+class FileInfoCache {
+public:
+  FileInfoCache(const clang::SourceManager& sm, SharedFileInfoCache& shared) : sm(sm), shared(shared) {}
+
+  /// @brief FileInfo of a file in the TU
+  const FileInfo& get(const clang::FileID fid);
+
+  /// @brief FileInfo of the file a decl is in, with macro locations resolved to where the macro was used
+  const FileInfo& get(const clang::Decl* d);
+
+private:
+  const clang::SourceManager&                    sm;
+  SharedFileInfoCache&                           shared;
+  llvm::DenseMap<clang::FileID, const FileInfo*> files;
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,224 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/HeaderOnlyDatabase.hpp"
+#include "spdlog/spdlog.h"
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Extensions of the files in cfg->headerDirs that are treated as headers
+static const std::unordered_set<std::string> kHeaderExtensions = {".h", ".hh", ".hpp", ".hxx", ".h++"};
+
+/// Absolute and normalized version of path, which may be relative to dir
+static std::string getAbsolutePath(const llvm::StringRef dir, const llvm::StringRef path) {
+  llvm::SmallString<128> absPath(path);
+  llvm::sys::fs::make_absolute(dir, absPath);
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/true);
+  return absPath.str().str();
+}
+
+/// All headers in cfg->headerDirs that aren't in cfg->ignorePaths, sorted
+static std::vector<std::string> findHeaders(const hdoc::types::Config* cfg) {
+  std::vector<std::string> headers;
+  for (const auto& dir : cfg->headerDirs) {
+    const std::filesystem::path path = cfg->rootDir / dir;
+    if (!std::filesystem::is_directory(path)) {
+      spdlog::warn("Header directory {} does not exist. Proceeding without it.", path.string());
+      continue;
+    }
+
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             path, std::filesystem::directory_options::skip_permission_denied, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (!it->is_regular_file() || kHeaderExtensions.count(it->path().extension().string()) == 0) {
+        continue;
+      }
+      const std::string relPath = it->path().lexically_relative(cfg->rootDir).string();
+      if (std::any_of(cfg->ignorePaths.begin(), cfg->ignorePaths.end(), [&](const std::string& ignorePath) {
+            return relPath.find(ignorePath) != std::string::npos;
+          })) {
+        continue;
+      }
+      headers.emplace_back(it->path().lexically_normal().string());
+    }
+  }
+
+  std::sort(headers.begin(), headers.end());
+  headers.erase(std::unique(headers.begin(), headers.end()), headers.end());
+  return headers;
+}
+
+/// Write content to path unless the file already exists. The file is written under a temporary name first so that
+/// concurrent runs never see it half-written.
+static bool writeFileIfMissing(const std::filesystem::path& path, const std::string& content) {
+  if (std::filesystem::exists(path)) {
+    return true;
+  }
+  llvm::SmallString<128> tempPath;
+  int                    fd = -1;
+  if (llvm::sys::fs::createUniqueFile(path.string() + ".%%%%%%%%.tmp", fd, tempPath)) {
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << content;
+  }
+  if (llvm::sys::fs::rename(tempPath, path.string())) {
+    llvm::sys::fs::remove(tempPath);
+    return std::filesystem::exists(path);
+  }
+  return true;
+}
+
+std::unique_ptr<hdoc::indexer::HeaderOnlyDatabase>
+hdoc::indexer::HeaderOnlyDatabase::create(const clang::tooling::CompilationDatabase& cmpdb,
+                                          const hdoc::types::Config*                 cfg) {
+  // The representative command is the one most C++ files in the project share, apart from the source file and
+  // its outputs
+  std::vector<clang::tooling::CompileCommand>  candidates;
+  std::unordered_map<std::string, std::size_t> counts;
+  std::string                                  bestKey;
+  std::size_t                                  bestIndex = 0;
+  for (auto& cmd : cmpdb.getAllCompileCommands()) {
+    const std::string path = getAbsolutePath(cmd.Directory, cmd.Filename);
+    if (llvm::sys::path::extension(path) == ".c") {
+      continue;
+    }
+
+    cmd.CommandLine = clang::tooling::getClangStripOutputAdjuster()(cmd.CommandLine, path);
+    cmd.CommandLine = clang::tooling::getClangStripDependencyFileAdjuster()(cmd.CommandLine, path);
+    cmd.CommandLine.erase(
+        std::remove_if(cmd.CommandLine.begin() + 1,
+                       cmd.CommandLine.end(),
+                       [&](const std::string& arg) { return getAbsolutePath(cmd.Directory, arg) == path; }),
+        cmd.CommandLine.end());
+
+    std::string key = cmd.Directory;
+    for (const auto& arg : cmd.CommandLine) {
+      key += '\0' + arg;
+    }
+    const std::size_t count = ++counts[key];
+    if (bestKey.empty() || (key != bestKey && count > counts[bestKey])) {
+      bestKey   = key;
+      bestIndex = candidates.size();
+    }
+    candidates.emplace_back(std::move(cmd));
+  }
+  if (candidates.empty()) {
+    spdlog::error("Header-only indexing needs a C++ file in the compilation database to borrow its flags from.");
+    return nullptr;
+  }
+  const clang::tooling::CompileCommand& representative = candidates[bestIndex];
+
+  const std::vector<std::string> headers = findHeaders(cfg);
+  if (headers.empty()) {
+    spdlog::error("Header-only indexing found no headers in the header directories.");
+    return nullptr;
+  }
+
+  // Headers are either included one per synthetic file, or all headers of a directory together
+  std::map<std::string, std::vector<std::string>> groups;
+  for (const auto& header : headers) {
+    if (cfg->headerOnlyMode == hdoc::types::HeaderOnlyMode::PerDirectory) {
+      groups[llvm::sys::path::parent_path(header).str()].emplace_back(header);
+    } else {
+      groups[header].emplace_back(header);
+    }
+  }
+
+  // Synthetic files only outlive the run if the index cache can reuse their results, otherwise every run writes its
+  // own so that concurrent runs don't share them
+  auto                  db = std::unique_ptr<HeaderOnlyDatabase>(new HeaderOnlyDatabase());
+  std::filesystem::path dir;
+  if (!cfg->cacheDir.empty()) {
+    dir = cfg->cacheDir / "header-only";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+  } else {
+    llvm::SmallString<128> tempDir;
+    if (const std::error_code ec = llvm::sys::fs::createUniqueDirectory("hdoc-header-only", tempDir)) {
+      spdlog::error("Unable to create a directory for the synthetic files of header-only indexing: {}", ec.message());
+      return nullptr;
+    }
+    dir = db->tempDir = tempDir.str().str();
+  }
+
+  for (const auto& [_, group] : groups) {
+    std::string content = "// Generated by hdoc\n";
+    for (const auto& header : group) {
+      content += "#include \"" + header + "\"\n";
+    }
+
+    // Like shared prefix headers, synthetic files are named after their contents and the flags they're compiled
+    // with, so that they're identical across runs and the index cache can reuse their results
+    const std::string name =
+        llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(bestKey + '\0' + content)), true);
+    const std::filesystem::path path = dir / ("tu-" + name + ".cpp");
+    if (!writeFileIfMissing(path, content)) {
+      spdlog::warn("Unable to write synthetic file for {}, skipping it.", group.front());
+      continue;
+    }
+
+    clang::tooling::CompileCommand cmd = representative;
+    cmd.Filename                       = path.string();
+    cmd.Output                         = "";
+    cmd.CommandLine.emplace_back(path.string());
+    db->commands.emplace(path.string(), std::move(cmd));
+  }
+  if (db->commands.empty()) {
+    spdlog::error("Header-only indexing was unable to write any synthetic files to {}.", dir.string());
+    return nullptr;
+  }
+
+  spdlog::info("Header-only indexing of {} headers in {} synthetic files, using the flags of {}.",
+               headers.size(),
+               db->commands.size(),
+               representative.Filename);
+  return db;
+}
+
+hdoc::indexer::HeaderOnlyDatabase::~HeaderOnlyDatabase() {
+  if (!this->tempDir.empty()) {
+    std::error_code ec;
+    std::filesystem::remove_all(this->tempDir, ec);
+  }
+}
+
+std::vector<clang::tooling::CompileCommand>
+hdoc::indexer::HeaderOnlyDatabase::getCompileCommands(llvm::StringRef FilePath) const {
+  const auto it = this->commands.find(FilePath.str());
+  if (it == this->commands.end()) {
+    return {};
+  }
+  return {it->second};
+}
+
+std::vector<std::string> hdoc::indexer::HeaderOnlyDatabase::getAllFiles() const {
+  std::vector<std::string> files;
+  files.reserve(this->commands.size());
+  for (const auto& [path, _] : this->commands) {
+    files.emplace_back(path);
+  }
+  return files;
+}
+
+std::vector<clang::tooling::CompileCommand> hdoc::indexer::HeaderOnlyDatabase::getAllCompileCommands() const {
+  std::vector<clang::tooling::CompileCommand> cmds;
+  cmds.reserve(this->commands.size());
+  for (const auto& [_, cmd] : this->commands) {
+    cmds.emplace_back(cmd);
+  }
+  return cmds;
+}
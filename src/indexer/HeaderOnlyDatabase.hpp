@@ -0,0 +1,40 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+#include "types/Config.hpp"
+
+namespace hdoc::indexer {
+/// @brief Compilation database of synthetic source files that do nothing but include the project's public headers.
+///
+/// Every synthetic file is compiled with the flags of a representative command from the project's real compilation
+/// database, so that only the API surface is parsed instead of every source file and test of the project.
+/// Depending on cfg->headerOnlyMode, there's one synthetic file per header or one per directory of headers.
+/// Synthetic files are kept in the index cache so that later runs can reuse their results, and otherwise in a
+/// temporary directory of this run that is removed along with the database.
+class HeaderOnlyDatabase : public clang::tooling::CompilationDatabase {
+public:
+  /// @brief Create synthetic files for the headers in cfg->headerDirs. Returns nullptr if there are no headers,
+  /// cmpdb has no command to borrow flags from, or no synthetic file could be written.
+  static std::unique_ptr<HeaderOnlyDatabase> create(const clang::tooling::CompilationDatabase& cmpdb,
+                                                    const hdoc::types::Config*                 cfg);
+  ~HeaderOnlyDatabase() override;
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef FilePath) const override;
+  std::vector<std::string>                    getAllFiles() const override;
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override;
+
+private:
+  std::map<std::string, clang::tooling::CompileCommand> commands; ///< Command of each synthetic file
+  std::filesystem::path                                 tempDir;  ///< Directory removed with the database, if any
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,290 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/IndexAction.hpp"
+#include "indexer/IndexConsumer.hpp"
+#include "serde/BinarySerializer.hpp"
+#include "spdlog/spdlog.h"
+#include "support/SharedPCH.hpp"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+
+/// Paths may be relative to the working directory of the compile command, which only the TU's own VFS knows.
+/// Make them absolute so that they mean the same thing in every thread.
+static std::string getAbsolutePath(llvm::vfs::FileSystem& FS, const llvm::StringRef path) {
+  llvm::SmallString<128> absPath(path);
+  FS.makeAbsolute(absPath);
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/true);
+  return absPath.str().str();
+}
+
+namespace {
+/// Records every file entered during preprocessing or loaded from a PCH. System headers are included too since
+/// they can change what is declared in project headers.
+class AllFilesDependencyCollector : public clang::DependencyCollector {
+public:
+  bool needSystemDependencies() override {
+    return true;
+  }
+
+  /// The PCH and a shared PCH's prefix header are temporary files, what matters are the headers they include
+  bool sawDependency(llvm::StringRef filename, bool, bool, bool isModuleFile, bool) override {
+    return !isModuleFile && !hdoc::indexer::SharedPCH::isPrefixHeader(filename);
+  }
+};
+
+/// Restricts the traversal of the wrapped consumer to top-level decls from files that haven't been
+/// indexed by another TU yet. Everything the indexer would find in the skipped files is already in the Index.
+class SkipIndexedFilesConsumer : public clang::ASTConsumer {
+public:
+  SkipIndexedFilesConsumer(std::unique_ptr<clang::ASTConsumer>        consumer,
+                           const hdoc::indexer::IndexedFileRegistry& registry,
+                           std::vector<std::string>&                 skipped)
+      : consumer(std::move(consumer)), registry(registry), skipped(skipped) {}
+
+  void HandleTranslationUnit(clang::ASTContext& ctx) override {
+    const auto& SM = ctx.getSourceManager();
+    auto&       FS = SM.getFileManager().getVirtualFileSystem();
+
+    // Most top-level decls come from a handful of files, so only look up each file once
+    llvm::DenseMap<clang::FileID, bool> isIndexed;
+    std::vector<clang::Decl*>           scope;
+    bool                                skippedAny = false;
+    for (clang::Decl* d : ctx.getTranslationUnitDecl()->decls()) {
+      const clang::FileID fid = SM.getFileID(SM.getExpansionLoc(d->getLocation()));
+      auto [it, inserted]     = isIndexed.try_emplace(fid, false);
+      if (inserted) {
+        if (const auto fileEntry = SM.getFileEntryRefForID(fid)) {
+          const std::string path = getAbsolutePath(FS, fileEntry->getName());
+          it->second             = this->registry.contains(path);
+          if (it->second) {
+            this->skipped.emplace_back(path);
+          }
+        }
+      }
+      if (it->second) {
+        skippedAny = true;
+      } else {
+        scope.emplace_back(d);
+      }
+    }
+
+    if (skippedAny) {
+      ctx.setTraversalScope(scope);
+    }
+    this->consumer->HandleTranslationUnit(ctx);
+  }
+
+private:
+  std::unique_ptr<clang::ASTConsumer>        consumer;
+  const hdoc::indexer::IndexedFileRegistry& registry;
+  std::vector<std::string>&                 skipped;
+};
+
+/// Runs only the preprocessor over a single TU to find the files it includes.
+class ScanDependenciesAction : public clang::PreprocessOnlyAction {
+public:
+  ScanDependenciesAction(std::vector<std::string>* dependencies) : dependencies(dependencies) {}
+
+protected:
+  bool BeginSourceFileAction(clang::CompilerInstance& CI) override {
+    this->collector.attachToPreprocessor(CI.getPreprocessor());
+    return true;
+  }
+
+  void EndSourceFileAction() override {
+    auto& FS = this->getCompilerInstance().getFileManager().getVirtualFileSystem();
+    this->dependencies->emplace_back(getAbsolutePath(FS, this->getCurrentFile()));
+    for (const auto& dep : this->collector.getDependencies()) {
+      this->dependencies->emplace_back(getAbsolutePath(FS, dep));
+    }
+  }
+
+private:
+  AllFilesDependencyCollector collector;
+  std::vector<std::string>*   dependencies;
+};
+
+/// Indexes a single TU, optionally recording the files that were included.
+class IndexAction : public clang::ASTFrontendAction {
+public:
+  IndexAction(hdoc::types::Index*                       index,
+              const hdoc::types::Config*                cfg,
+              hdoc::indexer::SharedFileInfoCache*       files,
+              const hdoc::indexer::NamespacePatterns*   patterns,
+              const hdoc::indexer::IndexedFileRegistry* registry,
+              std::vector<std::string>*                 dependencies,
+              std::vector<std::string>*                 skipped)
+      : index(index), cfg(cfg), files(files), patterns(patterns), registry(registry), dependencies(dependencies),
+        skipped(skipped) {}
+
+protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance& CI, llvm::StringRef) override {
+    if (this->dependencies != nullptr) {
+      // The preprocessor already exists, but the PCH reader doesn't. Registering the collector with CI gets it
+      // attached to the reader once it's created, so that headers from a shared PCH are recorded too.
+      this->collector->attachToPreprocessor(CI.getPreprocessor());
+      CI.addDependencyCollector(this->collector);
+    }
+    auto consumer = std::make_unique<hdoc::indexer::IndexConsumer>(this->index, this->cfg, this->files, this->patterns);
+    if (this->registry != nullptr) {
+      return std::make_unique<SkipIndexedFilesConsumer>(std::move(consumer), *this->registry, *this->skipped);
+    }
+    return consumer;
+  }
+
+  void EndSourceFileAction() override {
+    if (this->dependencies == nullptr) {
+      return;
+    }
+
+    auto& FS = this->getCompilerInstance().getFileManager().getVirtualFileSystem();
+    this->dependencies->emplace_back(getAbsolutePath(FS, this->getCurrentFile()));
+    for (const auto& dep : this->collector->getDependencies()) {
+      this->dependencies->emplace_back(getAbsolutePath(FS, dep));
+    }
+  }
+
+private:
+  hdoc::types::Index*                          index;
+  const hdoc::types::Config*                   cfg;
+  hdoc::indexer::SharedFileInfoCache*          files;
+  const hdoc::indexer::NamespacePatterns*      patterns;
+  std::shared_ptr<AllFilesDependencyCollector> collector = std::make_shared<AllFilesDependencyCollector>();
+  const hdoc::indexer::IndexedFileRegistry*    registry;
+  std::vector<std::string>*                    dependencies;
+  std::vector<std::string>*                    skipped;
+};
+} // namespace
+
+/// Sort a vector of paths and remove duplicates
+static void sortUnique(std::vector<std::string>& paths) {
+  std::sort(paths.begin(), paths.end());
+  paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+}
+
+std::unique_ptr<clang::FrontendAction> hdoc::indexer::TUIndexer::create() {
+  if (this->shard == nullptr) {
+    // A worker sends everything in its shard to the parent, so it can't reuse one that has symbols of other files
+    this->shard = this->inWorker ? this->shards->makeShard() : this->shards->acquire();
+  }
+
+  // Dependencies are only needed to key the cache, to register the files this TU indexed, and for the dependency map
+  const bool needDependencies = this->cache != nullptr || this->registry != nullptr || this->dependencyMap != nullptr;
+  return std::make_unique<IndexAction>(this->cache == nullptr ? this->shard.get() : &this->tuIndex,
+                                       this->cfg,
+                                       this->files,
+                                       this->patterns,
+                                       this->registry,
+                                       needDependencies ? &this->dependencies : nullptr,
+                                       &this->skipped);
+}
+
+void hdoc::indexer::TUIndexer::finish(const bool success) {
+  sortUnique(this->dependencies);
+  sortUnique(this->skipped);
+
+  if (this->shard == nullptr) {
+    this->shard = this->shards->acquire();
+  }
+  if (this->cache != nullptr) {
+    // Files that failed to parse aren't cached, so that they're retried on the next run
+    if (success) {
+      this->cache->store(this->path, this->dependencies, this->skipped, this->tuIndex);
+    }
+    this->shard->merge(std::move(this->tuIndex));
+  }
+  this->shards->release(std::move(this->shard));
+
+  // Files are only registered after their symbols are in a shard, so a TU that skips them
+  // can never end up with symbols that would have come from them
+  if (this->registry != nullptr && success) {
+    this->registry->add(this->dependencies);
+  }
+  if (this->dependencyMap != nullptr && success) {
+    if (this->laterCommands) {
+      this->dependencyMap->extend(this->path, this->dependencies);
+    } else {
+      this->dependencyMap->add(this->path, this->dependencies);
+    }
+  }
+}
+
+std::string hdoc::indexer::TUIndexer::finishInWorker(const bool success) {
+  sortUnique(this->dependencies);
+  sortUnique(this->skipped);
+
+  if (this->cache != nullptr && success) {
+    this->cache->store(this->path, this->dependencies, this->skipped, this->tuIndex);
+  }
+  // Only later files in the same worker will see this, the other workers have their own registries
+  if (this->registry != nullptr && success) {
+    this->registry->add(this->dependencies);
+  }
+
+  // The parent records the dependencies in its map, so they're sent ahead of the symbols: their number, then one
+  // per line
+  std::string result;
+  if (this->dependencyMap != nullptr) {
+    const std::size_t numDependencies = success ? this->dependencies.size() : 0;
+    result += std::to_string(numDependencies) + "\n";
+    for (std::size_t i = 0; i < numDependencies; i++) {
+      result += this->dependencies[i] + "\n";
+    }
+  }
+
+  if (this->cache != nullptr) {
+    return result + hdoc::serde::serializeToBinary(this->tuIndex);
+  }
+  return result + (this->shard == nullptr ? hdoc::serde::serializeToBinary(hdoc::types::Index())
+                                          : hdoc::serde::serializeToBinary(*this->shard));
+}
+
+void hdoc::indexer::TUIndexer::finishFromWorker(const bool success, const std::string_view result) {
+  llvm::StringRef data(result.data(), result.size());
+  if (this->dependencyMap != nullptr) {
+    llvm::StringRef line;
+    std::tie(line, data)     = data.split('\n');
+    uint64_t numDependencies = 0;
+    if (line.getAsInteger(10, numDependencies)) {
+      numDependencies = 0;
+      data            = "";
+    }
+    for (uint64_t i = 0; i < numDependencies; i++) {
+      std::tie(line, data) = data.split('\n');
+      this->dependencies.emplace_back(line.str());
+    }
+    if (success && numDependencies > 0) {
+      this->dependencyMap->add(this->path, this->dependencies);
+    }
+  }
+
+  hdoc::types::Index received;
+  if (!hdoc::serde::deserializeFromBinary(std::string_view(data.data(), data.size()), received)) {
+    spdlog::error("Symbols of {} sent by its worker process are corrupt. Information from this file will be missing "
+                  "from hdoc's output",
+                  this->path);
+    return;
+  }
+  auto shard = this->shards->acquire();
+  shard->merge(std::move(received));
+  this->shards->release(std::move(shard));
+}
+
+std::unique_ptr<clang::FrontendAction> hdoc::indexer::DependencyScanner::create() {
+  return std::make_unique<ScanDependenciesAction>(this->dependencies);
+}
+
+void hdoc::indexer::DependencyScanner::finish(const bool) {
+  sortUnique(*this->dependencies);
+}
@@ -0,0 +1,81 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexer/DependencyMap.hpp"
+#include "indexer/FileInfoCache.hpp"
+#include "indexer/IndexCache.hpp"
+#include "indexer/IndexShards.hpp"
+#include "indexer/IndexedFileRegistry.hpp"
+#include "indexer/NamespaceClassifier.hpp"
+#include "support/ParallelExecutor.hpp"
+#include "types/Config.hpp"
+#include "types/Index.hpp"
+
+namespace hdoc::indexer {
+/// @brief Indexes every compile command of a single source file.
+///
+/// Without an IndexCache, symbols are written straight into a shard of the Index. With one, they're collected
+/// into a private Index first so that exactly what this file contributed (and which files it depends on)
+/// can be saved to the cache, and are then merged into a shard once the file is done.
+/// If a registry is given, declarations from files that other TUs have already indexed are skipped, and
+/// the files this TU included are registered once it's done. Paths of files are cached in files and
+/// namespaces are matched against patterns, if given. The files this TU included are recorded in dependencyMap,
+/// if one is given.
+/// In a worker process, the symbols are collected into a new shard that is sent to the parent, where it's merged
+/// into a shard. Files are only registered with the worker's own copy of the registry.
+class TUIndexer : public TUActionFactory {
+public:
+  TUIndexer(const std::string&         path,
+            IndexShards*               shards,
+            const hdoc::types::Config* cfg,
+            IndexCache*                cache,
+            IndexedFileRegistry*       registry,
+            SharedFileInfoCache*       files,
+            const NamespacePatterns*   patterns,
+            DependencyMap*             dependencyMap = nullptr)
+      : path(path), shards(shards), cfg(cfg), cache(cache), registry(registry), files(files), patterns(patterns),
+        dependencyMap(dependencyMap) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override;
+  void                                   finish(const bool success) override;
+  void                                   prepareForWorker() override { this->inWorker = true; }
+  void                                   prepareForLaterCommands() override { this->laterCommands = true; }
+  std::string                            finishInWorker(const bool success) override;
+  void                                   finishFromWorker(const bool success, const std::string_view result) override;
+
+private:
+  std::string                         path;
+  IndexShards*                        shards;
+  const hdoc::types::Config*          cfg;
+  IndexCache*                         cache;
+  IndexedFileRegistry*                registry;
+  SharedFileInfoCache*                files;
+  const NamespacePatterns*            patterns;
+  DependencyMap*                      dependencyMap;
+  std::unique_ptr<hdoc::types::Index> shard;            ///< Shard acquired for this file, if any
+  hdoc::types::Index                  tuIndex;          ///< Symbols contributed by this file, only used with a cache
+  std::vector<std::string>            dependencies;     ///< Absolute paths of all files included while parsing
+  std::vector<std::string>            skipped;          ///< Absolute paths of files skipped because they were indexed
+  bool                                inWorker      = false; ///< Is the file parsed in a worker process?
+  bool                                laterCommands = false; ///< Were earlier commands parsed by another factory?
+};
+
+/// @brief Records the files that a single source file includes, by only running the preprocessor over it.
+class DependencyScanner : public TUActionFactory {
+public:
+  /// dependencies receives the absolute paths of the included files, sorted, once the file is done
+  DependencyScanner(std::vector<std::string>* dependencies) : dependencies(dependencies) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override;
+  void                                   finish(const bool success) override;
+
+private:
+  std::vector<std::string>* dependencies;
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,270 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/IndexCache.hpp"
+#include "serde/BinarySerializer.hpp"
+
+#include "spdlog/spdlog.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <iterator>
+
+/// First line of every cache entry. Entries with a different header are treated as misses.
+static constexpr char kCacheEntryHeader[] = "hdoc-index-cache 2";
+
+/// Append a field to a string that will be hashed, terminated so that adjacent fields can't run into each other.
+static void appendField(std::string& key, const llvm::StringRef s) {
+  key.append(s.data(), s.size());
+  key.push_back('\0');
+}
+
+/// SHA1 hash of a string, as lowercase hex
+static std::string getHexDigest(const std::string& s) {
+  return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(s)), /*LowerCase=*/true);
+}
+
+hdoc::indexer::IndexCache::IndexCache(const std::filesystem::path&               dir,
+                                      const clang::tooling::CompilationDatabase& cmpdb,
+                                      const std::vector<std::string>&            includePaths,
+                                      const hdoc::types::Config*                 cfg)
+    : dir(dir), cmpdb(cmpdb) {
+  std::error_code ec;
+  std::filesystem::create_directories(this->dir, ec);
+  if (ec) {
+    spdlog::warn("Unable to create index cache directory {}: {}", this->dir.string(), ec.message());
+  }
+
+  // Anything that changes which symbols are indexed or what they look like has to be part of the key.
+  std::string key;
+  appendField(key, cfg->hdocVersion);
+  appendField(key, cfg->rootDir.string());
+  appendField(key, cfg->ignorePrivateMembers ? "1" : "0");
+  appendField(key, cfg->stripArguments ? "1" : "0");
+  for (const auto* list : {&includePaths,
+                           &cfg->ignorePaths,
+                           &cfg->ignoreNamespaces,
+                           &cfg->detailNamespaces,
+                           &cfg->keepArguments,
+                           &cfg->extraStripArguments}) {
+    for (const auto& s : *list) {
+      appendField(key, s);
+    }
+    appendField(key, "");
+  }
+  this->fingerprint = getHexDigest(key);
+}
+
+std::filesystem::path hdoc::indexer::IndexCache::getEntryPath(const std::string& path) const {
+  std::string key;
+  appendField(key, this->fingerprint);
+  for (const auto& cmd : this->cmpdb.getCompileCommands(path)) {
+    appendField(key, cmd.Directory);
+    appendField(key, cmd.Filename);
+    for (const auto& arg : cmd.CommandLine) {
+      appendField(key, arg);
+    }
+  }
+  return this->dir / (getHexDigest(key) + ".tu");
+}
+
+uint64_t hdoc::indexer::IndexCache::getContentHash(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(this->contentHashesMutex);
+    if (const auto it = this->contentHashes.find(path); it != this->contentHashes.end()) {
+      return it->second;
+    }
+  }
+
+  uint64_t hash = 0;
+  if (auto buf = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false)) {
+    hash = llvm::xxHash64(buf->get()->getBuffer());
+  }
+
+  std::lock_guard<std::mutex> lock(this->contentHashesMutex);
+  this->contentHashes.emplace(path, hash);
+  return hash;
+}
+
+std::vector<std::string> hdoc::indexer::IndexCache::loadUnchanged(const std::vector<std::string>& files,
+                                                                  IndexShards&                    shards,
+                                                                  llvm::ThreadPool&               pool,
+                                                                  IndexedFileRegistry*            registry) {
+  // Validating an entry means hashing all of its dependencies, so do it in parallel.
+  std::vector<std::optional<Entry>> entries(files.size());
+  for (std::size_t i = 0; i < files.size(); i++) {
+    pool.async([&, i]() { entries[i] = this->readEntry(files[i], /*validate=*/true); });
+  }
+  pool.wait();
+
+  // An entry that skipped files because another TU had already indexed them is only complete if some other
+  // entry that is also being reused covers those files. Dropping an entry can uncover files that other
+  // entries skipped, so repeat until nothing changes.
+  std::unordered_map<std::string, std::size_t> coverage;
+  for (const auto& entry : entries) {
+    if (entry) {
+      for (const auto& path : entry->covered) {
+        coverage[path]++;
+      }
+    }
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::size_t i = 0; i < files.size(); i++) {
+      if (!entries[i]) {
+        continue;
+      }
+      const bool complete = std::all_of(entries[i]->skipped.begin(), entries[i]->skipped.end(), [&](const auto& p) {
+        return coverage[p] > 0;
+      });
+      if (!complete) {
+        spdlog::debug("Index cache entry for {} depends on files that have to be reindexed.", files[i]);
+        for (const auto& path : entries[i]->covered) {
+          coverage[path]--;
+        }
+        entries[i].reset();
+        changed = true;
+      }
+    }
+  }
+
+  std::vector<char> loaded(files.size(), false);
+  for (std::size_t i = 0; i < files.size(); i++) {
+    if (entries[i]) {
+      pool.async([&, i]() {
+        hdoc::types::Index cached;
+        if (!hdoc::serde::deserializeFromBinary(entries[i]->payload, cached)) {
+          spdlog::warn("Index cache entry for {} is corrupt, reindexing it.", files[i]);
+          return;
+        }
+        auto shard = shards.acquire();
+        shard->merge(std::move(cached));
+        shards.release(std::move(shard));
+        loaded[i] = true;
+      });
+    }
+  }
+  pool.wait();
+
+  std::vector<std::string> changedFiles;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    if (!loaded[i]) {
+      changedFiles.emplace_back(files[i]);
+    } else if (registry != nullptr) {
+      registry->add(entries[i]->covered);
+    }
+  }
+  spdlog::info("Loaded {} of {} files from the index cache in {}.",
+               files.size() - changedFiles.size(),
+               files.size(),
+               this->dir.string());
+  return changedFiles;
+}
+
+std::optional<std::vector<std::string>> hdoc::indexer::IndexCache::getDependencies(const std::string& path) {
+  const auto entry = this->readEntry(path, /*validate=*/false);
+  if (!entry) {
+    return std::nullopt;
+  }
+
+  std::vector<std::string> dependencies;
+  std::set_union(entry->covered.begin(),
+                 entry->covered.end(),
+                 entry->skipped.begin(),
+                 entry->skipped.end(),
+                 std::back_inserter(dependencies));
+  return dependencies;
+}
+
+std::optional<hdoc::indexer::IndexCache::Entry> hdoc::indexer::IndexCache::readEntry(const std::string& path, const bool validate) {
+  auto buf = llvm::MemoryBuffer::getFile(this->getEntryPath(path).string(), /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!buf) {
+    return std::nullopt;
+  }
+
+  // The entry starts with a text manifest of dependencies and skipped files, followed by the binary symbol payload.
+  Entry           entry;
+  llvm::StringRef data = buf->get()->getBuffer();
+  llvm::StringRef line;
+  std::tie(line, data) = data.split('\n');
+  if (line != kCacheEntryHeader) {
+    return std::nullopt;
+  }
+
+  std::tie(line, data)          = data.split('\n');
+  const auto [depsStr, skipStr] = line.split(' ');
+  uint64_t numDependencies      = 0;
+  uint64_t numSkipped           = 0;
+  if (depsStr.getAsInteger(10, numDependencies) || skipStr.getAsInteger(10, numSkipped)) {
+    return std::nullopt;
+  }
+
+  std::vector<std::string> dependencies;
+  for (uint64_t i = 0; i < numDependencies; i++) {
+    std::tie(line, data)          = data.split('\n');
+    const auto [hashStr, depPath] = line.split(' ');
+    uint64_t hash                 = 0;
+    if (hashStr.getAsInteger(16, hash) || depPath.empty() ||
+        (validate && this->getContentHash(depPath.str()) != hash)) {
+      spdlog::debug("Index cache entry for {} is stale ({} changed).", path, depPath.str());
+      return std::nullopt;
+    }
+    dependencies.emplace_back(depPath.str());
+  }
+
+  for (uint64_t i = 0; i < numSkipped; i++) {
+    std::tie(line, data) = data.split('\n');
+    if (line.empty()) {
+      return std::nullopt;
+    }
+    entry.skipped.emplace_back(line.str());
+  }
+
+  // Both lists were written sorted
+  std::set_difference(dependencies.begin(),
+                      dependencies.end(),
+                      entry.skipped.begin(),
+                      entry.skipped.end(),
+                      std::back_inserter(entry.covered));
+  entry.payload = std::string(data.data(), data.size());
+  return entry;
+}
+
+void hdoc::indexer::IndexCache::store(const std::string&              path,
+                                      const std::vector<std::string>& dependencies,
+                                      const std::vector<std::string>& skipped,
+                                      const hdoc::types::Index&       index) {
+  std::string entry = std::string(kCacheEntryHeader) + "\n" + std::to_string(dependencies.size()) + " " +
+                      std::to_string(skipped.size()) + "\n";
+  for (const auto& dep : dependencies) {
+    entry += llvm::utohexstr(this->getContentHash(dep)) + " " + dep + "\n";
+  }
+  for (const auto& s : skipped) {
+    entry += s + "\n";
+  }
+  entry += hdoc::serde::serializeToBinary(index);
+
+  // Write to a temporary file and rename it into place so that a concurrent or interrupted run never sees
+  // a partially written entry.
+  const std::filesystem::path entryPath = this->getEntryPath(path);
+  llvm::SmallString<128>      tempPath;
+  int                         fd = -1;
+  if (const auto ec = llvm::sys::fs::createUniqueFile(entryPath.string() + ".%%%%%%%%.tmp", fd, tempPath)) {
+    spdlog::warn("Unable to write index cache entry for {}: {}", path, ec.message());
+    return;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << entry;
+  }
+  if (const auto ec = llvm::sys::fs::rename(tempPath, entryPath.string())) {
+    spdlog::warn("Unable to write index cache entry for {}: {}", path, ec.message());
+    llvm::sys::fs::remove(tempPath);
+  }
+}
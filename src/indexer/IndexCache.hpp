@@ -0,0 +1,78 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexShards.hpp"
+#include "indexer/IndexedFileRegistry.hpp"
+#include "types/Config.hpp"
+#include "types/Index.hpp"
+
+namespace hdoc::indexer {
+/// @brief On-disk cache of the symbols that each source file in the compilation database contributed to the Index.
+///
+/// An entry is keyed on the file's compile commands, the extra include paths hdoc adds, and the parts of the
+/// configuration that influence indexing. Alongside the symbols, each entry stores the content hash of every file
+/// that was included while parsing. An entry is only reused if all of those files are unchanged, and if every
+/// file it skipped because another TU had indexed it is covered by another entry that is reused too.
+class IndexCache {
+public:
+  IndexCache(const std::filesystem::path&               dir,
+             const clang::tooling::CompilationDatabase& cmpdb,
+             const std::vector<std::string>&            includePaths,
+             const hdoc::types::Config*                 cfg);
+
+  /// @brief Load the cached symbols of every file in files whose entry is still valid into shards.
+  /// Files covered by the loaded entries are added to registry, if one is given.
+  /// Returns the files that have no valid entry and need to be indexed again.
+  std::vector<std::string> loadUnchanged(const std::vector<std::string>& files,
+                                         IndexShards&                    shards,
+                                         llvm::ThreadPool&               pool,
+                                         IndexedFileRegistry*            registry);
+
+  /// @brief Save the symbols that path contributed, along with the files it depends on and the files
+  /// whose declarations were skipped because another TU indexed them.
+  void store(const std::string&              path,
+             const std::vector<std::string>& dependencies,
+             const std::vector<std::string>& skipped,
+             const hdoc::types::Index&       index);
+
+  /// @brief The files that path included on the run that last cached it, even if some of them changed since.
+  /// Returns std::nullopt if it has no cache entry.
+  std::optional<std::vector<std::string>> getDependencies(const std::string& path);
+
+private:
+  /// A cache entry whose dependencies are all unchanged
+  struct Entry {
+    std::string              payload; ///< Serialized symbols
+    std::vector<std::string> skipped; ///< Files that were skipped because another TU indexed them
+    std::vector<std::string> covered; ///< Dependencies that this entry's symbols fully cover
+  };
+
+  /// Read the cache entry for a source file, checking that its dependencies are unchanged if validate is true.
+  /// Returns std::nullopt if there's no (valid) entry.
+  std::optional<Entry> readEntry(const std::string& path, const bool validate);
+
+  /// Path of the cache entry for a source file
+  std::filesystem::path getEntryPath(const std::string& path) const;
+
+  /// Content hash of a file, memoized since most headers are shared by many files. Returns 0 if it can't be read.
+  uint64_t getContentHash(const std::string& path);
+
+  std::filesystem::path                      dir;
+  const clang::tooling::CompilationDatabase& cmpdb;
+  std::string                                fingerprint; ///< Hash of the configuration that affects indexing
+  std::unordered_map<std::string, uint64_t>  contentHashes;
+  std::mutex                                 contentHashesMutex;
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,145 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/IndexConsumer.hpp"
+#include "indexer/Matchers.hpp"
+
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/SourceManager.h"
+
+#include <memory>
+
+/// Whether a record or function was instantiated from a template, like the isTemplateInstantiation() AST matcher
+static bool isTemplateInstantiation(const clang::TemplateSpecializationKind tsk) {
+  return tsk == clang::TSK_ImplicitInstantiation || tsk == clang::TSK_ExplicitInstantiationDefinition ||
+         tsk == clang::TSK_ExplicitInstantiationDeclaration;
+}
+
+namespace {
+/// Visits declarations in the same order and with the same filters that hdoc's AST matchers used to, which keeps
+/// the index identical. Filters that only depend on where a declaration is are applied to whole subtrees.
+class IndexVisitor : public clang::RecursiveASTVisitor<IndexVisitor> {
+public:
+  IndexVisitor(clang::SourceManager&                sm,
+               hdoc::types::Index*                  index,
+               const hdoc::types::Config*           cfg,
+               hdoc::indexer::FileInfoCache&        files,
+               hdoc::indexer::NamespaceClassifier& namespaces)
+      : sm(sm), cfg(cfg), files(files), namespaces(namespaces), FunctionBuilder(index, cfg, &files, &namespaces),
+        RecordBuilder(index, cfg, &files, &namespaces), EnumBuilder(index, cfg, &files, &namespaces),
+        NamespaceBuilder(index, cfg, &files, &namespaces), UsingBuilder(index, cfg, &files, &namespaces) {}
+
+  // Same traversal as clang's MatchFinder
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool TraverseDecl(clang::Decl* d) {
+    if (d == nullptr || llvm::isa<clang::TranslationUnitDecl>(d)) {
+      return clang::RecursiveASTVisitor<IndexVisitor>::TraverseDecl(d);
+    }
+
+    // Nothing in system headers is documented
+    const clang::SourceLocation loc = this->sm.getExpansionLoc(d->getBeginLoc());
+    if (loc.isValid() && this->sm.isInSystemHeader(loc)) {
+      return true;
+    }
+
+    // Everything in a declaration comes from the same file as the declaration itself, unless the declaration is a
+    // namespace or extern block that #includes another file
+    const bool inIgnoredFile = loc.isValid() && this->isIgnoredFile(this->sm.getFileID(loc));
+    if (inIgnoredFile && !llvm::isa<clang::NamespaceDecl, clang::LinkageSpecDecl, clang::ExportDecl>(d)) {
+      return true;
+    }
+
+    if (!inIgnoredFile && !d->isImplicit()) {
+      this->dispatch(d);
+    }
+
+    // Nothing in anonymous namespaces is documented
+    if (const auto* ns = llvm::dyn_cast<clang::NamespaceDecl>(d); ns != nullptr && ns->isAnonymousNamespace()) {
+      return true;
+    }
+
+    // Declarations in template instantiations are skipped, but the instantiations are traversed like the
+    // matchers did since enums and namespaces were matched in them
+    bool isInstantiation = false;
+    if (const auto* record = llvm::dyn_cast<clang::CXXRecordDecl>(d)) {
+      isInstantiation = isTemplateInstantiation(record->getTemplateSpecializationKind());
+    } else if (const auto* function = llvm::dyn_cast<clang::FunctionDecl>(d)) {
+      isInstantiation = isTemplateInstantiation(function->getTemplateSpecializationKind());
+    }
+    this->instantiationDepth += isInstantiation;
+    const bool result = clang::RecursiveASTVisitor<IndexVisitor>::TraverseDecl(d);
+    this->instantiationDepth -= isInstantiation;
+    return result;
+  }
+
+private:
+  /// Pass a declaration in a non-ignored file to the builder for its kind
+  void dispatch(clang::Decl* d) {
+    const bool isInstantiated = this->instantiationDepth > 0;
+    if (const auto* function = llvm::dyn_cast<clang::FunctionDecl>(d)) {
+      if (!isInstantiated && !isTemplateInstantiation(function->getTemplateSpecializationKind()) &&
+          !this->isInIgnoredNamespace(d)) {
+        this->FunctionBuilder.run(function);
+      }
+    } else if (const auto* record = llvm::dyn_cast<clang::CXXRecordDecl>(d)) {
+      if (record->isThisDeclarationADefinition() && !isInstantiated &&
+          !isTemplateInstantiation(record->getTemplateSpecializationKind()) && !this->isInIgnoredNamespace(d)) {
+        this->RecordBuilder.run(record);
+      }
+    } else if (const auto* enumDecl = llvm::dyn_cast<clang::EnumDecl>(d)) {
+      if (enumDecl->isThisDeclarationADefinition() && !this->isInIgnoredNamespace(d)) {
+        this->EnumBuilder.run(enumDecl);
+      }
+    } else if (const auto* ns = llvm::dyn_cast<clang::NamespaceDecl>(d)) {
+      if (!this->isInIgnoredNamespace(d)) {
+        this->NamespaceBuilder.run(ns);
+      }
+    } else if (llvm::isa<clang::UsingDecl, clang::UsingShadowDecl, clang::TypedefNameDecl>(d)) {
+      if (!isInstantiated && !this->isInIgnoredNamespace(d)) {
+        this->UsingBuilder.run(llvm::cast<clang::NamedDecl>(d));
+      }
+    }
+  }
+
+  /// Whether a file matches one of cfg->ignorePaths
+  bool isIgnoredFile(const clang::FileID fid) {
+    return !this->cfg->ignorePaths.empty() && this->files.get(fid).ignored;
+  }
+
+  /// Namespaces were only ignored by the matchers if some paths were ignored as well, which is kept as it was
+  bool isInIgnoredNamespace(const clang::Decl* d) {
+    return !this->cfg->ignorePaths.empty() && this->namespaces.isInIgnoredNamespace(d);
+  }
+
+  clang::SourceManager&                     sm;
+  const hdoc::types::Config*                cfg;
+  hdoc::indexer::FileInfoCache&             files;
+  hdoc::indexer::NamespaceClassifier&       namespaces;
+  hdoc::indexer::matchers::FunctionMatcher  FunctionBuilder;
+  hdoc::indexer::matchers::RecordMatcher    RecordBuilder;
+  hdoc::indexer::matchers::EnumMatcher      EnumBuilder;
+  hdoc::indexer::matchers::NamespaceMatcher NamespaceBuilder;
+  hdoc::indexer::matchers::UsingMatcher     UsingBuilder;
+  std::size_t                               instantiationDepth = 0; ///< Number of enclosing template instantiations
+};
+} // namespace
+
+void hdoc::indexer::IndexConsumer::HandleTranslationUnit(clang::ASTContext& ctx) {
+  // Without a cache shared by all threads, the paths are only cached for this TU
+  std::unique_ptr<SharedFileInfoCache> ownSharedFiles;
+  if (this->sharedFiles == nullptr) {
+    ownSharedFiles = std::make_unique<SharedFileInfoCache>(this->cfg);
+  }
+  FileInfoCache files(ctx.getSourceManager(), this->sharedFiles ? *this->sharedFiles : *ownSharedFiles);
+
+  std::unique_ptr<NamespacePatterns> ownPatterns;
+  if (this->patterns == nullptr) {
+    ownPatterns = std::make_unique<NamespacePatterns>(this->cfg);
+  }
+  NamespaceClassifier namespaces(this->patterns ? *this->patterns : *ownPatterns);
+
+  IndexVisitor visitor(ctx.getSourceManager(), this->index, this->cfg, files, namespaces);
+  visitor.TraverseAST(ctx);
+}
@@ -0,0 +1,37 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+
+#include "indexer/FileInfoCache.hpp"
+#include "indexer/NamespaceClassifier.hpp"
+#include "types/Config.hpp"
+#include "types/Index.hpp"
+
+namespace hdoc::indexer {
+/// @brief Walks a TU once and passes every declaration hdoc documents to the symbol builders in Matchers.hpp.
+///
+/// Subtrees that can't contain documented declarations (anonymous namespaces, system headers, and ignored files)
+/// are skipped as a whole instead of checking every declaration in them.
+class IndexConsumer : public clang::ASTConsumer {
+public:
+  /// @brief sharedFiles and patterns may be nullptr, in which case file paths are only cached for this TU and
+  /// the namespace patterns are compiled for this TU
+  IndexConsumer(hdoc::types::Index*        index,
+                const hdoc::types::Config* cfg,
+                SharedFileInfoCache*       sharedFiles,
+                const NamespacePatterns*   patterns)
+      : index(index), cfg(cfg), sharedFiles(sharedFiles), patterns(patterns) {}
+
+  void HandleTranslationUnit(clang::ASTContext& ctx) override;
+
+private:
+  hdoc::types::Index*        index;
+  const hdoc::types::Config* cfg;
+  SharedFileInfoCache*       sharedFiles;
+  const NamespacePatterns*   patterns;
+};
+} // namespace hdoc::indexer
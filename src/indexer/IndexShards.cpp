@@ -0,0 +1,46 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/IndexShards.hpp"
+
+std::unique_ptr<hdoc::types::Index> hdoc::indexer::IndexShards::acquire() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->shards.empty()) {
+      auto shard = std::move(this->shards.back());
+      this->shards.pop_back();
+      return shard;
+    }
+  }
+  return this->makeShard();
+}
+
+std::unique_ptr<hdoc::types::Index> hdoc::indexer::IndexShards::makeShard() {
+  auto shard = std::make_unique<hdoc::types::Index>();
+  if (this->claimSymbols) {
+    shard->shareClaims(&this->claims);
+  }
+  return shard;
+}
+
+void hdoc::indexer::IndexShards::release(std::unique_ptr<hdoc::types::Index> shard) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->shards.emplace_back(std::move(shard));
+}
+
+void hdoc::indexer::IndexShards::mergeInto(hdoc::types::Index& index, llvm::ThreadPool& pool) {
+  // Merge the second half of the shards into the first half in parallel until only one is left
+  while (this->shards.size() > 1) {
+    const std::size_t half = (this->shards.size() + 1) / 2;
+    for (std::size_t i = half; i < this->shards.size(); i++) {
+      pool.async([&, i]() { this->shards[i - half]->merge(std::move(*this->shards[i])); });
+    }
+    pool.wait();
+    this->shards.resize(half);
+  }
+
+  if (!this->shards.empty()) {
+    index.merge(std::move(*this->shards.front()));
+    this->shards.clear();
+  }
+}
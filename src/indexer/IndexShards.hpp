@@ -0,0 +1,43 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "llvm/Support/ThreadPool.h"
+
+#include "types/Index.hpp"
+
+namespace hdoc::indexer {
+/// @brief Indexes that worker threads collect symbols into while indexing, so that they never wait on each other.
+///
+/// A worker acquires a shard for each file it indexes and releases it once it's done, which means there are never
+/// more shards than threads. Once indexing is done, all shards are merged into the final Index.
+class IndexShards {
+public:
+  /// @brief If claimSymbols is true, shards claim symbols from a shared set so that each symbol is only built
+  /// by the first worker that sees it.
+  IndexShards(const bool claimSymbols) : claimSymbols(claimSymbols) {}
+
+  /// @brief Take a shard for exclusive use by the calling thread
+  std::unique_ptr<hdoc::types::Index> acquire();
+
+  /// @brief Create a new shard that isn't part of this set, but claims symbols from it
+  std::unique_ptr<hdoc::types::Index> makeShard();
+
+  /// @brief Return a shard taken with acquire()
+  void release(std::unique_ptr<hdoc::types::Index> shard);
+
+  /// @brief Merge all of the shards into index, in parallel. All shards must have been released.
+  void mergeInto(hdoc::types::Index& index, llvm::ThreadPool& pool);
+
+private:
+  const bool                                       claimSymbols;
+  hdoc::types::SymbolClaims                        claims;
+  std::vector<std::unique_ptr<hdoc::types::Index>> shards; ///< Shards that aren't in use
+  std::mutex                                       mutex;
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,35 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace hdoc::indexer {
+/// @brief Thread-safe set of files whose declarations have been completely indexed by some TU.
+///
+/// Matching the declarations of such a file again in another TU would only produce symbols that are already in
+/// the Index, so top-level declarations from registered files are skipped before any matcher runs.
+/// Files are only registered once the TU that indexed them has finished and its symbols were merged.
+class IndexedFileRegistry {
+public:
+  /// @brief Check if the file at the absolute path has been indexed
+  bool contains(const std::string& path) const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->files.find(path) != this->files.end();
+  }
+
+  /// @brief Mark all of the files at the given absolute paths as indexed
+  void add(const std::vector<std::string>& paths) {
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    this->files.insert(paths.begin(), paths.end());
+  }
+
+private:
+  std::unordered_set<std::string> files;
+  mutable std::shared_mutex       mutex;
+};
+} // namespace hdoc::indexer
@@ -1,51 +1,253 @@
 // Copyright 2019-2023 hdoc
 // SPDX-License-Identifier: AGPL-3.0-only
 
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "spdlog/spdlog.h"
-#include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Tooling/ArgumentsAdjusters.h"
-#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 
+#include "indexer/HeaderOnlyDatabase.hpp"
+#include "indexer/IndexAction.hpp"
+#include "indexer/IndexCache.hpp"
+#include "indexer/IndexShards.hpp"
+#include "indexer/IndexedFileRegistry.hpp"
 #include "indexer/Indexer.hpp"
-#include "indexer/Matchers.hpp"
+#include "indexer/TUSetPlanner.hpp"
+#include "serde/BinarySerializer.hpp"
 #include "support/ParallelExecutor.hpp"
+#include "support/PrebuiltArtifacts.hpp"
+#include "support/SharedPCH.hpp"
 #include "support/StringUtils.hpp"
+#include "support/TUScheduler.hpp"
 
 // Check if a symbol is a child of the given namespace
 static bool isChild(const hdoc::types::Symbol& ns, const hdoc::types::Symbol& s) {
   return s.parentNamespaceID.raw() == ns.ID.raw();
 }
 
-void hdoc::indexer::Indexer::run() {
-  spdlog::info("Starting indexing...");
+/// Choose a subset of files that together include every project header that any of them includes, and return
+/// the files that were left out. Include sets come from the index cache if possible, and from running only the
+/// preprocessor otherwise.
+static std::vector<std::string> dropRedundantFiles(std::vector<std::string>&                  files,
+                                                   const clang::tooling::CompilationDatabase& cmpdb,
+                                                   const std::vector<std::string>&            includePaths,
+                                                   const hdoc::indexer::ArgumentProfile*      profile,
+                                                   hdoc::indexer::PrebuiltArtifacts*          prebuilt,
+                                                   hdoc::indexer::IndexCache*                 cache,
+                                                   const hdoc::types::Config*                 cfg,
+                                                   llvm::ThreadPool&                          pool) {
+  std::vector<std::vector<std::string>>        dependencies(files.size());
+  std::vector<std::string>                     filesToScan;
+  std::unordered_map<std::string, std::size_t> fileIndices;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    fileIndices.emplace(files[i], i);
+    if (const auto deps = cache ? cache->getDependencies(files[i]) : std::nullopt) {
+      dependencies[i] = *deps;
+    } else {
+      filesToScan.emplace_back(files[i]);
+    }
+  }
 
-  std::string err;
-  const auto  stx = clang::tooling::JSONCommandLineSyntax::AutoDetect;
-  const auto  cmpdb =
-      clang::tooling::JSONCompilationDatabase::loadFromFile(this->cfg->compileCommandsJSON.string(), err, stx);
+  spdlog::info("Scanning the includes of {} files.", filesToScan.size());
+  hdoc::indexer::ParallelExecutor scanner(cmpdb,
+                                          includePaths,
+                                          pool,
+                                          std::make_shared<clang::PCHContainerOperations>(),
+                                          nullptr,
+                                          hdoc::types::SchedulingPolicy::LongestFirst,
+                                          nullptr);
+  scanner.useArgumentProfile(profile, /*compare=*/false);
+  scanner.usePrebuiltArtifacts(prebuilt);
+  scanner.execute(filesToScan, [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::DependencyScanner>(&dependencies[fileIndices.at(path)]);
+  });
 
-  if (cmpdb == nullptr) {
-    spdlog::error("Unable to initialize compilation database ({})", err);
-    return;
+  // Source files don't have to be covered, which is what allows dropping any files at all
+  std::unordered_set<std::string> sourceFiles;
+  for (const auto& file : files) {
+    llvm::SmallString<128> path(file);
+    llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+    sourceFiles.emplace(path.str());
+  }
+  const auto needsCoverage = [&](const std::string& dep) {
+    if (sourceFiles.count(dep) > 0) {
+      return false;
+    }
+    const std::string relPath = std::filesystem::path(dep).lexically_relative(cfg->rootDir).string();
+    if (relPath.empty() || relPath.rfind("..", 0) == 0) {
+      return false;
+    }
+    return std::none_of(cfg->ignorePaths.begin(), cfg->ignorePaths.end(), [&](const std::string& ignorePath) {
+      return relPath.find(ignorePath) != std::string::npos;
+    });
+  };
+
+  std::vector<std::string> chosenFiles;
+  std::vector<std::string> droppedFiles;
+  std::size_t              next = 0;
+  for (const auto i : hdoc::indexer::planMinimalTUSet(dependencies, needsCoverage)) {
+    droppedFiles.insert(droppedFiles.end(), files.begin() + next, files.begin() + i);
+    chosenFiles.emplace_back(files[i]);
+    next = i + 1;
+  }
+  droppedFiles.insert(droppedFiles.end(), files.begin() + next, files.end());
+
+  spdlog::info("Indexing {} of {} files, the project headers included by the other {} files are covered by them.",
+               chosenFiles.size(),
+               files.size(),
+               droppedFiles.size());
+  files = std::move(chosenFiles);
+  return droppedFiles;
+}
+
+/// Can files be indexed while compile_commands.json is still being read? Only if they're indexed in the order of the
+/// database by threads, and nothing needs to know all of them before indexing starts.
+static bool canIndexWhileLoading(const hdoc::types::Config* cfg) {
+  return cfg->schedulingPolicy == hdoc::types::SchedulingPolicy::Database && cfg->numProcesses == 0 &&
+         cfg->numShards == 1 && cfg->command != hdoc::types::Command::Update && cfg->cacheDir.empty() &&
+         !cfg->minimalTUSet && !cfg->useSharedPCH && cfg->headerOnlyMode == hdoc::types::HeaderOnlyMode::Disabled;
+}
+
+/// Path of the dependency map that is saved next to a partial index
+static std::filesystem::path getDependencyMapPath(const std::filesystem::path& partialIndexPath) {
+  return partialIndexPath.string() + ".deps";
+}
+
+/// Read a partial index saved by savePartialIndex() into index
+static bool readPartialIndex(const std::filesystem::path& path, hdoc::types::Index& index) {
+  const auto buffer = llvm::MemoryBuffer::getFile(path.string(), /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    spdlog::error("Unable to read partial index {}: {}", path.string(), buffer.getError().message());
+    return false;
   }
+  if (!hdoc::serde::deserializeFromBinary((*buffer)->getBuffer(), index)) {
+    spdlog::error("{} is not a partial index written by this version of hdoc.", path.string());
+    return false;
+  }
+  return true;
+}
+
+/// Remove all symbols that are declared in one of files, which are relative to the root directory
+static void dropSymbolsInFiles(hdoc::types::Index& index, const std::unordered_set<std::string>& files) {
+  const auto drop = [&](auto& db) {
+    std::erase_if(db.entries, [&](const auto& entry) { return files.count(entry.second.file) > 0; });
+  };
+  drop(index.functions);
+  drop(index.records);
+  drop(index.enums);
+  drop(index.namespaces);
+  drop(index.aliases);
+}
+
+std::vector<std::string> hdoc::indexer::selectShard(std::vector<std::string> files,
+                                                    const uint32_t           shardIndex,
+                                                    const uint32_t           numShards) {
+  // Neighboring files tend to include the same headers, so keeping them in the same shard means fewer headers
+  // are indexed by more than one shard
+  std::sort(files.begin(), files.end());
+  const std::size_t begin = files.size() * shardIndex / numShards;
+  const std::size_t end   = files.size() * (shardIndex + 1) / numShards;
+  return std::vector<std::string>(files.begin() + begin, files.begin() + end);
+}
+
+bool hdoc::indexer::Indexer::savePartialIndex(const std::filesystem::path& path) const {
+  std::ofstream out(path, std::ios::binary);
+  out << hdoc::serde::serializeToBinary(this->index);
+  if (!out) {
+    spdlog::error("Unable to save partial index to {}.", path.string());
+    return false;
+  }
+  if (!this->dependencyMap.save(getDependencyMapPath(path))) {
+    return false;
+  }
+  spdlog::info("Saved partial index to {}.", path.string());
+  return true;
+}
 
-  hdoc::indexer::matchers::FunctionMatcher  FunctionFinder(&this->index, this->cfg);
-  hdoc::indexer::matchers::RecordMatcher    RecordFinder(&this->index, this->cfg);
-  hdoc::indexer::matchers::EnumMatcher      EnumFinder(&this->index, this->cfg);
-  hdoc::indexer::matchers::NamespaceMatcher NamespaceFinder(&this->index, this->cfg);
-  hdoc::indexer::matchers::UsingMatcher     UsingFinder(&this->index, this->cfg);
-  clang::ast_matchers::MatchFinder          Finder;
-  Finder.addMatcher(FunctionFinder.getMatcher(), &FunctionFinder);
-  Finder.addMatcher(RecordFinder.getMatcher(), &RecordFinder);
-  Finder.addMatcher(EnumFinder.getMatcher(), &EnumFinder);
-  Finder.addMatcher(NamespaceFinder.getMatcher(), &NamespaceFinder);
-  Finder.addMatcher(UsingFinder.getMatcher(), &UsingFinder);
+bool hdoc::indexer::Indexer::loadPartialIndex(const std::filesystem::path& path) {
+  hdoc::types::Index partial;
+  if (!readPartialIndex(path, partial)) {
+    return false;
+  }
+  this->index.merge(std::move(partial));
+  spdlog::info("Merged partial index {}.", path.string());
+  return true;
+}
 
+bool hdoc::indexer::Indexer::loadCompilationDatabase() {
+  this->jsonCmpdb = std::make_unique<hdoc::indexer::CompileCommandsDatabase>();
+  if (!this->readCompilationDatabase()) {
+    return false;
+  }
+
+  // In header-only mode, the project's source files only lend their flags to synthetic files that include its headers
+  if (this->cfg->headerOnlyMode != hdoc::types::HeaderOnlyMode::Disabled) {
+    this->headerOnlyCmpdb = hdoc::indexer::HeaderOnlyDatabase::create(*this->jsonCmpdb, this->cfg);
+    if (this->headerOnlyCmpdb == nullptr) {
+      return false;
+    }
+  }
+  if (this->headerOnlyCmpdb) {
+    this->cmpdb = this->headerOnlyCmpdb.get();
+  } else {
+    this->cmpdb = this->jsonCmpdb.get();
+  }
+  this->loadIncludePaths();
+  return true;
+}
+
+bool hdoc::indexer::Indexer::readCompilationDatabase(const CompileCommandsDatabase::FileCallback& onFile) {
+  // Symbols in ignored paths are dropped anyway, so source files in them aren't worth parsing
+  const auto isIndexed = [&](const std::string& path) {
+    if (this->cfg->ignorePaths.empty()) {
+      return true;
+    }
+    const std::string relPath = std::filesystem::path(path).lexically_relative(this->cfg->rootDir).string();
+    return std::none_of(this->cfg->ignorePaths.begin(), this->cfg->ignorePaths.end(), [&](const std::string& s) {
+      return relPath.find(s) != std::string::npos;
+    });
+  };
+
+  // Only the first files are indexed with the debug limit, unless the files to index are selected from all of them
+  uint32_t maxFiles = this->cfg->debugLimitNumIndexedFiles;
+  if (this->cfg->numShards > 1 || this->cfg->command == hdoc::types::Command::Update ||
+      this->cfg->headerOnlyMode != hdoc::types::HeaderOnlyMode::Disabled) {
+    maxFiles = 0;
+  }
+
+  std::string err;
+  this->jsonCmpdb->useDeduplication(this->cfg->deduplicateCommands);
+  if (!this->jsonCmpdb->load(this->cfg->compileCommandsJSON.string(), err, isIndexed, maxFiles, onFile)) {
+    spdlog::error("Unable to initialize compilation database ({})", err);
+    return false;
+  }
+  if (this->jsonCmpdb->getNumFilteredCommands() > 0) {
+    spdlog::info("Left out {} compile commands of source files in ignored paths.",
+                 this->jsonCmpdb->getNumFilteredCommands());
+  }
+  if (this->jsonCmpdb->getNumDuplicateCommands() > 0) {
+    const std::size_t numCommands = this->jsonCmpdb->getNumCommands();
+    spdlog::info("Left out {} compile commands of {} files that parse them the same way as another of their commands, "
+                 "parsing {} instead of {} commands.",
+                 this->jsonCmpdb->getNumDuplicateCommands(),
+                 this->jsonCmpdb->getNumDeduplicatedFiles(),
+                 numCommands,
+                 numCommands + this->jsonCmpdb->getNumDuplicateCommands());
+  }
+  return true;
+}
+
+void hdoc::indexer::Indexer::loadIncludePaths() {
   // Add include search paths to clang invocation
-  std::vector<std::string> includePaths = {};
+  this->includePaths.clear();
   for (const std::string& d : cfg->includePaths) {
     // Ignore include paths that don't exist
     if (!std::filesystem::exists(d)) {
@@ -53,11 +255,391 @@ void hdoc::indexer::Indexer::run() {
       continue;
     }
     spdlog::info("Appending {} to list of include paths.", d);
-    includePaths.emplace_back("-isystem" + d);
+    this->includePaths.emplace_back("-isystem" + d);
+  }
+
+  // hdoc only needs declarations, signatures, and comments. Clang still parses the bodies of constexpr functions
+  // and functions with deduced return types, since their signatures depend on them.
+  if (this->cfg->skipFunctionBodies) {
+    this->includePaths.insert(this->includePaths.end(), {"-Xclang", "-skip-function-bodies"});
+  }
+
+  // Arguments that hdoc doesn't need are removed from compile commands before the flags above are added
+  this->argumentProfile.reset();
+  if (this->cfg->stripArguments || !this->cfg->extraStripArguments.empty()) {
+    this->argumentProfile = std::make_unique<hdoc::indexer::ArgumentProfile>(
+        this->cfg->stripArguments, this->cfg->keepArguments, this->cfg->extraStripArguments);
+  }
+}
+
+bool hdoc::indexer::Indexer::run() {
+  spdlog::info("Starting indexing...");
+
+  // Files are indexed while compile_commands.json is still being read if nothing needs all of them up front
+  const bool indexWhileLoading = canIndexWhileLoading(this->cfg);
+  if (indexWhileLoading) {
+    this->jsonCmpdb = std::make_unique<hdoc::indexer::CompileCommandsDatabase>();
+    this->cmpdb     = this->jsonCmpdb.get();
+    this->loadIncludePaths();
+  } else if (!this->loadCompilationDatabase()) {
+    return false;
+  }
+
+  std::vector<std::string> files = this->cmpdb->getAllFiles();
+  if (this->cfg->numShards > 1) {
+    const std::size_t numFiles = files.size();
+    files = selectShard(std::move(files), this->cfg->shardIndex, this->cfg->numShards);
+    spdlog::info("Shard {} of {} has {} of {} files.",
+                 this->cfg->shardIndex + 1,
+                 this->cfg->numShards,
+                 files.size(),
+                 numFiles);
+  }
+  // Only the files affected by the changes are indexed again, the other symbols come from the partial indexes
+  if (this->cfg->command == hdoc::types::Command::Update) {
+    hdoc::indexer::DependencyMap baseDependencies;
+    for (const auto& path : this->cfg->partialIndexPaths) {
+      if (!baseDependencies.load(getDependencyMapPath(path))) {
+        spdlog::error("Unable to read {}, which 'hdoc index' saves next to the partial index.",
+                      getDependencyMapPath(path).string());
+        return false;
+      }
+    }
+    std::unordered_set<std::string> changedFiles;
+    for (const auto& file : this->cfg->changedFiles) {
+      changedFiles.emplace((this->cfg->rootDir / file).lexically_normal().string());
+    }
+    const std::size_t numFiles = files.size();
+    files                      = baseDependencies.getAffectedFiles(files, changedFiles);
+    spdlog::info("Reindexing {} of {} files, which are affected by {} changed files.",
+                 files.size(),
+                 numFiles,
+                 changedFiles.size());
+  }
+  if (this->cfg->debugLimitNumIndexedFiles > 0 && this->cfg->debugLimitNumIndexedFiles < files.size()) {
+    files.resize(this->cfg->debugLimitNumIndexedFiles);
+  }
+  if (this->cfg->command == hdoc::types::Command::Watch) {
+    this->sourceFiles = files;
+  }
+
+  // Headers shared by many files only need to be matched in the first TU that finishes indexing them
+  std::unique_ptr<hdoc::indexer::IndexedFileRegistry> registry;
+  if (this->cfg->skipIndexedFiles) {
+    registry = std::make_unique<hdoc::indexer::IndexedFileRegistry>();
+  }
+
+  // Every worker collects symbols into a shard of its own. Without a cache, shards claim symbols from a shared set
+  // so that each one is only built once. With a cache, every file needs to collect all symbols it contributes.
+  hdoc::indexer::IndexShards shards(/*claimSymbols=*/this->cfg->cacheDir.empty());
+
+  // Partial indexes come with the files that every indexed file included, so that `hdoc update` can tell which
+  // files are affected by changes. Watch mode needs to know the same.
+  hdoc::indexer::DependencyMap* dependencyMap = this->cfg->command == hdoc::types::Command::Index ||
+                                                        this->cfg->command == hdoc::types::Command::Watch
+                                                    ? &this->dependencyMap
+                                                    : nullptr;
+
+  // Reuse the symbols of files that haven't changed since the last run, and only parse the rest
+  std::unique_ptr<hdoc::indexer::IndexCache> cache;
+  if (!this->cfg->cacheDir.empty()) {
+    cache = std::make_unique<hdoc::indexer::IndexCache>(
+        this->cfg->cacheDir, *this->cmpdb, this->includePaths, this->cfg);
+    std::vector<std::string> changedFiles = cache->loadUnchanged(files, shards, this->pool, registry.get());
+    if (dependencyMap != nullptr) {
+      const std::unordered_set<std::string> reindexed(changedFiles.begin(), changedFiles.end());
+      for (const auto& file : files) {
+        if (reindexed.count(file) == 0) {
+          dependencyMap->add(file, cache->getDependencies(file).value_or(std::vector<std::string>()));
+        }
+      }
+    }
+    files = std::move(changedFiles);
+  }
+
+  // Files that timed out on an earlier run are indexed after all other files, so that they can't hold them up, or
+  // not at all
+  hdoc::indexer::TUQuarantine quarantine;
+  const std::filesystem::path quarantinePath = this->cfg->quarantinePath;
+  std::vector<std::string>    quarantinedFiles;
+  if (!quarantinePath.empty()) {
+    quarantine.load(quarantinePath);
+    const auto it = std::stable_partition(
+        files.begin(), files.end(), [&](const std::string& file) { return !quarantine.contains(file); });
+    quarantinedFiles.assign(it, files.end());
+    files.erase(it, files.end());
+    if (this->cfg->quarantinePolicy == hdoc::types::QuarantinePolicy::Skip) {
+      this->skippedFiles = std::move(quarantinedFiles);
+      quarantinedFiles.clear();
+    }
+  }
+
+  // All files share the same PCHContainerOperations, which the shared PCHs are built with too. PCHs and module
+  // files of the build are checked up front, so that stale ones are only replaced once and not by every worker
+  // process.
+  auto                                              pchOps = std::make_shared<clang::PCHContainerOperations>();
+  std::unique_ptr<hdoc::indexer::PrebuiltArtifacts> prebuilt;
+  if (this->cfg->reusePrebuilt) {
+    prebuilt = std::make_unique<hdoc::indexer::PrebuiltArtifacts>(*this->cmpdb, this->includePaths, pchOps);
+    prebuilt->prepare(files, this->pool);
+  }
+
+  // Only index as many files as needed to see every project header once
+  std::vector<std::string> droppedFiles;
+  if (this->cfg->minimalTUSet) {
+    droppedFiles = dropRedundantFiles(files,
+                                      *this->cmpdb,
+                                      this->includePaths,
+                                      this->argumentProfile.get(),
+                                      prebuilt.get(),
+                                      cache.get(),
+                                      this->cfg,
+                                      this->pool);
+  }
+
+  std::unique_ptr<hdoc::indexer::SharedPCH> pch;
+  if (this->cfg->useSharedPCH) {
+    pch = std::make_unique<hdoc::indexer::SharedPCH>(
+        *this->cmpdb, this->includePaths, pchOps, this->argumentProfile.get());
+    pch->build(files, this->pool);
+  }
+
+  // Durations and peak memory of the previous run are kept next to the index cache, so they're only available if
+  // there is one
+  hdoc::indexer::TUDurations  durations;
+  const std::filesystem::path durationsPath = this->cfg->cacheDir.empty() ? "" : this->cfg->cacheDir / "durations";
+  if (!durationsPath.empty()) {
+    durations.load(durationsPath);
+  }
+
+  // Paths of files are classified and namespace patterns compiled once for all threads
+  hdoc::indexer::SharedFileInfoCache     sharedFiles(this->cfg);
+  const hdoc::indexer::NamespacePatterns patterns(this->cfg);
+
+  hdoc::indexer::ParallelExecutor tool(
+      *this->cmpdb, this->includePaths, this->pool, pchOps, pch.get(), this->cfg->schedulingPolicy, &durations);
+  if (this->cfg->numProcesses > 0) {
+    tool.useWorkerProcesses(this->cfg->numProcesses, this->cfg->maxWorkerRSS);
+  }
+  tool.useMemoryBudget(this->cfg->memoryBudget);
+  tool.useTimeout(this->cfg->tuTimeout);
+  tool.useArgumentProfile(this->argumentProfile.get(), this->cfg->debugCompareArguments);
+  tool.usePrebuiltArtifacts(prebuilt.get());
+  const auto createIndexer = [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(
+        path, &shards, this->cfg, cache.get(), registry.get(), &sharedFiles, &patterns, dependencyMap);
+  };
+  if (indexWhileLoading) {
+    bool loaded = false;
+    tool.executeWhileLoading([&](const auto& addFile) { loaded = this->readCompilationDatabase(addFile); },
+                             createIndexer);
+    if (!loaded) {
+      return false;
+    }
+    if (this->cfg->command == hdoc::types::Command::Watch) {
+      this->sourceFiles = this->jsonCmpdb->getAllFiles();
+    }
+  } else {
+    tool.execute(files, createIndexer);
+  }
+  if (!quarantinedFiles.empty()) {
+    spdlog::info("Indexing {} files that timed out on an earlier run.", quarantinedFiles.size());
+    tool.execute(quarantinedFiles, createIndexer);
+  }
+  tool.printFileSystemStats();
+  tool.printArgumentComparison();
+  if (prebuilt) {
+    prebuilt->printStats();
+  }
+  if (this->argumentProfile) {
+    this->argumentProfile->printStats();
+  }
+  shards.mergeInto(this->index, this->pool);
+
+  // Files stay in quarantine until they're indexed within the timeout
+  this->timedOutFiles = tool.getTimedOutFiles();
+  if (!quarantinePath.empty()) {
+    for (const auto& file : quarantinedFiles) {
+      quarantine.remove(file);
+    }
+    for (const auto& file : this->timedOutFiles) {
+      quarantine.add(file);
+    }
+    quarantine.save(quarantinePath);
   }
 
-  hdoc::indexer::ParallelExecutor tool(*cmpdb, includePaths, this->pool, this->cfg->debugLimitNumIndexedFiles);
-  tool.execute(clang::tooling::newFrontendActionFactory(&Finder));
+  // Symbols from the partial indexes are only kept if they weren't indexed again. Those declared in changed files
+  // are dropped even if they weren't, since they may have been removed.
+  if (this->cfg->command == hdoc::types::Command::Update) {
+    const std::unordered_set<std::string> changedFiles(this->cfg->changedFiles.begin(), this->cfg->changedFiles.end());
+    for (const auto& path : this->cfg->partialIndexPaths) {
+      hdoc::types::Index base;
+      if (!readPartialIndex(path, base)) {
+        return false;
+      }
+      dropSymbolsInFiles(base, changedFiles);
+      this->index.merge(std::move(base));
+    }
+  }
+
+  // Index the files that were left out as well, and report the symbols that only they contain
+  if (this->cfg->debugVerifyMinimalTUSet && !droppedFiles.empty()) {
+    hdoc::indexer::IndexShards verifyShards(/*claimSymbols=*/true);
+    tool.execute(droppedFiles, [&](const std::string& path) {
+      return std::make_unique<hdoc::indexer::TUIndexer>(
+          path, &verifyShards, this->cfg, nullptr, nullptr, &sharedFiles, &patterns);
+    });
+    hdoc::types::Index verifyIndex;
+    verifyShards.mergeInto(verifyIndex, this->pool);
+
+    const auto countMissing = [](const auto& db, const auto& verifyDB) {
+      return std::count_if(verifyDB.entries.begin(), verifyDB.entries.end(), [&](const auto& entry) {
+        return !db.contains(entry.first);
+      });
+    };
+    const std::size_t numMissing = countMissing(this->index.functions, verifyIndex.functions) +
+                                   countMissing(this->index.records, verifyIndex.records) +
+                                   countMissing(this->index.enums, verifyIndex.enums) +
+                                   countMissing(this->index.namespaces, verifyIndex.namespaces) +
+                                   countMissing(this->index.aliases, verifyIndex.aliases);
+    if (numMissing == 0) {
+      spdlog::info("Verified that the {} files that were left out contain no additional symbols.",
+                   droppedFiles.size());
+    } else {
+      spdlog::warn("{} symbols are only declared in files that were left out. They were added to the index.",
+                   numMissing);
+    }
+    this->index.merge(std::move(verifyIndex));
+  }
+
+  if (!durationsPath.empty()) {
+    durations.save(durationsPath);
+  }
+
+  // Postprocessing changes the index in place, so watch mode keeps the raw index to apply changes to
+  if (this->cfg->command == hdoc::types::Command::Watch) {
+    this->rawIndex = std::make_unique<hdoc::types::Index>();
+    this->rawIndex->assign(this->index);
+  }
+  return true;
+}
+
+bool hdoc::indexer::Indexer::runOverFile(const std::string&                path,
+                                         const std::vector<std::string>&   args,
+                                         const std::optional<std::string>& code) {
+  const std::string absPath = std::filesystem::absolute(path).lexically_normal().string();
+  std::unique_ptr<clang::tooling::CompilationDatabase> cmpdb;
+  if (!args.empty()) {
+    cmpdb = std::make_unique<clang::tooling::FixedCompilationDatabase>(
+        std::filesystem::path(absPath).parent_path().string(), args);
+    this->loadIncludePaths();
+  } else {
+    if (!this->loadCompilationDatabase()) {
+      return false;
+    }
+    cmpdb       = clang::tooling::inferMissingCompileCommands(std::move(this->jsonCmpdb));
+    this->cmpdb = nullptr;
+  }
+
+  // A single file has no other files to share headers, a cache, or a PCH with
+  hdoc::indexer::IndexShards             shards(/*claimSymbols=*/true);
+  hdoc::indexer::SharedFileInfoCache     sharedFiles(this->cfg);
+  const hdoc::indexer::NamespacePatterns patterns(this->cfg);
+
+  auto                                              pchOps = std::make_shared<clang::PCHContainerOperations>();
+  std::unique_ptr<hdoc::indexer::PrebuiltArtifacts> prebuilt;
+  if (this->cfg->reusePrebuilt) {
+    prebuilt = std::make_unique<hdoc::indexer::PrebuiltArtifacts>(*cmpdb, this->includePaths, pchOps);
+  }
+
+  hdoc::indexer::ParallelExecutor tool(
+      *cmpdb, this->includePaths, this->pool, pchOps, nullptr, this->cfg->schedulingPolicy, nullptr);
+  tool.useArgumentProfile(this->argumentProfile.get(), /*compare=*/false);
+  tool.usePrebuiltArtifacts(prebuilt.get());
+  if (code) {
+    tool.mapVirtualFile(absPath, *code);
+  }
+  tool.execute({absPath}, [&](const std::string& file) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(
+        file, &shards, this->cfg, nullptr, nullptr, &sharedFiles, &patterns);
+  });
+  shards.mergeInto(this->index, this->pool);
+  return true;
+}
+
+void hdoc::indexer::Indexer::update(const std::vector<std::string>& changedFiles) {
+  const std::unordered_set<std::string> changed(changedFiles.begin(), changedFiles.end());
+  const std::vector<std::string>        files = this->dependencyMap.getAffectedFiles(this->sourceFiles, changed);
+  spdlog::info("Reindexing {} files, which are affected by {} changed files.", files.size(), changed.size());
+
+  std::unique_ptr<hdoc::indexer::IndexedFileRegistry> registry;
+  if (this->cfg->skipIndexedFiles) {
+    registry = std::make_unique<hdoc::indexer::IndexedFileRegistry>();
+  }
+  hdoc::indexer::IndexShards             shards(/*claimSymbols=*/true);
+  hdoc::indexer::SharedFileInfoCache     sharedFiles(this->cfg);
+  const hdoc::indexer::NamespacePatterns patterns(this->cfg);
+
+  // The tool is kept across updates, so that files that didn't change are neither stat-ed nor read from disk again
+  if (this->updateTool == nullptr) {
+    this->updatePCHOps = std::make_shared<clang::PCHContainerOperations>();
+    this->updateTool   = std::make_unique<hdoc::indexer::ParallelExecutor>(*this->cmpdb,
+                                                                         this->includePaths,
+                                                                         this->pool,
+                                                                         this->updatePCHOps,
+                                                                         nullptr,
+                                                                         this->cfg->schedulingPolicy,
+                                                                         nullptr);
+    if (this->cfg->numProcesses > 0) {
+      this->updateTool->useWorkerProcesses(this->cfg->numProcesses, this->cfg->maxWorkerRSS);
+    }
+    this->updateTool->useMemoryBudget(this->cfg->memoryBudget);
+    this->updateTool->useTimeout(this->cfg->tuTimeout);
+    this->updateTool->useArgumentProfile(this->argumentProfile.get(), /*compare=*/false);
+    this->updateTool->recordLookups();
+  } else {
+    this->updateTool->invalidate(changedFiles);
+    this->updateTool->clearTimedOutFiles();
+  }
+
+  // The build may have replaced its PCHs and module files since they were last checked
+  if (this->cfg->reusePrebuilt) {
+    this->updatePrebuilt = std::make_unique<hdoc::indexer::PrebuiltArtifacts>(
+        *this->cmpdb, this->includePaths, this->updatePCHOps);
+    this->updatePrebuilt->prepare(files, this->pool);
+    this->updateTool->usePrebuiltArtifacts(this->updatePrebuilt.get());
+  }
+
+  this->updateTool->execute(files, [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(
+        path, &shards, this->cfg, nullptr, registry.get(), &sharedFiles, &patterns, &this->dependencyMap);
+  });
+  this->timedOutFiles = this->updateTool->getTimedOutFiles();
+
+  // The new symbols replace the old ones. Symbols declared in changed files are dropped even if no file declares
+  // them anymore.
+  std::unordered_set<std::string> changedRelPaths;
+  for (const auto& file : changedFiles) {
+    changedRelPaths.emplace(std::filesystem::path(file).lexically_relative(this->cfg->rootDir).string());
+  }
+  dropSymbolsInFiles(*this->rawIndex, changedRelPaths);
+  auto updated = std::make_unique<hdoc::types::Index>();
+  shards.mergeInto(*updated, this->pool);
+  updated->merge(std::move(*this->rawIndex));
+  this->rawIndex = std::move(updated);
+  this->index.assign(*this->rawIndex);
+}
+
+std::vector<std::string> hdoc::indexer::Indexer::getWatchedFiles() const {
+  std::unordered_set<std::string> files(this->sourceFiles.begin(), this->sourceFiles.end());
+  for (const auto& file : this->dependencyMap.getAllDependencies()) {
+    // Only project files can change while hdoc is running, system headers are left out
+    const std::string relPath = std::filesystem::path(file).lexically_relative(this->cfg->rootDir).string();
+    if (!relPath.empty() && relPath.rfind("..", 0) != 0) {
+      files.insert(file);
+    }
+  }
+  return std::vector<std::string>(files.begin(), files.end());
 }
 
 void hdoc::indexer::Indexer::resolveNamespaces() {
@@ -177,6 +759,20 @@ void hdoc::indexer::Indexer::printStats() const {
   printDatabaseSize("Enums", this->index.enums);
   printDatabaseSize("Namespaces", this->index.namespaces);
   printDatabaseSize("Usings", this->index.aliases);
+
+  if (!this->timedOutFiles.empty()) {
+    spdlog::warn("{} files were abandoned because they took too long to index:", this->timedOutFiles.size());
+    for (const auto& file : this->timedOutFiles) {
+      spdlog::warn("  {}", file);
+    }
+  }
+  if (!this->skippedFiles.empty()) {
+    spdlog::warn("{} files were skipped because they took too long to index on an earlier run:",
+                 this->skippedFiles.size());
+    for (const auto& file : this->skippedFiles) {
+      spdlog::warn("  {}", file);
+    }
+  }
 }
 
 void hdoc::indexer::Indexer::pruneMethods() {
@@ -5,16 +5,58 @@
 
 #include "llvm/Support/ThreadPool.h"
 
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "indexer/CompileCommandsDatabase.hpp"
+#include "indexer/DependencyMap.hpp"
+#include "indexer/HeaderOnlyDatabase.hpp"
+#include "support/ArgumentProfile.hpp"
+#include "support/ParallelExecutor.hpp"
+#include "support/PrebuiltArtifacts.hpp"
 #include "types/Config.hpp"
 #include "types/Index.hpp"
 
 namespace hdoc::indexer {
+/// @brief The files that the shard with the given zero-based index indexes when files are split into numShards shards.
+/// Every shard gets a contiguous range of the sorted files, so the result only depends on the set of files.
+std::vector<std::string>
+selectShard(std::vector<std::string> files, const uint32_t shardIndex, const uint32_t numShards);
+
 /// @brief Index all of the code in a project into hdoc's internal representation
 class Indexer {
 public:
   Indexer(const hdoc::types::Config* cfg, llvm::ThreadPool& pool) : cfg(cfg), pool(pool) {}
-  /// @brief Run the indexer over project code
-  void run();
+  /// @brief Run the indexer over project code. Returns false if the compilation database or the partial indexes
+  /// and dependency maps it needs can't be read, in which case the index must not be used.
+  bool run();
+
+  /// @brief Index only the file at path, with code as its contents instead of what's on disk if given.
+  /// It's parsed with args as compiler flags if given, or else with its compile command. Files without one, like
+  /// headers, borrow the command of the most similar file in the compilation database. Returns false if that's needed
+  /// and the compilation database couldn't be loaded.
+  bool runOverFile(const std::string&                path,
+                   const std::vector<std::string>&   args,
+                   const std::optional<std::string>& code = std::nullopt);
+
+  /// @brief Index the files affected by changes to changedFiles (absolute paths) again, replacing the symbols they
+  /// contributed before, and reset the index to what it was before postprocessing. Only available in watch mode.
+  void update(const std::vector<std::string>& changedFiles);
+
+  /// @brief Absolute paths of the source files, and of the project files they included when they were last indexed.
+  /// Only available in watch mode.
+  std::vector<std::string> getWatchedFiles() const;
+
+  /// @brief Save the index as a partial index, before any postprocessing, and the files that every indexed file
+  /// included next to it, for `hdoc update`. Returns false if they couldn't be written.
+  bool savePartialIndex(const std::filesystem::path& path) const;
+
+  /// @brief Merge a partial index saved by savePartialIndex() into the index. Symbols that are already in the index
+  /// are kept, just like when shards are merged. Returns false if the partial index couldn't be read.
+  bool loadPartialIndex(const std::filesystem::path& path);
 
   /// @brief Update the declaration of the all records to indicate records they inherit
   /// from and the type of inheritance. This must be done after all records are
@@ -36,16 +78,48 @@ public:
   /// We need to remove them prior to HTML serialization to ensure we don't have dead links.
   void pruneTypeRefs();
 
-  /// @brief Print the number of matches, indexed entries, and size of the database for each type.
+  /// @brief Print the number of matches, indexed entries, and size of the database for each type, and the files that
+  /// were abandoned or skipped because they took too long.
   void printStats() const;
 
   /// @brief Dump the index for use in serde
   const hdoc::types::Index* dump() const;
 
 private:
+  /// Load the compilation database and the include paths that are added to every compile command
+  bool loadCompilationDatabase();
+
+  /// Read compile_commands.json into jsonCmpdb, calling onFile with a file that's indexed every time one of its
+  /// commands was read.
+  /// Files in ignored paths are left out, and so are the files after the first few if only those are indexed.
+  bool readCompilationDatabase(const CompileCommandsDatabase::FileCallback& onFile = nullptr);
+
+  /// Load the flags that are added to every compile command and the profile of arguments that are removed from them,
+  /// which loadCompilationDatabase() does too
+  void loadIncludePaths();
+
   hdoc::types::Index         index;
   const hdoc::types::Config* cfg;
   llvm::ThreadPool&          pool;
+  std::vector<std::string>   timedOutFiles; ///< Files abandoned because of cfg->tuTimeout
+  std::vector<std::string>   skippedFiles;  ///< Files not indexed because they timed out on an earlier run
+  DependencyMap              dependencyMap; ///< Files included by each indexed file, only recorded if needed
+  std::vector<std::string>   includePaths;  ///< Flags added to every compile command
+
+  std::unique_ptr<ArgumentProfile> argumentProfile; ///< Removes arguments from compile commands, if configured
+
+  std::unique_ptr<CompileCommandsDatabase>   jsonCmpdb;
+  std::unique_ptr<HeaderOnlyDatabase>        headerOnlyCmpdb; ///< Only used in header-only mode
+  const clang::tooling::CompilationDatabase* cmpdb = nullptr;  ///< Database that files are indexed with
+
+  // Only kept in watch mode
+  std::vector<std::string>            sourceFiles; ///< Files from the compilation database
+  std::unique_ptr<hdoc::types::Index> rawIndex;    ///< The index before postprocessing
+
+  // Created by the first update and kept for the later ones
+  std::shared_ptr<clang::PCHContainerOperations> updatePCHOps;
+  std::unique_ptr<PrebuiltArtifacts>             updatePrebuilt; ///< Replaced by every update
+  std::unique_ptr<ParallelExecutor>              updateTool;     ///< Remembers what earlier updates looked up
 };
 
 } // namespace hdoc::indexer
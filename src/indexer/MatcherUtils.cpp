@@ -17,55 +17,22 @@
 
 #include <filesystem>
 
-/// When hdoc is run by multiple threads, we use a VFS (virtual file system) to access
-/// files safely. The working directory of the parser is changed during indexing, and
-/// other threads have no visibility of this. Consequently, canonical paths
-/// generated in a non-VFS-aware way can be wrong.
-/// This function is similar to one defined in clang, and gets the canonical path in a
-/// VFS-aware way.
-static std::optional<std::string> getCanonicalPath(const clang::Decl* d) {
-  const auto& sourceManager = d->getASTContext().getSourceManager();
-  const auto fileLoc = d->getASTContext().getSourceManager().getFileLoc(d->getLocation()); // Resolves macro locations
-  const auto* fileEntry = sourceManager.getFileEntryForID(sourceManager.getFileID(fileLoc));
-
-  if (!fileEntry) {
-    return std::nullopt;
-  }
-
-  llvm::SmallString<128> path = fileEntry->getName();
-  if (!llvm::sys::path::is_absolute(path)) {
-    if (auto ec = sourceManager.getFileManager().getVirtualFileSystem().makeAbsolute(path)) {
-      spdlog::warn("Could not turn relative path '{}' to absolute: {}", path.c_str(), ec.message().c_str());
-      return std::nullopt;
-    }
-  }
-
-  if (auto dir = sourceManager.getFileManager().getDirectoryRef(llvm::sys::path::parent_path(path))) {
-    const llvm::StringRef  dirName = sourceManager.getFileManager().getCanonicalName(dir.get());
-    llvm::SmallString<128> realPath;
-    llvm::sys::path::append(realPath, dirName, llvm::sys::path::filename(path));
-    return realPath.str().str();
-  }
-
-  return path.str().str();
-}
-
 template <typename T> static bool isParamAndHasName(const T* param) {
   return (param != nullptr) && param->hasParamName();
 }
 
 /// This is used across all types of symbols (Function, Record, Namespace, etc.) to get the
 /// vital information of the symbol
-void fillOutSymbol(hdoc::types::Symbol& s, const clang::NamedDecl* d, const std::filesystem::path& rootDir) {
+void fillOutSymbol(hdoc::types::Symbol& s, const clang::NamedDecl* d, hdoc::indexer::FileInfoCache& files) {
   s.name = d->getNameAsString();
   s.line = d->getASTContext().getSourceManager().getSpellingLineNumber(d->getLocation());
 
-  const auto absPath = getCanonicalPath(d);
-  if (!absPath) {
+  const hdoc::indexer::FileInfo& file = files.get(d);
+  if (!file.hasPath) {
     spdlog::warn("Unable to get absolute path for {}", s.name);
     return;
   }
-  s.file = std::filesystem::relative(*absPath, rootDir).string();
+  s.file = file.relPath;
 }
 
 /// @brief If the type is a specialized template, convert it to the original non-specialized
@@ -81,52 +48,31 @@ const clang::ClassTemplateDecl* getNonSpecializedVersionOfDecl(const clang::TagD
   return NULL;
 }
 
-void fillNamespace(hdoc::types::Symbol& s, const clang::NamedDecl* d, const hdoc::types::Config* cfg) {
+void fillNamespace(hdoc::types::Symbol& s, const clang::NamedDecl* d, hdoc::indexer::NamespaceClassifier& namespaces) {
   const auto* dc = d->getLexicalDeclContext();
   if (const auto* n = llvm::dyn_cast_or_null<clang::NamespaceDecl>(dc)) {
     s.parentNamespaceID = buildID(n);
   } else if (const auto* n = llvm::dyn_cast_or_null<clang::RecordDecl>(dc)) {
     s.parentNamespaceID = buildID(n);
   }
-  s.isDetail = hdoc::indexer::matchers::utils::isEnclosingNamespaceInList(d, cfg->detailNamespaces);
+  s.isDetail = namespaces.isInDetailNamespace(d);
 }
 
-bool isInIgnoreList(const clang::Decl* d, const hdoc::types::Config* cfg) {
-
-  // handle path-based ignore
-  const auto ignorePaths = cfg->ignorePaths;
-  const auto rootDir = cfg->rootDir;
-
-  const auto fileLoc = d->getASTContext().getSourceManager().getFileLoc(d->getLocation()); // Resolves macro locations
-  const auto rawPath = std::filesystem::path(d->getASTContext().getSourceManager().getFilename(fileLoc).str());
-
-  // If the decl has an empty path, it's probably compiler-generated so we ignore it
-  if (rawPath == "") {
-    spdlog::warn("Empty path, ignoring decl");
-    return true;
-  }
-
-  const auto absPath = getCanonicalPath(d);
-  if (!absPath) {
+bool isInIgnoreList(const clang::Decl*                 d,
+                    hdoc::indexer::FileInfoCache&       files,
+                    hdoc::indexer::NamespaceClassifier& namespaces) {
+  // Decls without a path are probably compiler-generated, so they're ignored along with decls in files outside of
+  // the rootDir and in ignored paths
+  const hdoc::indexer::FileInfo& file = files.get(d);
+  if (!file.hasPath) {
     spdlog::warn("Unable to get absolute path for a decl, ignoring it");
     return true;
   }
-
-  // Ignore paths outside of the rootDir
-  // ".." is used as a janky way to determine if the path is outside of rootDir since the canonicalized path
-  // should not have any ".."s in it
-  const std::string relPath = std::filesystem::relative(std::filesystem::path(*absPath), rootDir).string();
-  if (relPath.find("..") != std::string::npos) {
+  if (file.outsideRootDir || file.ignored) {
     return true;
   }
 
-  for (const auto& substr : ignorePaths) {
-    if (relPath.find(substr) != std::string::npos) {
-      return true;
-    }
-  }
-
-  return hdoc::indexer::matchers::utils::isEnclosingNamespaceInList(d, cfg->ignoreNamespaces);
+  return namespaces.isInIgnoredNamespace(d);
 }
 
 /// Decls in anonymous namespaces should not be documented
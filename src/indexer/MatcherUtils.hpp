@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "indexer/FileInfoCache.hpp"
+#include "indexer/NamespaceClassifier.hpp"
 #include "types/Config.hpp"
 #include "types/Symbols.hpp"
 #include "clang/AST/Comment.h"
@@ -11,17 +13,19 @@
 #include <string>
 
 /// @brief Update the name, line, and file of the decl
-void fillOutSymbol(hdoc::types::Symbol& s, const clang::NamedDecl* d, const std::filesystem::path& rootDir);
+void fillOutSymbol(hdoc::types::Symbol& s, const clang::NamedDecl* d, hdoc::indexer::FileInfoCache& files);
 
 /// @brief If the type is a specialized template, convert it to the original non-specialized
 /// templated type.
 const clang::ClassTemplateDecl* getNonSpecializedVersionOfDecl(const clang::TagDecl* tagdecl);
 
 /// @brief Find the parent namespace (either record or an actual namespace) of a decl
-void fillNamespace(hdoc::types::Symbol& s, const clang::NamedDecl* d, const hdoc::types::Config* cfg);
+void fillNamespace(hdoc::types::Symbol& s, const clang::NamedDecl* d, hdoc::indexer::NamespaceClassifier& namespaces);
 
 /// @brief Check if a decl is defined in a non-existent file or in the set of ignored paths or namespaces
-bool isInIgnoreList(const clang::Decl* d, const hdoc::types::Config* cfg);
+bool isInIgnoreList(const clang::Decl*                 d,
+                    hdoc::indexer::FileInfoCache&       files,
+                    hdoc::indexer::NamespaceClassifier& namespaces);
 
 /// @brief Check if the decl is in an anonymous namespace
 bool isInAnonymousNamespace(const clang::Decl* d);
@@ -9,29 +9,10 @@
 #include "Matchers.hpp"
 #include "MatcherUtils.hpp"
 #include "types/Symbols.hpp"
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Comment.h"
 #include "clang/Lex/Lexer.h"
 
-bool hdoc::indexer::matchers::utils::isEnclosingNamespaceInList(const clang::Decl* decl, const std::vector<std::string>& list) {
-  auto* parent = decl->getDeclContext();
-  while (parent) {
-    if (auto* namespaceDecl = llvm::dyn_cast<clang::NamespaceDecl>(parent)) {
-      if (namespaceDecl->isAnonymousNamespace()) {
-        parent = parent->getParent();
-        continue;
-      }
-      auto name = namespaceDecl->getNameAsString();
-      for (const auto& substr : list) {
-        if (name.find(substr) != std::string::npos) {
-          return true;
-        }
-      }
-    }
-    parent = parent->getParent();
-  }
-  return false;
-}
-
 /// @brief Try to get a SymbolID from a QualType, and return an empty SymbolID if it's not possible
 static hdoc::types::SymbolID getTypeSymbolID(const clang::QualType& typ) {
   // Get a TagDecl from the QualType, stripping pointers and references if needed.
@@ -109,9 +90,7 @@ static std::vector<hdoc::types::TemplateParam> collectTemplateParams(const clang
   return templateParams;
 }
 
-void hdoc::indexer::matchers::FunctionMatcher::run(const clang::ast_matchers::MatchFinder::MatchResult& Result) {
-  const auto res = Result.Nodes.getNodeAs<clang::FunctionDecl>("function");
-
+void hdoc::indexer::matchers::FunctionMatcher::run(const clang::FunctionDecl* res) {
   // We must either deliberately ignore deleted functions or document them as deleted. Doing neither will mean
   // they show up as _defined_, which is the opposite of the truth. Not listing them is the easier way out; if
   // we ever do want document them we should also document implicitly deleted constructors and functions.
@@ -129,20 +108,20 @@ void hdoc::indexer::matchers::FunctionMatcher::run(const clang::ast_matchers::Ma
 
   // Ignore invalid matches, matches in ignored files, and static functions
   if (res == nullptr ||
-      isInIgnoreList(res, this->cfg) || !res->getSourceRange().isValid() ||
+      isInIgnoreList(res, *this->files, *this->namespaces) || !res->getSourceRange().isValid() ||
       (res->isStatic() && !res->isCXXClassMember()) || isInAnonymousNamespace(res) ||
       (res->getAccess() == clang::AS_private && cfg->ignorePrivateMembers == true)) {
     return;
   }
 
   const hdoc::types::SymbolID ID = buildID(res);
-  if (this->index->functions.contains(ID)) {
+  // Only the first thread to claim a symbol builds it
+  if (!this->index->functions.claim(ID)) {
     return;
   }
-  this->index->functions.reserve(ID);
   hdoc::types::FunctionSymbol f;
   f.ID = ID;
-  fillOutSymbol(f, res, this->cfg->rootDir);
+  fillOutSymbol(f, res, *this->files);
 
   // Determine if the function is a conversion operator early, since it influences proto generation
   if (const auto* conversion = llvm::dyn_cast<clang::CXXConversionDecl>(res)) {
@@ -237,13 +216,11 @@ void hdoc::indexer::matchers::FunctionMatcher::run(const clang::ast_matchers::Ma
 
   f.proto          = getFunctionSignature(f);
 
-  fillNamespace(f, res, this->cfg);
-  this->index->functions.update(f.ID, f);
+  fillNamespace(f, res, *this->namespaces);
+  this->index->functions.update(f.ID, std::move(f));
 }
 
-void hdoc::indexer::matchers::UsingMatcher::run(const clang::ast_matchers::MatchFinder::MatchResult& Result) {
-  const auto res = Result.Nodes.getNodeAs<clang::NamedDecl>("using");
-
+void hdoc::indexer::matchers::UsingMatcher::run(const clang::NamedDecl* res) {
   // Only interested in aliases
   if(!llvm::isa_and_present<clang::UsingDecl>(res) && !llvm::isa_and_present<clang::UsingShadowDecl>(res)
      && !llvm::isa_and_present<clang::TypedefNameDecl>(res)) {
@@ -258,27 +235,27 @@ void hdoc::indexer::matchers::UsingMatcher::run(const clang::ast_matchers::Match
   // Count the number of aliases matched
   this->index->aliases.numMatches++;
 
-  if(isInIgnoreList(res, this->cfg)) spdlog::warn("Ignoring Using [ignore list] : {}", res->getQualifiedNameAsString());
+  if(isInIgnoreList(res, *this->files, *this->namespaces)) spdlog::warn("Ignoring Using [ignore list] : {}", res->getQualifiedNameAsString());
   if(!res->getSourceRange().isValid()) spdlog::warn("Ignoring Using [invalid source range] : {}", res->getQualifiedNameAsString());
 
   // Ignore invalid matches and matches in ignored files
   if (res == nullptr ||
-      isInIgnoreList(res, this->cfg) || !res->getSourceRange().isValid() ||
+      isInIgnoreList(res, *this->files, *this->namespaces) || !res->getSourceRange().isValid() ||
       (res->getAccess() == clang::AS_private && cfg->ignorePrivateMembers == true)) {
     return;
   }
 
   const hdoc::types::SymbolID ID = buildID(res);
-  if (this->index->aliases.contains(ID)) {
+  // Only the first thread to claim a symbol builds it
+  if (!this->index->aliases.claim(ID)) {
     return;
   }
-  this->index->aliases.reserve(ID);
 
   clang::PrintingPolicy pp(res->getASTContext().getLangOpts());
 
   hdoc::types::AliasSymbol a;
   a.ID = ID;
-  fillOutSymbol(a, res, this->cfg->rootDir);
+  fillOutSymbol(a, res, *this->files);
 
   a.isRecordMember = res->isCXXClassMember();
   if(a.isRecordMember) a.access = res->getAccess();
@@ -314,8 +291,8 @@ void hdoc::indexer::matchers::UsingMatcher::run(const clang::ast_matchers::Match
     processSymbolComment(a, comment, res->getASTContext());
   }
 
-  fillNamespace(a, res, this->cfg);
-  this->index->aliases.update(a.ID, a);
+  fillNamespace(a, res, *this->namespaces);
+  this->index->aliases.update(a.ID, std::move(a));
 }
 
 std::vector<std::string> templateArgsToStrings(const clang::TemplateArgumentList& args, const clang::ASTContext& ctx, const hdoc::types::RecordSymbol& record) {
@@ -367,15 +344,13 @@ std::vector<std::string> templateArgsToStrings(const clang::TemplateArgumentList
   return ret;
 }
 
-void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::MatchFinder::MatchResult& Result) {
-  const auto res = Result.Nodes.getNodeAs<clang::CXXRecordDecl>("record");
-
+void hdoc::indexer::matchers::RecordMatcher::run(const clang::CXXRecordDecl* res) {
   // Count the number of records matched
   this->index->records.numMatches++;
 
   // Ignore invalid matches
   if (res == nullptr || !res->isCompleteDefinition() || !res->getSourceRange().isValid() ||
-      isInIgnoreList(res, this->cfg) || isInAnonymousNamespace(res)) {
+      isInIgnoreList(res, *this->files, *this->namespaces) || isInAnonymousNamespace(res)) {
     return;
   }
 
@@ -401,13 +376,13 @@ void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::Matc
   }
 
   const hdoc::types::SymbolID ID = buildID(res);
-  if (this->index->records.contains(ID)) {
+  // Only the first thread to claim a symbol builds it
+  if (!this->index->records.claim(ID)) {
     return;
   }
-  this->index->records.reserve(ID);
   hdoc::types::RecordSymbol c;
   c.ID = ID;
-  fillOutSymbol(c, res, this->cfg->rootDir);
+  fillOutSymbol(c, res, *this->files);
 
   // Apply the cached name found earlier for suspected typedef'ed decls
   if (c.name == "") {
@@ -421,7 +396,7 @@ void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::Matc
   // Get methods and decls (what's the difference?) for this record
   for (const auto* m : res->methods()) {
     if (m == nullptr || m->isImplicit() ||
-        isInIgnoreList(m, this->cfg) || isInAnonymousNamespace(m) ||
+        isInIgnoreList(m, *this->files, *this->namespaces) || isInAnonymousNamespace(m) ||
         (m->getAccess() == clang::AS_private && cfg->ignorePrivateMembers == true)) {
       continue;
     }
@@ -430,7 +405,7 @@ void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::Matc
   for (const auto* d : res->decls()) {
     if (const auto* ftd = llvm::dyn_cast<clang::FunctionTemplateDecl>(d)) {
       if (ftd == nullptr || ftd->isImplicit() ||
-          isInIgnoreList(ftd, this->cfg) || isInAnonymousNamespace(ftd) ||
+          isInIgnoreList(ftd, *this->files, *this->namespaces) || isInAnonymousNamespace(ftd) ||
           (ftd->getAccess() == clang::AS_private && cfg->ignorePrivateMembers == true)) {
         continue;
       }
@@ -447,7 +422,7 @@ void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::Matc
       if (!alias) alias = llvm::dyn_cast<clang::UsingDecl>(d);
       if (!alias) alias = llvm::dyn_cast<clang::TypedefNameDecl>(d);
       if (alias == nullptr || alias->isImplicit() ||
-          isInIgnoreList(alias, this->cfg) || isInAnonymousNamespace(alias) ||
+          isInIgnoreList(alias, *this->files, *this->namespaces) || isInAnonymousNamespace(alias) ||
           (alias->getAccess() == clang::AS_private && cfg->ignorePrivateMembers == true)) {
         continue;
       }
@@ -573,30 +548,28 @@ void hdoc::indexer::matchers::RecordMatcher::run(const clang::ast_matchers::Matc
     processSymbolComment(c, comment, res->getASTContext());
   }
 
-  fillNamespace(c, res, this->cfg);
-  this->index->records.update(c.ID, c);
+  fillNamespace(c, res, *this->namespaces);
+  this->index->records.update(c.ID, std::move(c));
 }
 
-void hdoc::indexer::matchers::EnumMatcher::run(const clang::ast_matchers::MatchFinder::MatchResult& Result) {
-  const auto res = Result.Nodes.getNodeAs<clang::EnumDecl>("enum");
-
+void hdoc::indexer::matchers::EnumMatcher::run(const clang::EnumDecl* res) {
   // Count the number of classes matched
   this->index->enums.numMatches++;
 
   // Ignore invalid matches and anonymous enums
   if (res == nullptr || res->getNameAsString() == "" ||
-      isInIgnoreList(res, this->cfg) || isInAnonymousNamespace(res)) {
+      isInIgnoreList(res, *this->files, *this->namespaces) || isInAnonymousNamespace(res)) {
     return;
   }
 
   const hdoc::types::SymbolID ID = buildID(res);
-  if (this->index->enums.contains(ID)) {
+  // Only the first thread to claim a symbol builds it
+  if (!this->index->enums.claim(ID)) {
     return;
   }
-  this->index->enums.reserve(ID);
   hdoc::types::EnumSymbol e;
   e.ID = ID;
-  fillOutSymbol(e, res, this->cfg->rootDir);
+  fillOutSymbol(e, res, *this->files);
 
   if (const auto* parent = llvm::dyn_cast<clang::CXXRecordDecl>(res->getParent())) {
     e.name = parent->getNameAsString() + "::" + e.name;
@@ -635,31 +608,29 @@ void hdoc::indexer::matchers::EnumMatcher::run(const clang::ast_matchers::MatchF
     processSymbolComment(e, comment, res->getASTContext());
   }
 
-  fillNamespace(e, res, this->cfg);
-  this->index->enums.update(e.ID, e);
+  fillNamespace(e, res, *this->namespaces);
+  this->index->enums.update(e.ID, std::move(e));
 }
 
-void hdoc::indexer::matchers::NamespaceMatcher::run(const clang::ast_matchers::MatchFinder::MatchResult& Result) {
-  const auto res = Result.Nodes.getNodeAs<clang::NamespaceDecl>("namespace");
-
+void hdoc::indexer::matchers::NamespaceMatcher::run(const clang::NamespaceDecl* res) {
   // Count the number of namespaces matched
   this->index->namespaces.numMatches++;
 
   // Ignore invalid matches and anonymous enums
   if (res == nullptr || res->getNameAsString() == "" ||
-      isInIgnoreList(res, this->cfg) || isInAnonymousNamespace(res)) {
+      isInIgnoreList(res, *this->files, *this->namespaces) || isInAnonymousNamespace(res)) {
     return;
   }
 
   const hdoc::types::SymbolID ID = buildID(res);
-  if (this->index->namespaces.contains(ID)) {
+  // Only the first thread to claim a symbol builds it
+  if (!this->index->namespaces.claim(ID)) {
     return;
   }
-  this->index->namespaces.reserve(ID);
   hdoc::types::NamespaceSymbol n;
   n.ID = ID;
-  fillOutSymbol(n, res, this->cfg->rootDir);
+  fillOutSymbol(n, res, *this->files);
 
-  fillNamespace(n, res, this->cfg);
-  this->index->namespaces.update(n.ID, n);
+  fillNamespace(n, res, *this->namespaces);
+  this->index->namespaces.update(n.ID, std::move(n));
 }
@@ -0,0 +1,29 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/NamespaceClassifier.hpp"
+
+hdoc::indexer::NamespaceClassifier::Flags hdoc::indexer::NamespaceClassifier::getEnclosing(const clang::Decl* d) {
+  for (const clang::DeclContext* dc = d->getDeclContext(); dc != nullptr; dc = dc->getParent()) {
+    if (const auto* ns = llvm::dyn_cast<clang::NamespaceDecl>(dc)) {
+      return this->get(ns);
+    }
+  }
+  return Flags();
+}
+
+hdoc::indexer::NamespaceClassifier::Flags hdoc::indexer::NamespaceClassifier::get(const clang::NamespaceDecl* ns) {
+  if (const auto it = this->namespaces.find(ns); it != this->namespaces.end()) {
+    return it->second;
+  }
+
+  // Anonymous namespaces have no name to match, but still inherit the flags of their parents
+  Flags flags = this->getEnclosing(ns);
+  if (!ns->isAnonymousNamespace()) {
+    const llvm::StringRef name = ns->getName();
+    flags.ignored = flags.ignored || this->patterns.ignore.matches(std::string_view(name.data(), name.size()));
+    flags.detail  = flags.detail || this->patterns.detail.matches(std::string_view(name.data(), name.size()));
+  }
+  this->namespaces[ns] = flags;
+  return flags;
+}
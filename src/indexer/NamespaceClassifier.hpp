@@ -0,0 +1,50 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include "clang/AST/Decl.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include "support/MultiPatternMatcher.hpp"
+#include "types/Config.hpp"
+
+namespace hdoc::indexer {
+/// @brief cfg->ignoreNamespaces and cfg->detailNamespaces, compiled once and shared by all threads.
+struct NamespacePatterns {
+  NamespacePatterns(const hdoc::types::Config* cfg) : ignore(cfg->ignoreNamespaces), detail(cfg->detailNamespaces) {}
+
+  hdoc::utils::MultiPatternMatcher ignore;
+  hdoc::utils::MultiPatternMatcher detail;
+};
+
+/// @brief Whether decls in a single TU are in an ignored or detail namespace.
+///
+/// A decl is in such a namespace if the name of any of its enclosing namespaces contains one of the patterns.
+/// The result is memoized for every namespace, so classifying a decl only takes finding its innermost namespace.
+class NamespaceClassifier {
+public:
+  NamespaceClassifier(const NamespacePatterns& patterns) : patterns(patterns) {}
+
+  /// @brief Is any namespace enclosing d in cfg->ignoreNamespaces?
+  bool isInIgnoredNamespace(const clang::Decl* d) { return this->getEnclosing(d).ignored; }
+
+  /// @brief Is any namespace enclosing d in cfg->detailNamespaces?
+  bool isInDetailNamespace(const clang::Decl* d) { return this->getEnclosing(d).detail; }
+
+private:
+  struct Flags {
+    bool ignored = false;
+    bool detail  = false;
+  };
+
+  /// Flags of the innermost namespace that encloses d, not counting d itself
+  Flags getEnclosing(const clang::Decl* d);
+
+  /// Flags of ns, including its own name
+  Flags get(const clang::NamespaceDecl* ns);
+
+  const NamespacePatterns&                           patterns;
+  llvm::DenseMap<const clang::NamespaceDecl*, Flags> namespaces;
+};
+} // namespace hdoc::indexer
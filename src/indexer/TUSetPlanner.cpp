@@ -0,0 +1,61 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "indexer/TUSetPlanner.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+std::vector<std::size_t>
+hdoc::indexer::planMinimalTUSet(const std::vector<std::vector<std::string>>&    dependencies,
+                                const std::function<bool(const std::string&)>& needsCoverage) {
+  // Number the files that need to be covered, so that the greedy loop only works with integers
+  std::unordered_map<std::string, std::size_t> fileIDs;
+  std::vector<std::vector<std::size_t>>        covers(dependencies.size());
+  for (std::size_t i = 0; i < dependencies.size(); i++) {
+    for (const auto& dep : dependencies[i]) {
+      if (!needsCoverage(dep)) {
+        continue;
+      }
+      const auto [it, inserted] = fileIDs.try_emplace(dep, fileIDs.size());
+      covers[i].emplace_back(it->second);
+    }
+    std::sort(covers[i].begin(), covers[i].end());
+    covers[i].erase(std::unique(covers[i].begin(), covers[i].end()), covers[i].end());
+  }
+
+  // Lazy greedy set cover: a source file's gain can only shrink as other files are chosen, so a popped entry whose
+  // recomputed gain is still at least the next best stale gain is the best choice.
+  std::vector<char>                                        covered(fileIDs.size(), false);
+  std::priority_queue<std::pair<std::size_t, std::size_t>> queue; ///< Pairs of (possibly stale) gain and index
+  for (std::size_t i = 0; i < covers.size(); i++) {
+    if (!covers[i].empty()) {
+      queue.emplace(covers[i].size(), i);
+    }
+  }
+
+  std::vector<std::size_t> chosen;
+  while (!queue.empty()) {
+    const std::size_t i = queue.top().second;
+    queue.pop();
+
+    const std::size_t gain = std::count_if(covers[i].begin(), covers[i].end(), [&](auto f) { return !covered[f]; });
+    if (gain == 0) {
+      continue;
+    }
+    if (!queue.empty() && gain < queue.top().first) {
+      queue.emplace(gain, i);
+      continue;
+    }
+
+    chosen.emplace_back(i);
+    for (const auto f : covers[i]) {
+      covered[f] = true;
+    }
+  }
+
+  std::sort(chosen.begin(), chosen.end());
+  return chosen;
+}
@@ -0,0 +1,19 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace hdoc::indexer {
+/// @brief Choose a small subset of source files that together include every file that needs to be indexed.
+///
+/// dependencies[i] holds the files included by the i-th source file, and needsCoverage decides which of them have
+/// to be included by at least one of the chosen source files. Finding the smallest such subset is the set cover
+/// problem, so this greedily picks the source file that covers the most uncovered files until all are covered.
+/// Returns the indices of the chosen source files, in ascending order.
+std::vector<std::size_t> planMinimalTUSet(const std::vector<std::vector<std::string>>&    dependencies,
+                                          const std::function<bool(const std::string&)>& needsCoverage);
+} // namespace hdoc::indexer
@@ -1,41 +1,50 @@
 // Copyright 2019-2023 hdoc
 // SPDX-License-Identifier: AGPL-3.0-only
 
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/Threading.h"
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_set>
 
 #include "frontend/Frontend.hpp"
 #include "indexer/Indexer.hpp"
+#include "serde/BinarySerializer.hpp"
+#include "serde/DocServer.hpp"
 #include "serde/HTMLWriter.hpp"
+#include "serde/Preview.hpp"
 #include "serde/SerdeUtils.hpp"
 #include "serde/Serialization.hpp"
+#include "support/FileWatcher.hpp"
 
-int main(int argc, char** argv) {
-  // Print stack trace on failure
-  llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-
-  hdoc::types::Config cfg;
-  cfg.binaryType = hdoc::types::BinaryType::Full;
-  hdoc::frontend::Frontend frontend(argc, argv, &cfg);
-
-  // Ensure that cfg was properly initialized
-  if (!cfg.initialized) {
-    return EXIT_FAILURE;
-  }
-
-  llvm::ThreadPool       pool(llvm::hardware_concurrency(cfg.numThreads));
-  hdoc::indexer::Indexer indexer(&cfg, pool);
-  indexer.run();
+/// Postprocess the index once all symbols are in it
+static const hdoc::types::Index* postprocess(hdoc::indexer::Indexer& indexer) {
   indexer.pruneMethods();
   indexer.pruneTypeRefs();
   indexer.resolveNamespaces();
   indexer.updateRecordNames();
   indexer.updateMemberFunctions();
   indexer.printStats();
-  const hdoc::types::Index* index = indexer.dump();
+  return indexer.dump();
+}
 
+/// Save the documentation. If changedSymbols is given, only the pages that show them are printed, along with the
+/// overview pages.
+static void printDocs(const hdoc::types::Index*                        index,
+                      const hdoc::types::Config&                       cfg,
+                      llvm::ThreadPool&                                pool,
+                      const std::unordered_set<hdoc::types::SymbolID>* changedSymbols = nullptr) {
   hdoc::serde::HTMLWriter htmlWriter(index, &cfg, pool);
+  if (changedSymbols != nullptr) {
+    htmlWriter.onlyPrintPagesOf(*changedSymbols);
+  }
   htmlWriter.printFunctions();
   htmlWriter.printAliases();
   htmlWriter.printRecords();
@@ -44,6 +53,125 @@ int main(int argc, char** argv) {
   htmlWriter.printSearchPage();
   htmlWriter.processMarkdownFiles();
   htmlWriter.printProjectIndex();
+}
+
+/// Update the documentation whenever a file that it's generated from changes, until hdoc is stopped.
+/// Only the files affected by a change are indexed again, and only the pages of symbols that changed are printed.
+static int watch(hdoc::indexer::Indexer& indexer, const hdoc::types::Config& cfg, llvm::ThreadPool& pool) {
+  const hdoc::types::Index* index = postprocess(indexer);
+  printDocs(index, cfg, pool);
+  auto fingerprints = hdoc::serde::fingerprintSymbols(*index);
+
+  hdoc::utils::FileWatcher watcher;
+  while (true) {
+    std::vector<std::string> files = indexer.getWatchedFiles();
+    for (const auto& path : cfg.mdPaths) {
+      files.emplace_back(std::filesystem::absolute(path).string());
+    }
+    if (!cfg.homepage.empty()) {
+      files.emplace_back(std::filesystem::absolute(cfg.homepage).string());
+    }
+    if (!watcher.watch(files)) {
+      return EXIT_FAILURE;
+    }
+    spdlog::info("Watching {} files for changes.", files.size());
+
+    const std::vector<std::string> changedFiles = watcher.waitForChanges();
+    if (changedFiles.empty()) {
+      return EXIT_FAILURE;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    indexer.update(changedFiles);
+    index = postprocess(indexer);
+
+    // Symbols are compared after postprocessing, since that's what their pages show
+    auto                                      newFingerprints = hdoc::serde::fingerprintSymbols(*index);
+    std::unordered_set<hdoc::types::SymbolID> changedSymbols;
+    for (const auto& [id, fingerprint] : newFingerprints) {
+      const auto it = fingerprints.find(id);
+      if (it == fingerprints.end() || it->second != fingerprint) {
+        changedSymbols.insert(id);
+      }
+    }
+    fingerprints = std::move(newFingerprints);
+    printDocs(index, cfg, pool, &changedSymbols);
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    spdlog::info("Updated the documentation of {} symbols after {} files changed in {:.2f} seconds.",
+                 changedSymbols.size(),
+                 changedFiles.size(),
+                 elapsed.count());
+  }
+}
+
+/// Print the pages of the symbols declared in cfg.previewPath to stdout, as a JSON object that maps the name of every
+/// page to its HTML
+static int preview(const hdoc::types::Config& cfg, llvm::ThreadPool& pool) {
+  std::optional<std::string> code;
+  if (cfg.previewFromStdin) {
+    auto buf = llvm::MemoryBuffer::getSTDIN();
+    if (!buf) {
+      spdlog::error("Unable to read the contents of {} from stdin.", cfg.previewPath.string());
+      return EXIT_FAILURE;
+    }
+    code = buf->get()->getBuffer().str();
+  }
+
+  const auto pages = hdoc::serde::previewFile(cfg.previewPath.string(), cfg.previewFlags, code, cfg, pool);
+  if (!pages) {
+    return EXIT_FAILURE;
+  }
+  llvm::json::OStream json(llvm::outs());
+  json.object([&] {
+    for (const auto& [name, html] : *pages) {
+      json.attribute(name, html);
+    }
+  });
+  llvm::outs() << "\n";
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  // Print stack trace on failure
+  llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
+
+  hdoc::types::Config cfg;
+  cfg.binaryType = hdoc::types::BinaryType::Full;
+  hdoc::frontend::Frontend frontend(argc, argv, &cfg);
+
+  // Ensure that cfg was properly initialized
+  if (!cfg.initialized) {
+    return EXIT_FAILURE;
+  }
+
+  llvm::ThreadPool       pool(llvm::hardware_concurrency(cfg.numThreads));
+  if (cfg.command == hdoc::types::Command::Preview) {
+    return preview(cfg, pool);
+  }
+  hdoc::indexer::Indexer indexer(&cfg, pool);
+  if (cfg.command == hdoc::types::Command::Merge) {
+    for (const auto& path : cfg.partialIndexPaths) {
+      if (!indexer.loadPartialIndex(path)) {
+        return EXIT_FAILURE;
+      }
+    }
+  } else if (!indexer.run()) {
+    return EXIT_FAILURE;
+  }
+
+  // Partial indexes are saved before postprocessing, which needs all symbols
+  if (cfg.command == hdoc::types::Command::Index) {
+    return indexer.savePartialIndex(cfg.partialIndexPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (cfg.command == hdoc::types::Command::Watch) {
+    return watch(indexer, cfg, pool);
+  }
+  const hdoc::types::Index* index = postprocess(indexer);
+  if (cfg.command == hdoc::types::Command::Serve) {
+    const hdoc::serde::HTMLWriter htmlWriter(index, &cfg, pool, /*renderOnly=*/true);
+    return hdoc::serde::serveDocs(htmlWriter, cfg) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  printDocs(index, cfg, pool);
 
   // Ensure that cfg was properly initialized
   if (cfg.debugDumpJSONPayload) {
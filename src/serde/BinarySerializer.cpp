@@ -0,0 +1,429 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "serde/BinarySerializer.hpp"
+#include "types/Symbols.hpp"
+
+#include "llvm/Support/xxhash.h"
+
+#include <cstring>
+
+/// Magic bytes and version at the start of every binary payload.
+/// Bump kBinaryFormatVersion whenever the layout of any of the types below changes.
+static constexpr char     kBinaryMagic[8]      = {'H', 'D', 'O', 'C', 'I', 'D', 'X', '\0'};
+static constexpr uint32_t kBinaryFormatVersion = 1;
+
+namespace {
+/// Appends values to a string. All integers are written in little-endian order.
+class BinaryWriter {
+public:
+  std::string data;
+
+  void u64(const uint64_t v) {
+    for (uint32_t i = 0; i < 8; i++) {
+      this->data.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+  }
+  void i64(const int64_t v) {
+    this->u64(static_cast<uint64_t>(v));
+  }
+  void b(const bool v) {
+    this->data.push_back(v ? 1 : 0);
+  }
+  void str(const std::string& s) {
+    this->u64(s.size());
+    this->data.append(s);
+  }
+  void id(const hdoc::types::SymbolID& id) {
+    this->u64(id.raw());
+  }
+  void ids(const std::vector<hdoc::types::SymbolID>& ids) {
+    this->u64(ids.size());
+    for (const auto& id : ids) {
+      this->id(id);
+    }
+  }
+};
+
+/// Reads values written by BinaryWriter. Once a read runs past the end of the data all subsequent
+/// reads return default values and ok is set to false, so callers only need to check it once at the end.
+class BinaryReader {
+public:
+  BinaryReader(const std::string_view data) : data(data) {}
+
+  bool ok = true;
+
+  uint64_t u64() {
+    if (!this->ensure(8)) {
+      return 0;
+    }
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+      v |= static_cast<uint64_t>(static_cast<uint8_t>(this->data[this->pos + i])) << (8 * i);
+    }
+    this->pos += 8;
+    return v;
+  }
+  int64_t i64() {
+    return static_cast<int64_t>(this->u64());
+  }
+  bool b() {
+    if (!this->ensure(1)) {
+      return false;
+    }
+    return this->data[this->pos++] != 0;
+  }
+  std::string str() {
+    const uint64_t size = this->u64();
+    if (!this->ensure(size)) {
+      return "";
+    }
+    std::string s(this->data.substr(this->pos, size));
+    this->pos += size;
+    return s;
+  }
+  hdoc::types::SymbolID id() {
+    return hdoc::types::SymbolID(this->u64());
+  }
+  std::vector<hdoc::types::SymbolID> ids() {
+    std::vector<hdoc::types::SymbolID> ids;
+    const uint64_t                     size = this->count(8);
+    ids.reserve(size);
+    for (uint64_t i = 0; i < size; i++) {
+      ids.emplace_back(this->id());
+    }
+    return ids;
+  }
+
+  /// Read an element count, sanity checking it against the remaining data so that a corrupt count
+  /// doesn't trigger a huge allocation. minElementSize is the smallest possible serialized size of an element.
+  uint64_t count(const uint64_t minElementSize) {
+    const uint64_t size = this->u64();
+    if (this->ok && size > (this->data.size() - this->pos) / minElementSize) {
+      this->ok = false;
+      return 0;
+    }
+    return size;
+  }
+
+  bool atEnd() const {
+    return this->pos == this->data.size();
+  }
+
+private:
+  bool ensure(const uint64_t size) {
+    if (!this->ok || this->data.size() - this->pos < size) {
+      this->ok = false;
+      return false;
+    }
+    return true;
+  }
+
+  std::string_view data;
+  uint64_t         pos = 0;
+};
+} // namespace
+
+static void write(BinaryWriter& w, const hdoc::types::Symbol& s) {
+  w.str(s.name);
+  w.str(s.briefComment);
+  w.str(s.docComment);
+  w.id(s.ID);
+  w.str(s.file);
+  w.u64(s.line);
+  w.id(s.parentNamespaceID);
+  w.b(s.isDetail);
+}
+
+static void read(BinaryReader& r, hdoc::types::Symbol& s) {
+  s.name              = r.str();
+  s.briefComment      = r.str();
+  s.docComment        = r.str();
+  s.ID                = r.id();
+  s.file              = r.str();
+  s.line              = r.u64();
+  s.parentNamespaceID = r.id();
+  s.isDetail          = r.b();
+}
+
+static void write(BinaryWriter& w, const hdoc::types::TypeRef& t) {
+  w.id(t.id);
+  w.str(t.name);
+}
+
+static void read(BinaryReader& r, hdoc::types::TypeRef& t) {
+  t.id   = r.id();
+  t.name = r.str();
+}
+
+static void write(BinaryWriter& w, const std::vector<hdoc::types::TemplateParam>& tparams) {
+  w.u64(tparams.size());
+  for (const auto& tparam : tparams) {
+    w.u64(static_cast<uint64_t>(tparam.templateType));
+    w.str(tparam.name);
+    w.str(tparam.type);
+    w.str(tparam.docComment);
+    w.str(tparam.defaultValue);
+    w.b(tparam.isParameterPack);
+    w.b(tparam.isTypename);
+  }
+}
+
+static void read(BinaryReader& r, std::vector<hdoc::types::TemplateParam>& tparams) {
+  const uint64_t size = r.count(8);
+  tparams.resize(size);
+  for (auto& tparam : tparams) {
+    tparam.templateType    = static_cast<hdoc::types::TemplateParam::TemplateType>(r.u64());
+    tparam.name            = r.str();
+    tparam.type            = r.str();
+    tparam.docComment      = r.str();
+    tparam.defaultValue    = r.str();
+    tparam.isParameterPack = r.b();
+    tparam.isTypename      = r.b();
+  }
+}
+
+static void write(BinaryWriter& w, const hdoc::types::FunctionSymbol& f) {
+  write(w, static_cast<const hdoc::types::Symbol&>(f));
+  w.b(f.isRecordMember);
+  w.b(f.isHiddenFriend);
+  w.b(f.isConstexpr);
+  w.b(f.isConsteval);
+  w.b(f.isExplicit);
+  w.b(f.isInline);
+  w.b(f.isNoDiscard);
+  w.b(f.isNoReturn);
+  w.b(f.isConst);
+  w.b(f.isVolatile);
+  w.b(f.isRestrict);
+  w.b(f.isVirtual);
+  w.b(f.isVariadic);
+  w.b(f.isNoExcept);
+  w.b(f.hasTrailingReturn);
+  w.b(f.isCtorOrDtor);
+  w.b(f.isConversionOp);
+  w.u64(f.nameStart);
+  w.u64(f.postTemplate);
+  w.u64(f.access);
+  w.u64(f.storageClass);
+  w.u64(f.refQualifier);
+  w.str(f.proto);
+  write(w, f.returnType);
+  w.str(f.returnTypeDocComment);
+  w.u64(f.params.size());
+  for (const auto& param : f.params) {
+    w.str(param.name);
+    write(w, param.type);
+    w.str(param.docComment);
+    w.str(param.defaultValue);
+  }
+  write(w, f.templateParams);
+}
+
+static void read(BinaryReader& r, hdoc::types::FunctionSymbol& f) {
+  read(r, static_cast<hdoc::types::Symbol&>(f));
+  f.isRecordMember    = r.b();
+  f.isHiddenFriend    = r.b();
+  f.isConstexpr       = r.b();
+  f.isConsteval       = r.b();
+  f.isExplicit        = r.b();
+  f.isInline          = r.b();
+  f.isNoDiscard       = r.b();
+  f.isNoReturn        = r.b();
+  f.isConst           = r.b();
+  f.isVolatile        = r.b();
+  f.isRestrict        = r.b();
+  f.isVirtual         = r.b();
+  f.isVariadic        = r.b();
+  f.isNoExcept        = r.b();
+  f.hasTrailingReturn = r.b();
+  f.isCtorOrDtor      = r.b();
+  f.isConversionOp    = r.b();
+  f.nameStart         = r.u64();
+  f.postTemplate      = r.u64();
+  f.access            = static_cast<clang::AccessSpecifier>(r.u64());
+  f.storageClass      = static_cast<clang::StorageClass>(r.u64());
+  f.refQualifier      = static_cast<clang::RefQualifierKind>(r.u64());
+  f.proto             = r.str();
+  read(r, f.returnType);
+  f.returnTypeDocComment = r.str();
+  f.params.resize(r.count(8));
+  for (auto& param : f.params) {
+    param.name = r.str();
+    read(r, param.type);
+    param.docComment   = r.str();
+    param.defaultValue = r.str();
+  }
+  read(r, f.templateParams);
+}
+
+static void write(BinaryWriter& w, const hdoc::types::RecordSymbol& c) {
+  write(w, static_cast<const hdoc::types::Symbol&>(c));
+  w.str(c.type);
+  w.str(c.proto);
+  w.u64(c.vars.size());
+  for (const auto& var : c.vars) {
+    w.b(var.isStatic);
+    w.str(var.name);
+    write(w, var.type);
+    w.str(var.defaultValue);
+    w.str(var.docComment);
+    w.u64(var.access);
+  }
+  w.ids(c.methodIDs);
+  w.u64(c.baseRecords.size());
+  for (const auto& base : c.baseRecords) {
+    w.id(base.id);
+    w.u64(base.access);
+    w.str(base.name);
+  }
+  write(w, c.templateParams);
+  w.ids(c.aliasIDs);
+  w.ids(c.hiddenFriendIDs);
+}
+
+static void read(BinaryReader& r, hdoc::types::RecordSymbol& c) {
+  read(r, static_cast<hdoc::types::Symbol&>(c));
+  c.type  = r.str();
+  c.proto = r.str();
+  c.vars.resize(r.count(8));
+  for (auto& var : c.vars) {
+    var.isStatic = r.b();
+    var.name     = r.str();
+    read(r, var.type);
+    var.defaultValue = r.str();
+    var.docComment   = r.str();
+    var.access       = static_cast<clang::AccessSpecifier>(r.u64());
+  }
+  c.methodIDs = r.ids();
+  c.baseRecords.resize(r.count(8));
+  for (auto& base : c.baseRecords) {
+    base.id     = r.id();
+    base.access = static_cast<clang::AccessSpecifier>(r.u64());
+    base.name   = r.str();
+  }
+  read(r, c.templateParams);
+  c.aliasIDs        = r.ids();
+  c.hiddenFriendIDs = r.ids();
+}
+
+static void write(BinaryWriter& w, const hdoc::types::EnumSymbol& e) {
+  write(w, static_cast<const hdoc::types::Symbol&>(e));
+  w.str(e.type);
+  w.u64(e.members.size());
+  for (const auto& member : e.members) {
+    w.i64(member.value);
+    w.str(member.name);
+    w.str(member.docComment);
+  }
+}
+
+static void read(BinaryReader& r, hdoc::types::EnumSymbol& e) {
+  read(r, static_cast<hdoc::types::Symbol&>(e));
+  e.type = r.str();
+  e.members.resize(r.count(8));
+  for (auto& member : e.members) {
+    member.value      = r.i64();
+    member.name       = r.str();
+    member.docComment = r.str();
+  }
+}
+
+static void write(BinaryWriter& w, const hdoc::types::NamespaceSymbol& n) {
+  write(w, static_cast<const hdoc::types::Symbol&>(n));
+  w.ids(n.records);
+  w.ids(n.namespaces);
+  w.ids(n.enums);
+  w.ids(n.usings);
+}
+
+static void read(BinaryReader& r, hdoc::types::NamespaceSymbol& n) {
+  read(r, static_cast<hdoc::types::Symbol&>(n));
+  n.records    = r.ids();
+  n.namespaces = r.ids();
+  n.enums      = r.ids();
+  n.usings     = r.ids();
+}
+
+static void write(BinaryWriter& w, const hdoc::types::AliasSymbol& a) {
+  write(w, static_cast<const hdoc::types::Symbol&>(a));
+  write(w, a.target);
+  w.b(a.isRecordMember);
+  w.u64(a.access);
+  write(w, a.templateParams);
+  w.str(a.proto);
+}
+
+static void read(BinaryReader& r, hdoc::types::AliasSymbol& a) {
+  read(r, static_cast<hdoc::types::Symbol&>(a));
+  read(r, a.target);
+  a.isRecordMember = r.b();
+  a.access         = static_cast<clang::AccessSpecifier>(r.u64());
+  read(r, a.templateParams);
+  a.proto = r.str();
+}
+
+template <typename T> static void writeDatabase(BinaryWriter& w, const hdoc::types::Database<T>& db) {
+  w.u64(db.numMatches);
+  w.u64(db.entries.size());
+  for (const auto& [k, v] : db.entries) {
+    write(w, v);
+  }
+}
+
+template <typename T> static void readDatabase(BinaryReader& r, hdoc::types::Database<T>& db) {
+  db.numMatches += r.u64();
+  const uint64_t size = r.count(8);
+  db.entries.reserve(db.entries.size() + size);
+  for (uint64_t i = 0; i < size && r.ok; i++) {
+    T symbol;
+    read(r, symbol);
+    db.entries.try_emplace(symbol.ID, std::move(symbol));
+  }
+}
+
+std::string hdoc::serde::serializeToBinary(const hdoc::types::Index& index) {
+  BinaryWriter w;
+  w.data.append(kBinaryMagic, sizeof(kBinaryMagic));
+  w.u64(kBinaryFormatVersion);
+  writeDatabase(w, index.functions);
+  writeDatabase(w, index.records);
+  writeDatabase(w, index.enums);
+  writeDatabase(w, index.namespaces);
+  writeDatabase(w, index.aliases);
+  return std::move(w.data);
+}
+
+bool hdoc::serde::deserializeFromBinary(const std::string_view data, hdoc::types::Index& index) {
+  if (data.size() < sizeof(kBinaryMagic) || std::memcmp(data.data(), kBinaryMagic, sizeof(kBinaryMagic)) != 0) {
+    return false;
+  }
+
+  BinaryReader r(data.substr(sizeof(kBinaryMagic)));
+  if (r.u64() != kBinaryFormatVersion) {
+    return false;
+  }
+  readDatabase(r, index.functions);
+  readDatabase(r, index.records);
+  readDatabase(r, index.enums);
+  readDatabase(r, index.namespaces);
+  readDatabase(r, index.aliases);
+  return r.ok && r.atEnd();
+}
+
+std::unordered_map<hdoc::types::SymbolID, uint64_t> hdoc::serde::fingerprintSymbols(const hdoc::types::Index& index) {
+  std::unordered_map<hdoc::types::SymbolID, uint64_t> fingerprints;
+  const auto fingerprintDatabase = [&](const auto& db) {
+    for (const auto& [k, v] : db.entries) {
+      BinaryWriter w;
+      write(w, v);
+      fingerprints.emplace(k, llvm::xxHash64(w.data));
+    }
+  };
+  fingerprintDatabase(index.functions);
+  fingerprintDatabase(index.records);
+  fingerprintDatabase(index.enums);
+  fingerprintDatabase(index.namespaces);
+  fingerprintDatabase(index.aliases);
+  return fingerprints;
+}
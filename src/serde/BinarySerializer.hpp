@@ -0,0 +1,26 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "types/Index.hpp"
+
+namespace hdoc::serde {
+/// @brief Serialize hdoc's index into a compact binary format.
+/// The format is only meant to be read back by the same version of hdoc (i.e. for the on-disk index cache),
+/// it is not a stable interchange format. Use serializeToJSON() for that.
+std::string serializeToBinary(const hdoc::types::Index& index);
+
+/// @brief Deserialize an index that was serialized with serializeToBinary() into `index`.
+/// Returns false if the data is truncated or was written by an incompatible version of hdoc.
+bool deserializeFromBinary(const std::string_view data, hdoc::types::Index& index);
+
+/// @brief Hash of the binary representation of every symbol in index, to find the symbols that differ between two
+/// versions of an index.
+std::unordered_map<hdoc::types::SymbolID, uint64_t> fingerprintSymbols(const hdoc::types::Index& index);
+} // namespace hdoc::serde
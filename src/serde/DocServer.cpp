@@ -0,0 +1,64 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "serde/DocServer.hpp"
+#include "serde/PageCache.hpp"
+#include "spdlog/spdlog.h"
+
+#include <httplib.h>
+#include <string>
+#include <string_view>
+
+/// MIME type of a page or bundled asset, based on its extension
+static const char* getContentType(const std::string_view name) {
+  if (name.ends_with(".html")) {
+    return "text/html; charset=utf-8";
+  } else if (name.ends_with(".css")) {
+    return "text/css";
+  } else if (name.ends_with(".js")) {
+    return "text/javascript";
+  } else if (name.ends_with(".json")) {
+    return "application/json";
+  } else if (name.ends_with(".png")) {
+    return "image/png";
+  } else if (name.ends_with(".ico")) {
+    return "image/x-icon";
+  }
+  return "application/octet-stream";
+}
+
+bool hdoc::serde::serveDocs(const HTMLWriter& htmlWriter, const hdoc::types::Config& cfg) {
+  PageCache       cache(cfg.serveCacheSize);
+  httplib::Server server;
+
+  // All pages are in the same directory, so anything with a slash in its name doesn't exist
+  server.Get(R"(/([^/]*))", [&](const httplib::Request& req, httplib::Response& res) {
+    const std::string name = req.matches[1].str().empty() ? "index.html" : req.matches[1].str();
+    auto              page = cache.get(name);
+    if (page == nullptr) {
+      auto content = htmlWriter.renderPage(name);
+      if (!content) {
+        res.status = 404;
+        res.set_content("Not found", "text/plain");
+        return;
+      }
+      page = cache.put(name, std::move(*content));
+    }
+
+    // Browsers revalidate pages on every request, so that they never show pages of an older index
+    res.set_header("ETag", page->etag);
+    res.set_header("Cache-Control", "no-cache");
+    if (req.get_header_value("If-None-Match").find(page->etag) != std::string::npos) {
+      res.status = 304;
+      return;
+    }
+    res.set_content(page->content, getContentType(name));
+  });
+
+  spdlog::info("Serving documentation at http://{}:{}", cfg.serveHost, cfg.servePort);
+  if (!server.listen(cfg.serveHost, static_cast<int>(cfg.servePort))) {
+    spdlog::error("Unable to serve documentation at {}:{}.", cfg.serveHost, cfg.servePort);
+    return false;
+  }
+  return true;
+}
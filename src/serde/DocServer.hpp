@@ -0,0 +1,15 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include "serde/HTMLWriter.hpp"
+#include "types/Config.hpp"
+
+namespace hdoc::serde {
+/// @brief Serve the documentation over HTTP at cfg.serveHost:cfg.servePort until hdoc is stopped.
+///
+/// Pages are rendered by htmlWriter when they are first requested and kept in an LRU cache of
+/// cfg.serveCacheSize bytes. Returns false if the server couldn't be started.
+bool serveDocs(const HTMLWriter& htmlWriter, const hdoc::types::Config& cfg);
+} // namespace hdoc::serde
@@ -8,6 +8,8 @@
 #include "clang/Format/Format.h"
 #include "llvm/Support/JSON.h"
 
+#include <algorithm>
+#include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <stack>
@@ -61,10 +63,44 @@ extern unsigned int ___assets_auto_render_min_js_len;
 extern unsigned int ___assets_highlight_min_js_len;
 extern unsigned int ___assets_index_min_js_len;
 
+/// A bundled asset, which is saved next to the HTML files
+struct BundledFile {
+  const std::string_view name;
+  const unsigned int     len;
+  const uint8_t*         file;
+};
+
+/// hdoc bundles assets (favicons, CSS) with the executable to simplify deployment.
+/// The files are converted to char arrays in the build process and collected here.
+/// The process looks janky but it's simple and it works.
+static std::vector<BundledFile> getBundledFiles() {
+  return {
+      {"apple-touch-icon.png", ___assets_apple_touch_icon_png_len, ___assets_apple_touch_icon_png},
+      {"favicon-16x16.png", ___assets_favicon_16x16_png_len, ___assets_favicon_16x16_png},
+      {"favicon-32x32.png", ___assets_favicon_32x32_png_len, ___assets_favicon_32x32_png},
+      {"favicon.ico", ___assets_favicon_ico_len, ___assets_favicon_ico},
+      {"styles.css", ___assets_styles_css_len, ___assets_styles_css},
+      {"search.js", ___assets_search_js_len, ___assets_search_js},
+      {"worker.js", ___assets_worker_js_len, ___assets_worker_js},
+      {"katex.min.css", ___assets_katex_min_css_len, ___assets_katex_min_css},
+      {"katex.min.js", ___assets_katex_min_js_len, ___assets_katex_min_js},
+      {"auto-render.min.js", ___assets_auto_render_min_js_len, ___assets_auto_render_min_js},
+      {"highlight.min.js", ___assets_highlight_min_js_len, ___assets_highlight_min_js},
+      {"index.min.js", ___assets_index_min_js_len, ___assets_index_min_js},
+  };
+}
+
 hdoc::serde::HTMLWriter::HTMLWriter(const hdoc::types::Index*  index,
                                     const hdoc::types::Config* cfg,
-                                    llvm::ThreadPool&          pool)
+                                    llvm::ThreadPool&          pool,
+                                    const bool                 renderOnly)
     : index(index), cfg(cfg), pool(pool) {
+  // Overview pages rendered on their own mustn't print the pages of all symbols in the background
+  if (renderOnly) {
+    this->pages.emplace();
+    return;
+  }
+
   // Create the directory where the HTML files will be placed
   std::error_code ec;
   if (std::filesystem::exists(this->cfg->outputDir) == false) {
@@ -76,32 +112,8 @@ hdoc::serde::HTMLWriter::HTMLWriter(const hdoc::types::Index*  index,
     }
   }
 
-  // hdoc bundles assets (favicons, CSS) with the executable to simplify deployment.
-  // The following code collects the files (converted to char arrays in the build process)
-  // and outputs them. The process looks janky but it's simple and it works.
-  struct BundledFile {
-    const unsigned int          len;
-    const uint8_t*              file;
-    const std::filesystem::path path;
-  };
-
-  std::vector<BundledFile> bundledFiles = {
-      {___assets_apple_touch_icon_png_len, ___assets_apple_touch_icon_png, cfg->outputDir / "apple-touch-icon.png"},
-      {___assets_favicon_16x16_png_len, ___assets_favicon_16x16_png, cfg->outputDir / "favicon-16x16.png"},
-      {___assets_favicon_32x32_png_len, ___assets_favicon_32x32_png, cfg->outputDir / "favicon-32x32.png"},
-      {___assets_favicon_ico_len, ___assets_favicon_ico, cfg->outputDir / "favicon.ico"},
-      {___assets_styles_css_len, ___assets_styles_css, cfg->outputDir / "styles.css"},
-      {___assets_search_js_len, ___assets_search_js, cfg->outputDir / "search.js"},
-      {___assets_worker_js_len, ___assets_worker_js, cfg->outputDir / "worker.js"},
-      {___assets_katex_min_css_len, ___assets_katex_min_css, cfg->outputDir / "katex.min.css"},
-      {___assets_katex_min_js_len, ___assets_katex_min_js, cfg->outputDir / "katex.min.js"},
-      {___assets_auto_render_min_js_len, ___assets_auto_render_min_js, cfg->outputDir / "auto-render.min.js"},
-      {___assets_highlight_min_js_len, ___assets_highlight_min_js, cfg->outputDir / "highlight.min.js"},
-      {___assets_index_min_js_len, ___assets_index_min_js, cfg->outputDir / "index.min.js"},
-  };
-
-  for (const auto& file : bundledFiles) {
-    std::ofstream out(file.path, std::ios::binary);
+  for (const auto& file : getBundledFiles()) {
+    std::ofstream out(this->cfg->outputDir / file.name, std::ios::binary);
     out.write((char*)file.file, file.len);
     out.close();
   }
@@ -117,6 +129,9 @@ std::string escapeForHTML(const std::string& in) {
   return str;
 }
 
+/// Where printNewPage() puts the page when renderPage() renders one on this thread, instead of saving it to a file
+static thread_local std::string* renderedPage = nullptr;
+
 /// Create a new HTML page with standard structure
 /// Optional sidebar, CSS styling, favicons, footer, etc.
 static void printNewPage(const hdoc::types::Config&   cfg,
@@ -224,7 +239,11 @@ static void printNewPage(const hdoc::types::Config&   cfg,
   CTML::Node p3 = CTML::Node("p.has-text-grey-light", "19AD43E11B2996");
   html.AppendNodeToBody(CTML::Node("footer.footer").AddChild(p1).AddChild(p2).AddChild(p3));
 
-  // Dump to a file
+  // Dump to a file, unless the page is rendered to be served
+  if (renderedPage != nullptr) {
+    *renderedPage = html.ToString();
+    return;
+  }
   std::ofstream(path) << html.ToString();
 }
 
@@ -529,6 +548,16 @@ static void printFunction(const hdoc::types::FunctionSymbol& f,
   main.AddChild(CTML::Node("hr.member-fun-separator"));
 }
 
+void hdoc::serde::HTMLWriter::printFunctionPage(const hdoc::types::FunctionSymbol& f) const {
+  CTML::Node main("main");
+  printFunction(f, main, this->cfg->gitRepoURL, this->cfg->gitDefaultBranch);
+  printNewPage(*this->cfg,
+               main,
+               this->cfg->outputDir / f.url(),
+               "function " + f.name + ": " + this->cfg->getPageTitleSuffix(),
+               getBreadcrumbNode("function", f, *this->index));
+}
+
 /// Print all of the functions that aren't record members in a project
 void hdoc::serde::HTMLWriter::printFunctions() const {
   CTML::Node main("main");
@@ -548,18 +577,10 @@ void hdoc::serde::HTMLWriter::printFunctions() const {
                     .AppendText(getSymbolBlurb(f));
     if (f.isDetail) li.ToggleClass("hdoc-detail");
     ul.AddChild(li);
-    CTML::Node page("main");
-    this->pool.async(
-        [&](const hdoc::types::FunctionSymbol& func, CTML::Node pg) {
-          printFunction(func, pg, this->cfg->gitRepoURL, this->cfg->gitDefaultBranch);
-          printNewPage(*this->cfg,
-                       pg,
-                       this->cfg->outputDir / func.url(),
-                       "function " + func.name + ": " + this->cfg->getPageTitleSuffix(),
-                       getBreadcrumbNode("function", func, *this->index));
-        },
-        f,
-        page);
+    if (!this->shouldPrintPage(id)) {
+      continue;
+    }
+    this->pool.async([&](const hdoc::types::FunctionSymbol& func) { this->printFunctionPage(func); }, f);
   }
   this->pool.wait();
   main.AddChild(CTML::Node("h2", "Overview"));
@@ -629,6 +650,16 @@ static void printAlias(const hdoc::types::AliasSymbol& a,
   }
 }
 
+void hdoc::serde::HTMLWriter::printAliasPage(const hdoc::types::AliasSymbol& a) const {
+  CTML::Node main("main");
+  printAlias(a, main, this->cfg->gitRepoURL, this->cfg->gitDefaultBranch);
+  printNewPage(*this->cfg,
+               main,
+               this->cfg->outputDir / a.url(),
+               "alias " + a.name + ": " + this->cfg->getPageTitleSuffix(),
+               getBreadcrumbNode("alias", a, *this->index));
+}
+
 /// Print all of the aliases that aren't record members in a project
 void hdoc::serde::HTMLWriter::printAliases() const {
   CTML::Node main("main");
@@ -648,18 +679,10 @@ void hdoc::serde::HTMLWriter::printAliases() const {
                     .AppendText(getSymbolBlurb(u));
     if (u.isDetail) li.ToggleClass("hdoc-detail");
     ul.AddChild(li);
-    CTML::Node page("main");
-    this->pool.async(
-        [&](const hdoc::types::AliasSymbol& alias, CTML::Node pg) {
-          printAlias(alias, pg, this->cfg->gitRepoURL, this->cfg->gitDefaultBranch);
-          printNewPage(*this->cfg,
-                       pg,
-                       this->cfg->outputDir / alias.url(),
-                       "alias " + alias.name + ": " + this->cfg->getPageTitleSuffix(),
-                       getBreadcrumbNode("alias", alias, *this->index));
-        },
-        u,
-        page);
+    if (!this->shouldPrintPage(id)) {
+      continue;
+    }
+    this->pool.async([&](const hdoc::types::AliasSymbol& alias) { this->printAliasPage(alias); }, u);
   }
   this->pool.wait();
   main.AddChild(CTML::Node("h2", "Overview"));
@@ -980,7 +1003,9 @@ void hdoc::serde::HTMLWriter::printRecords() const {
                     .AppendText(getSymbolBlurb(c));
     if (c.isDetail) li.ToggleClass("hdoc-detail");
     ul.AddChild(li);
-    this->pool.async([&](const hdoc::types::RecordSymbol& cls) { printRecord(cls); }, c);
+    if (this->shouldPrintPage(id)) {
+      this->pool.async([&](const hdoc::types::RecordSymbol& cls) { printRecord(cls); }, c);
+    }
   }
   this->pool.wait();
   main.AddChild(CTML::Node("h2", "Overview"));
@@ -1124,7 +1149,9 @@ void hdoc::serde::HTMLWriter::printEnums() const {
                     .AppendText(getSymbolBlurb(e));
     if (e.isDetail) li.ToggleClass("hdoc-detail");
     ul.AddChild(li);
-    this->pool.async([&](const hdoc::types::EnumSymbol& en) { printEnum(en); }, e);
+    if (this->shouldPrintPage(id)) {
+      this->pool.async([&](const hdoc::types::EnumSymbol& en) { printEnum(en); }, e);
+    }
   }
   this->pool.wait();
   main.AddChild(CTML::Node("h2", "Overview"));
@@ -1137,6 +1164,14 @@ void hdoc::serde::HTMLWriter::printEnums() const {
 }
 
 void hdoc::serde::HTMLWriter::printSearchPage() const {
+  this->printSearchHTML();
+
+  std::error_code      ec;
+  llvm::raw_fd_ostream jsonPath((cfg->outputDir / "index.json").string(), ec);
+  this->printSearchIndex(jsonPath);
+}
+
+void hdoc::serde::HTMLWriter::printSearchHTML() const {
   CTML::Node main("main");
 
   main.AddChild(CTML::Node("h1", "Search"));
@@ -1156,10 +1191,10 @@ We have left the Javascript code unminified so that you are able to inspect it y
   main.AddChild(CTML::Node("script").SetAttr("src", "index.min.js"));
   main.AddChild(CTML::Node("script").SetAttr("src", "search.js"));
   printNewPage(*this->cfg, main, this->cfg->outputDir / "search.html", "Search: " + this->cfg->getPageTitleSuffix());
+}
 
-  std::error_code      ec;
-  llvm::raw_fd_ostream jsonPath((cfg->outputDir / "index.json").string(), ec);
-  llvm::json::OStream  json(jsonPath);
+void hdoc::serde::HTMLWriter::printSearchIndex(llvm::raw_ostream& out) const {
+  llvm::json::OStream json(out);
 
   json.array([&] {
     for (const auto& s : this->index->functions.entries)
@@ -1238,10 +1273,147 @@ void hdoc::serde::HTMLWriter::printProjectIndex() const {
 void hdoc::serde::HTMLWriter::processMarkdownFiles() const {
   for (const auto& f : this->cfg->mdPaths) {
     spdlog::info("Processing markdown file {}", f.string());
-    hdoc::utils::MarkdownConverter converter(f);
-    CTML::Node                     main      = converter.getHTMLNode();
-    std::string                    filename  = "doc" + f.filename().replace_extension("html").string();
-    std::string                    pageTitle = f.filename().stem().string();
-    printNewPage(*this->cfg, main, this->cfg->outputDir / filename, pageTitle);
+    this->printMarkdownFile(f);
+  }
+}
+
+/// Name of the page that a Markdown file is converted to
+static std::string getMarkdownPageName(const std::filesystem::path& f) {
+  return "doc" + f.filename().replace_extension("html").string();
+}
+
+void hdoc::serde::HTMLWriter::printMarkdownFile(const std::filesystem::path& f) const {
+  hdoc::utils::MarkdownConverter converter(f);
+  CTML::Node                     main      = converter.getHTMLNode();
+  std::string                    pageTitle = f.filename().stem().string();
+  printNewPage(*this->cfg, main, this->cfg->outputDir / getMarkdownPageName(f), pageTitle);
+}
+
+std::optional<std::string> hdoc::serde::HTMLWriter::renderPage(const std::string& name) const {
+  for (const auto& file : getBundledFiles()) {
+    if (file.name == name) {
+      return std::string(reinterpret_cast<const char*>(file.file), file.len);
+    }
+  }
+  if (name == "index.json") {
+    std::string              json;
+    llvm::raw_string_ostream out(json);
+    this->printSearchIndex(out);
+    out.flush();
+    return json;
+  }
+
+  std::string page;
+  renderedPage = &page;
+  const bool found = this->printPageNamed(name);
+  renderedPage     = nullptr;
+  if (!found) {
+    return std::nullopt;
+  }
+  return page;
+}
+
+std::map<std::string, std::string> hdoc::serde::HTMLWriter::renderPagesOfFile(const std::string& file) const {
+  std::map<std::string, std::string> pages;
+  const auto                         renderAll = [&](const auto& db) {
+    for (const auto& [id, s] : db.entries) {
+      if (s.file != file) {
+        continue;
+      }
+      if (auto page = this->renderPage(s.url())) {
+        pages.emplace(s.url(), std::move(*page));
+      }
+    }
+  };
+  renderAll(this->index->records);
+  renderAll(this->index->functions);
+  renderAll(this->index->enums);
+  renderAll(this->index->aliases);
+  return pages;
+}
+
+bool hdoc::serde::HTMLWriter::printPageNamed(const std::string& name) const {
+  if (name == "index.html") {
+    this->printProjectIndex();
+  } else if (name == "functions.html") {
+    this->printFunctions();
+  } else if (name == "aliases.html") {
+    this->printAliases();
+  } else if (name == "records.html") {
+    this->printRecords();
+  } else if (name == "namespaces.html") {
+    this->printNamespaces();
+  } else if (name == "enums.html") {
+    this->printEnums();
+  } else if (name == "search.html") {
+    this->printSearchHTML();
+  } else if (const auto it = std::find_if(this->cfg->mdPaths.begin(),
+                                          this->cfg->mdPaths.end(),
+                                          [&](const auto& f) { return getMarkdownPageName(f) == name; });
+             it != this->cfg->mdPaths.end()) {
+    this->printMarkdownFile(*it);
+  } else {
+    return this->printSymbolPageNamed(name);
+  }
+  return true;
+}
+
+bool hdoc::serde::HTMLWriter::printSymbolPageNamed(const std::string& name) const {
+  // Symbol pages are named by a letter for the kind of symbol, followed by its ID in hex
+  const std::string_view suffix = ".html";
+  uint64_t               hash   = 0;
+  const char*            idEnd  = name.data() + 1 + 16;
+  if (name.size() != 1 + 16 + suffix.size() || !name.ends_with(suffix) ||
+      std::from_chars(name.data() + 1, idEnd, hash, 16).ptr != idEnd) {
+    return false;
+  }
+  const hdoc::types::SymbolID id(hash);
+
+  // Only the symbols that are listed in the overview pages have pages of their own
+  if (name[0] == 'r' && this->index->records.contains(id)) {
+    this->printRecord(this->index->records.entries.at(id));
+  } else if (name[0] == 'e' && this->index->enums.contains(id)) {
+    this->printEnum(this->index->enums.entries.at(id));
+  } else if (name[0] == 'f' && this->index->functions.contains(id)) {
+    const auto& f = this->index->functions.entries.at(id);
+    if (f.isRecordMember || f.isHiddenFriend) {
+      return false;
+    }
+    this->printFunctionPage(f);
+  } else if (name[0] == 'a' && this->index->aliases.contains(id)) {
+    const auto& a = this->index->aliases.entries.at(id);
+    if (a.isRecordMember) {
+      return false;
+    }
+    this->printAliasPage(a);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void hdoc::serde::HTMLWriter::onlyPrintPagesOf(const std::unordered_set<hdoc::types::SymbolID>& changedSymbols) {
+  std::unordered_set<hdoc::types::SymbolID> pages = changedSymbols;
+  const auto anyChanged = [&](const std::vector<hdoc::types::SymbolID>& ids) {
+    return std::any_of(ids.begin(), ids.end(), [&](const hdoc::types::SymbolID& id) { return pages.count(id) > 0; });
+  };
+
+  // Record pages show their members, and everything their base records show
+  for (const auto& [id, c] : this->index->records.entries) {
+    if (anyChanged(c.methodIDs) || anyChanged(c.hiddenFriendIDs) || anyChanged(c.aliasIDs)) {
+      pages.insert(id);
+    }
+  }
+  for (bool added = true; added;) {
+    added = false;
+    for (const auto& [id, c] : this->index->records.entries) {
+      const bool baseChanged = std::any_of(c.baseRecords.begin(), c.baseRecords.end(), [&](const auto& base) {
+        return pages.count(base.id) > 0;
+      });
+      if (baseChanged && pages.insert(id).second) {
+        added = true;
+      }
+    }
   }
+  this->pages = std::move(pages);
 }
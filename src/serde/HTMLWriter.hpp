@@ -4,6 +4,13 @@
 #pragma once
 
 #include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_set>
 
 #include "types/Config.hpp"
 #include "types/Index.hpp"
@@ -14,7 +21,11 @@ namespace serde {
 /// @brief Serialize hdoc's index to HTML files
 class HTMLWriter {
 public:
-  HTMLWriter(const hdoc::types::Index* index, const hdoc::types::Config* cfg, llvm::ThreadPool& pool);
+  /// @brief If renderOnly is set, nothing is saved to cfg->outputDir and pages are only rendered by renderPage()
+  HTMLWriter(const hdoc::types::Index*  index,
+             const hdoc::types::Config* cfg,
+             llvm::ThreadPool&          pool,
+             const bool                 renderOnly = false);
   void printFunctions() const;
   void printAliases() const;
   void printRecords() const;
@@ -32,10 +43,38 @@ public:
   /// @brief Convert Markdown files to HTML and save them to the filesystem
   void processMarkdownFiles() const;
 
+  /// @brief Only print the pages that show one of changedSymbols from now on, and the overview pages.
+  /// The pages of all other symbols must be up to date already.
+  void onlyPrintPagesOf(const std::unordered_set<hdoc::types::SymbolID>& changedSymbols);
+
+  /// @brief Render the page or bundled asset that would be saved as cfg->outputDir / name, without saving anything.
+  /// Returns std::nullopt if there is no such file. Only the requested page is rendered, so any thread may call it.
+  std::optional<std::string> renderPage(const std::string& name) const;
+
+  /// @brief Render the pages of all symbols declared in file, a path relative to cfg->rootDir, keyed by page name.
+  /// Symbols without a page of their own, like methods, are shown on the pages of their parents.
+  std::map<std::string, std::string> renderPagesOfFile(const std::string& file) const;
+
 private:
-  const hdoc::types::Index*  index;
-  const hdoc::types::Config* cfg;
-  llvm::ThreadPool&          pool;
+  void printFunctionPage(const hdoc::types::FunctionSymbol& f) const;
+  void printAliasPage(const hdoc::types::AliasSymbol& a) const;
+  void printSearchHTML() const;
+  void printSearchIndex(llvm::raw_ostream& out) const;
+  void printMarkdownFile(const std::filesystem::path& f) const;
+
+  /// Print the page saved as cfg->outputDir / name. Returns false if there is no such page.
+  bool printPageNamed(const std::string& name) const;
+  bool printSymbolPageNamed(const std::string& name) const;
+
+  /// Should the page of the symbol with the given ID be printed?
+  bool shouldPrintPage(const hdoc::types::SymbolID& id) const {
+    return !this->pages || this->pages->count(id) > 0;
+  }
+
+  const hdoc::types::Index*                                index;
+  const hdoc::types::Config*                               cfg;
+  llvm::ThreadPool&                                        pool;
+  std::optional<std::unordered_set<hdoc::types::SymbolID>> pages; ///< Symbols whose pages are printed (all if unset)
 };
 std::string getHyperlinkedFunctionProto(const std::string_view proto, const hdoc::types::FunctionSymbol& f);
 std::string clangFormat(const std::string_view s, const uint64_t& columnLimit = 50);
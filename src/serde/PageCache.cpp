@@ -0,0 +1,48 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "serde/PageCache.hpp"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/xxhash.h"
+
+std::shared_ptr<const hdoc::serde::PageCache::Page> hdoc::serde::PageCache::get(const std::string& name) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  const auto                  it = this->lookup.find(name);
+  if (it == this->lookup.end()) {
+    return nullptr;
+  }
+  this->pages.splice(this->pages.begin(), this->pages, it->second);
+  return it->second->second;
+}
+
+std::shared_ptr<const hdoc::serde::PageCache::Page> hdoc::serde::PageCache::put(const std::string& name,
+                                                                                std::string        content) {
+  auto page     = std::make_shared<Page>();
+  page->etag    = "\"" + llvm::utohexstr(llvm::xxHash64(content)) + "\"";
+  page->content = std::move(content);
+  if (page->content.size() > this->capacity) {
+    return page;
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  // Another request may have rendered the same page in the meantime
+  if (const auto it = this->lookup.find(name); it != this->lookup.end()) {
+    this->numBytes -= it->second->second->content.size();
+    this->pages.erase(it->second);
+    this->lookup.erase(it);
+  }
+  while (!this->pages.empty() && this->numBytes + page->content.size() > this->capacity) {
+    this->numBytes -= this->pages.back().second->content.size();
+    this->lookup.erase(this->pages.back().first);
+    this->pages.pop_back();
+  }
+  this->pages.emplace_front(name, page);
+  this->lookup[name] = this->pages.begin();
+  this->numBytes += page->content.size();
+  return page;
+}
+
+uint64_t hdoc::serde::PageCache::size() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->numBytes;
+}
@@ -0,0 +1,46 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace hdoc::serde {
+/// @brief Thread-safe LRU cache of rendered pages and their ETags, which holds pages of up to a given total size.
+///
+/// Pages are shared with the requests that serve them, so evicting a page never invalidates it for a request.
+class PageCache {
+public:
+  struct Page {
+    std::string content; ///< Rendered page
+    std::string etag;    ///< Quoted hash of content, which is valid for as long as the index doesn't change
+  };
+
+  PageCache(const uint64_t capacity) : capacity(capacity) {}
+
+  /// @brief The page with the given name, or nullptr if it isn't cached. The page becomes the most recently used one.
+  std::shared_ptr<const Page> get(const std::string& name);
+
+  /// @brief Cache content as the page with the given name, evicting the least recently used pages that don't fit
+  /// anymore, and return it. Pages larger than the capacity are returned without being cached.
+  std::shared_ptr<const Page> put(const std::string& name, std::string content);
+
+  /// @brief Total size of the cached pages in bytes
+  uint64_t size() const;
+
+private:
+  using Entry = std::pair<std::string, std::shared_ptr<const Page>>;
+
+  std::list<Entry>                                            pages; ///< Most recently used pages first
+  std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+  uint64_t                                                    capacity;
+  uint64_t                                                    numBytes = 0; ///< Total size of the cached pages
+  mutable std::mutex                                          mutex;
+};
+} // namespace hdoc::serde
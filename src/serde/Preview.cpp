@@ -0,0 +1,33 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "serde/Preview.hpp"
+#include "indexer/Indexer.hpp"
+#include "serde/HTMLWriter.hpp"
+
+#include <filesystem>
+
+std::optional<std::map<std::string, std::string>> hdoc::serde::previewFile(const std::string&                path,
+                                                                           const std::vector<std::string>&   args,
+                                                                           const std::optional<std::string>& code,
+                                                                           const hdoc::types::Config&        cfg,
+                                                                           llvm::ThreadPool&                 pool) {
+  // A preview only needs the declarations of a single file, and should be ready as soon as possible
+  hdoc::types::Config previewCfg = cfg;
+  previewCfg.skipFunctionBodies  = true;
+  previewCfg.headerOnlyMode      = hdoc::types::HeaderOnlyMode::Disabled;
+
+  hdoc::indexer::Indexer indexer(&previewCfg, pool);
+  if (!indexer.runOverFile(path, args, code)) {
+    return std::nullopt;
+  }
+  indexer.pruneMethods();
+  indexer.pruneTypeRefs();
+  indexer.resolveNamespaces();
+  indexer.updateRecordNames();
+  indexer.updateMemberFunctions();
+
+  // Symbols are matched by the path of their file relative to the root directory, like the indexer records it
+  const hdoc::serde::HTMLWriter htmlWriter(indexer.dump(), &previewCfg, pool, /*renderOnly=*/true);
+  return htmlWriter.renderPagesOfFile(std::filesystem::relative(std::filesystem::absolute(path), cfg.rootDir).string());
+}
@@ -0,0 +1,28 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include "llvm/Support/ThreadPool.h"
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "types/Config.hpp"
+
+namespace hdoc::serde {
+/// @brief Index only the file at path and render the pages of the symbols declared in it, keyed by page name.
+///
+/// This lets editors show what the documentation of a file will look like while it's edited, without running the
+/// whole pipeline. code replaces the contents of the file and args its compile command, if given, as in
+/// Indexer::runOverFile(). Function bodies are skipped and header-only mode is disabled whatever cfg says.
+/// Links to the pages of symbols from other files aren't rendered.
+/// Returns std::nullopt if the file couldn't be indexed.
+std::optional<std::map<std::string, std::string>> previewFile(const std::string&                path,
+                                                              const std::vector<std::string>&   args,
+                                                              const std::optional<std::string>& code,
+                                                              const hdoc::types::Config&        cfg,
+                                                              llvm::ThreadPool&                 pool);
+} // namespace hdoc::serde
@@ -0,0 +1,136 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/ArgumentProfile.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <string_view>
+
+/// Does arg match pattern, which is an argument or a prefix of arguments followed by '*'?
+static bool matchesPattern(const std::string_view arg, const std::string_view pattern) {
+  if (!pattern.empty() && pattern.back() == '*') {
+    return arg.starts_with(pattern.substr(0, pattern.size() - 1));
+  }
+  return arg == pattern;
+}
+
+static bool matchesAnyPattern(const std::string_view arg, const std::vector<std::string>& patterns) {
+  return std::any_of(
+      patterns.begin(), patterns.end(), [&](const std::string& pattern) { return matchesPattern(arg, pattern); });
+}
+
+/// Is arg removed by the built-in rules, not counting arguments with a separate value?
+static bool isStrippedByBuiltinRules(const std::string_view arg) {
+  // Optimization levels, but not -ObjC or -ObjC++
+  if (arg.starts_with("-O")) {
+    const std::string_view level = arg.substr(2);
+    return level == "s" || level == "z" || level == "g" || level == "fast" ||
+           std::all_of(level.begin(), level.end(), [](const char c) { return std::isdigit(c) != 0; });
+  }
+
+  // Debug information, but not -gcc-toolchain
+  if (arg.starts_with("-g")) {
+    return !arg.starts_with("-gcc-toolchain");
+  }
+
+  // Warnings, but not the arguments that -Wl, -Wa, and -Wp pass on to the linker, assembler, and preprocessor
+  if (arg.starts_with("-W")) {
+    return !arg.starts_with("-Wl,") && !arg.starts_with("-Wa,") && !arg.starts_with("-Wp,");
+  }
+  if (arg == "-w" || arg == "-pedantic" || arg == "-pedantic-errors") {
+    return true;
+  }
+
+  // Instrumentation and compiler plugins
+  static constexpr std::array<std::string_view, 11> prefixes = {
+      "-fsanitize",
+      "-fno-sanitize",
+      "-fprofile-",
+      "-fno-profile-",
+      "-fcoverage-",
+      "--coverage",
+      "-flto",
+      "-fno-lto",
+      "-fplugin=",
+      "-fplugin-arg-",
+      "-fpass-plugin=",
+  };
+  return std::any_of(
+      prefixes.begin(), prefixes.end(), [&](const std::string_view prefix) { return arg.starts_with(prefix); });
+}
+
+/// Is option, passed on to clang's frontend with -Xclang, one that loads a PCH or a plugin? They all take a value,
+/// which is passed with another -Xclang.
+static bool isFrontendPCHOrPlugin(const std::string_view option) {
+  return option == "-include-pch" || option == "-load" || option == "-plugin" || option == "-add-plugin" ||
+         option.starts_with("-plugin-arg-");
+}
+
+/// Is path a PCH built by clang or GCC?
+static bool isPCH(const std::string_view path) { return path.ends_with(".pch") || path.ends_with(".gch"); }
+
+bool hdoc::indexer::ArgumentProfile::isStripped(const std::string& arg) const {
+  if (matchesAnyPattern(arg, this->keep)) {
+    return false;
+  }
+  return matchesAnyPattern(arg, this->strip) || (this->useBuiltinRules && isStrippedByBuiltinRules(arg));
+}
+
+std::vector<std::string> hdoc::indexer::ArgumentProfile::apply(const std::vector<std::string>& args) const {
+  if (args.empty()) {
+    return args;
+  }
+
+  std::vector<std::string> result = {args[0]};
+  for (std::size_t i = 1; i < args.size(); i++) {
+    const std::string& arg  = args[i];
+    const std::string  next = i + 1 < args.size() ? args[i + 1] : "";
+
+    // Arguments passed on to other tools are kept as they are, apart from the PCHs and plugins of clang's frontend
+    if (arg == "-Xclang" && !next.empty()) {
+      if (this->useBuiltinRules && isFrontendPCHOrPlugin(next) && !matchesAnyPattern(next, this->keep)) {
+        i += i + 3 < args.size() && args[i + 2] == "-Xclang" ? 3 : 1;
+        continue;
+      }
+      result.insert(result.end(), {arg, next});
+      i++;
+      continue;
+    }
+    if ((arg == "-Xlinker" || arg == "-Xassembler" || arg == "-Xpreprocessor" || arg == "-mllvm") && !next.empty()) {
+      result.insert(result.end(), {arg, next});
+      i++;
+      continue;
+    }
+
+    if (this->useBuiltinRules && (arg == "-include-pch" || (arg == "-include" && isPCH(next))) &&
+        !matchesAnyPattern(arg, this->keep)) {
+      i++;
+      continue;
+    }
+    if (!this->isStripped(arg)) {
+      result.emplace_back(arg);
+    }
+  }
+  return result;
+}
+
+clang::tooling::ArgumentsAdjuster hdoc::indexer::ArgumentProfile::getAdjuster() const {
+  return [this](const clang::tooling::CommandLineArguments& args, llvm::StringRef) {
+    clang::tooling::CommandLineArguments adjusted = this->apply(args);
+    this->numCommands++;
+    this->numRemoved += args.size() - adjusted.size();
+    return adjusted;
+  };
+}
+
+void hdoc::indexer::ArgumentProfile::printStats() const {
+  if (this->numCommands == 0) {
+    return;
+  }
+  spdlog::info("Removed {} compiler arguments that hdoc doesn't need from {} compile commands.",
+               this->numRemoved.load(),
+               this->numCommands.load());
+}
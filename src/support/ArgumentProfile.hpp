@@ -0,0 +1,55 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "clang/Tooling/ArgumentsAdjusters.h"
+
+namespace hdoc::indexer {
+/// @brief Removes compiler arguments from compile commands that only cost parse time, since hdoc needs nothing but
+/// declarations and comments.
+///
+/// The built-in rules remove:
+///  - optimization levels: `-O<level>`
+///  - debug information: `-g<...>`
+///  - instrumentation: `-fsanitize*`, `-fno-sanitize*`, `-fprofile-*`, `-fno-profile-*`, `-fcoverage-*`,
+///    `--coverage`, `-flto*`, `-fno-lto`
+///  - warnings: `-W<warning>`, `-w`, `-pedantic`, `-pedantic-errors`, but not `-Wl,`, `-Wa,`, or `-Wp,`, which pass
+///    arguments on to other tools
+///  - prebuilt PCHs of the build tree: `-include-pch <file>`, `-include <file>` of a `.pch` or `.gch` file, and
+///    `-Xclang -include-pch -Xclang <file>`, since they're built by another compiler or may be stale
+///  - compiler plugins: `-fplugin=*`, `-fplugin-arg-*`, `-fpass-plugin=*`, and `-Xclang -load`, `-Xclang -plugin`,
+///    `-Xclang -add-plugin`, and `-Xclang -plugin-arg-*` along with their values
+///
+/// Patterns are either an argument or a prefix of arguments followed by `*`. Arguments that match a keep pattern are
+/// never removed, and arguments that match a strip pattern are removed even without the built-in rules.
+class ArgumentProfile {
+public:
+  ArgumentProfile(const bool useBuiltinRules, std::vector<std::string> keep, std::vector<std::string> strip)
+      : useBuiltinRules(useBuiltinRules), keep(std::move(keep)), strip(std::move(strip)) {}
+
+  /// @brief args without the arguments that this profile removes. The first argument is the compiler.
+  std::vector<std::string> apply(const std::vector<std::string>& args) const;
+
+  /// @brief Adjuster that applies this profile and counts the removed arguments for printStats()
+  clang::tooling::ArgumentsAdjuster getAdjuster() const;
+
+  /// @brief Print how many arguments the adjuster removed from how many compile commands
+  void printStats() const;
+
+private:
+  /// Is arg removed, not counting arguments with a separate value?
+  bool isStripped(const std::string& arg) const;
+
+  const bool                     useBuiltinRules;
+  const std::vector<std::string> keep;
+  const std::vector<std::string> strip;
+  mutable std::atomic<uint64_t>  numCommands = 0; ///< Compile commands that the adjuster was applied to
+  mutable std::atomic<uint64_t>  numRemoved  = 0; ///< Arguments that the adjuster removed from them
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,159 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/CachingFileSystem.hpp"
+#include "spdlog/spdlog.h"
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+/// A file whose contents are kept by a SharedFileSystemCache, which outlives it
+class CachedFile : public llvm::vfs::File {
+public:
+  CachedFile(const llvm::MemoryBufferRef contents, const llvm::vfs::Status& status)
+      : contents(contents), stat(status) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override { return this->stat; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getBuffer(const llvm::Twine&, int64_t, bool requiresNullTerminator, bool) override {
+    return llvm::MemoryBuffer::getMemBuffer(this->contents, requiresNullTerminator);
+  }
+
+  std::error_code close() override { return std::error_code(); }
+
+private:
+  llvm::MemoryBufferRef contents;
+  llvm::vfs::Status     stat;
+};
+} // namespace
+
+/// The status of a file as if it had been requested by the given path
+static llvm::ErrorOr<llvm::vfs::Status> withName(const llvm::ErrorOr<llvm::vfs::Status>& status,
+                                                 const llvm::Twine&                       path) {
+  if (!status) {
+    return status.getError();
+  }
+  return llvm::vfs::Status::copyWithNewName(*status, path);
+}
+
+hdoc::indexer::SharedFileSystemCache::Shard&
+hdoc::indexer::SharedFileSystemCache::getShard(const std::string& absPath) {
+  return this->shards[llvm::hash_value(absPath) % this->shards.size()];
+}
+
+llvm::ErrorOr<llvm::vfs::Status> hdoc::indexer::SharedFileSystemCache::status(const llvm::Twine&     path,
+                                                                               const std::string&     absPath,
+                                                                               llvm::vfs::FileSystem& fs) {
+  this->numStats++;
+  Shard& shard = this->getShard(absPath);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (const auto it = shard.entries.find(absPath); it != shard.entries.end() && it->second.status) {
+      this->numCachedStats++;
+      return withName(*it->second.status, path);
+    }
+  }
+
+  // Another thread may stat the same file in the meantime, which gives the same result
+  const llvm::ErrorOr<llvm::vfs::Status> status = fs.status(path);
+  std::lock_guard<std::mutex>            lock(shard.mutex);
+  shard.entries[absPath].status = status;
+  return status;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> hdoc::indexer::SharedFileSystemCache::openFileForRead(
+    const llvm::Twine& path, const std::string& absPath, llvm::vfs::FileSystem& fs) {
+  this->numOpens++;
+  Shard&   shard    = this->getShard(absPath);
+  uint32_t numReads = 0;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry&                      entry = shard.entries[absPath];
+    if (entry.contents) {
+      this->numCachedOpens++;
+      return std::make_unique<CachedFile>(entry.contents->getMemBufferRef(), *withName(*entry.status, path));
+    }
+    numReads = ++entry.numReads;
+  }
+
+  // Only missing files stay missing for the rest of the run. Other errors, like running out of file descriptors,
+  // may be gone by the next time the file is opened.
+  auto file = fs.openFileForRead(path);
+  if (!file) {
+    if (file.getError() == std::errc::no_such_file_or_directory) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.entries[absPath].status = file.getError();
+    }
+    return file;
+  }
+  if (numReads < 2) {
+    return file;
+  }
+
+  // The file is read for the second time, so it's probably a header that more TUs will include
+  const auto status = (*file)->status();
+  auto       buffer = (*file)->getBuffer(absPath, -1, /*RequiresNullTerminator=*/true, /*IsVolatile=*/false);
+  if (!status || !buffer) {
+    return fs.openFileForRead(path);
+  }
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Entry&                      entry = shard.entries[absPath];
+  if (!entry.contents) {
+    entry.status   = *status;
+    entry.contents = std::move(*buffer);
+  }
+  return std::make_unique<CachedFile>(entry.contents->getMemBufferRef(), *withName(*entry.status, path));
+}
+
+void hdoc::indexer::SharedFileSystemCache::invalidate(const std::string& absPath) {
+  Shard&                      shard = this->getShard(absPath);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.entries.erase(absPath);
+}
+
+void hdoc::indexer::SharedFileSystemCache::printStats() const {
+  if (this->numStats == 0 && this->numOpens == 0) {
+    return;
+  }
+  spdlog::info("File system cache served {} of {} stat calls and {} of {} file reads from memory.",
+               this->numCachedStats.load(),
+               this->numStats.load(),
+               this->numCachedOpens.load(),
+               this->numOpens.load());
+}
+
+std::string hdoc::indexer::CachingFileSystem::getCacheKey(const llvm::Twine& path) {
+  llvm::SmallString<256> absPath;
+  path.toVector(absPath);
+  if (this->makeAbsolute(absPath)) {
+    return "";
+  }
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/false);
+  return absPath.str().str();
+}
+
+llvm::ErrorOr<llvm::vfs::Status> hdoc::indexer::CachingFileSystem::status(const llvm::Twine& path) {
+  const std::string key = this->getCacheKey(path);
+  if (key.empty()) {
+    return ProxyFileSystem::status(path);
+  }
+  if (this->recordedPaths != nullptr) {
+    this->recordedPaths->insert(key);
+  }
+  return this->cache.status(path, key, this->getUnderlyingFS());
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+hdoc::indexer::CachingFileSystem::openFileForRead(const llvm::Twine& path) {
+  const std::string key = this->getCacheKey(path);
+  if (key.empty()) {
+    return ProxyFileSystem::openFileForRead(path);
+  }
+  if (this->recordedPaths != nullptr) {
+    this->recordedPaths->insert(key);
+  }
+  return this->cache.openFileForRead(path, key, this->getUnderlyingFS());
+}
@@ -0,0 +1,92 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+
+namespace hdoc::indexer {
+/// @brief Results of stat calls and contents of files, shared by the file systems of all TUs indexed in a single run.
+///
+/// Files are assumed not to change during a run, so every path is only stat-ed once per run, and headers are only read
+/// from disk once no matter how many TUs include them. Missing files are cached too, since header search looks for
+/// every header in many directories that don't have it. This is similar in spirit to the file system of
+/// clang-scan-deps. Contents are only kept once a file is read a second time, so that source files, which are
+/// usually only read once, don't take up memory. Files that change between runs over the same cache have to be
+/// invalidated.
+class SharedFileSystemCache {
+public:
+  /// Status of the file at absPath, stat-ed through fs if this is the first time it's needed.
+  /// Its name is path, like the status that fs returns.
+  llvm::ErrorOr<llvm::vfs::Status>
+  status(const llvm::Twine& path, const std::string& absPath, llvm::vfs::FileSystem& fs);
+
+  /// Open the file at absPath for reading, from memory if its contents were kept and through fs otherwise
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine& path, const std::string& absPath, llvm::vfs::FileSystem& fs);
+
+  /// Forget the status and contents of the file at absPath, so that they're read from disk again the next time
+  /// they're needed. Must not be called while TUs that may have read the file are parsed.
+  void invalidate(const std::string& absPath);
+
+  /// Print how many stat calls and reads were served from memory
+  void printStats() const;
+
+private:
+  struct Entry {
+    std::optional<llvm::ErrorOr<llvm::vfs::Status>> status;       ///< Set once the file was stat-ed or opened
+    std::unique_ptr<llvm::MemoryBuffer>             contents;     ///< Set once the file was read twice
+    uint32_t                                        numReads = 0; ///< Number of times the file was opened from disk
+  };
+
+  /// Entries are split by the hash of their path, so that threads rarely wait for each other
+  struct Shard {
+    llvm::StringMap<Entry> entries;
+    std::mutex             mutex;
+  };
+
+  Shard& getShard(const std::string& absPath);
+
+  std::array<Shard, 64> shards;
+  std::atomic<uint64_t> numStats       = 0; ///< Calls to status()
+  std::atomic<uint64_t> numCachedStats = 0; ///< Calls to status() served from memory
+  std::atomic<uint64_t> numOpens       = 0; ///< Calls to openFileForRead()
+  std::atomic<uint64_t> numCachedOpens = 0; ///< Calls to openFileForRead() served from memory
+};
+
+/// @brief File system of a single TU that stats and reads files through a SharedFileSystemCache.
+///
+/// Relative paths are resolved against the working directory of the wrapped file system, which belongs to the TU
+/// alone, so TUs can still change their working directories concurrently. Paths are only made absolute for the
+/// cache, fs still sees them as they were given.
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+  CachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, SharedFileSystemCache& cache)
+      : ProxyFileSystem(std::move(fs)), cache(cache) {}
+
+  llvm::ErrorOr<llvm::vfs::Status>                status(const llvm::Twine& path) override;
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(const llvm::Twine& path) override;
+
+  /// Add the absolute path of every file that is stat-ed or opened from now on to paths, or stop if it's nullptr
+  void recordPathsInto(std::unordered_set<std::string>* paths) { this->recordedPaths = paths; }
+
+private:
+  /// Absolute path of path without "." components, or an empty string if it can't be made absolute.
+  /// ".." components are kept since they mean something else after a symlink.
+  std::string getCacheKey(const llvm::Twine& path);
+
+  SharedFileSystemCache&           cache;
+  std::unordered_set<std::string>* recordedPaths = nullptr; ///< Where looked up paths are recorded, if anywhere
+};
+} // namespace hdoc::indexer
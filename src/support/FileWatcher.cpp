@@ -0,0 +1,105 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/FileWatcher.hpp"
+#include "spdlog/spdlog.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/// Events that mean a file in a watched directory has new contents or is gone
+static constexpr uint32_t kWatchedEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+hdoc::utils::FileWatcher::FileWatcher() {
+  this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (this->fd < 0) {
+    spdlog::error("Unable to watch files for changes: {}", std::strerror(errno));
+  }
+}
+
+hdoc::utils::FileWatcher::~FileWatcher() {
+  if (this->fd >= 0) {
+    close(this->fd);
+  }
+}
+
+bool hdoc::utils::FileWatcher::watch(const std::vector<std::string>& paths) {
+  if (this->fd < 0) {
+    return false;
+  }
+
+  this->files.clear();
+  std::unordered_set<std::string> dirs;
+  for (const auto& path : paths) {
+    const std::filesystem::path normalPath = std::filesystem::path(path).lexically_normal();
+    this->files.insert(normalPath.string());
+    dirs.insert(normalPath.parent_path().string());
+  }
+
+  // Directories that no file needs anymore stop being watched, the others are only added once
+  for (auto it = this->directories.begin(); it != this->directories.end();) {
+    if (dirs.erase(it->second) == 0) {
+      inotify_rm_watch(this->fd, it->first);
+      it = this->directories.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (const auto& dir : dirs) {
+    const int wd = inotify_add_watch(this->fd, dir.c_str(), kWatchedEvents | IN_ONLYDIR);
+    if (wd < 0) {
+      spdlog::error("Unable to watch {} for changes: {}", dir, std::strerror(errno));
+      return false;
+    }
+    this->directories[wd] = dir;
+  }
+  return true;
+}
+
+bool hdoc::utils::FileWatcher::readEvents(std::unordered_set<std::string>& changed) {
+  alignas(inotify_event) char buf[16 * 1024];
+  while (true) {
+    const ssize_t len = read(this->fd, buf, sizeof(buf));
+    if (len < 0) {
+      return errno == EAGAIN || errno == EINTR;
+    }
+    for (ssize_t pos = 0; pos < len;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(buf + pos);
+      pos += sizeof(inotify_event) + event->len;
+
+      const auto it = this->directories.find(event->wd);
+      if (it == this->directories.end() || event->len == 0) {
+        continue;
+      }
+      std::string path = (std::filesystem::path(it->second) / event->name).string();
+      if (this->files.count(path) > 0) {
+        changed.insert(std::move(path));
+      }
+    }
+  }
+}
+
+std::vector<std::string> hdoc::utils::FileWatcher::waitForChanges(const std::chrono::milliseconds settleTime) {
+  std::unordered_set<std::string> changed;
+  pollfd                          pfd = {this->fd, POLLIN, 0};
+  while (this->fd >= 0) {
+    // Block until something changes, then only wait for settleTime for more changes
+    const int rc = poll(&pfd, 1, changed.empty() ? -1 : static_cast<int>(settleTime.count()));
+    if (rc < 0 && errno != EINTR) {
+      spdlog::error("Unable to wait for changes to files: {}", std::strerror(errno));
+      break;
+    }
+    if (rc == 0) {
+      break;
+    }
+    if (rc > 0 && !this->readEvents(changed)) {
+      spdlog::error("Unable to read changes to files: {}", std::strerror(errno));
+      break;
+    }
+  }
+  return std::vector<std::string>(changed.begin(), changed.end());
+}
@@ -0,0 +1,41 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace hdoc::utils {
+/// @brief Waits for changes to a set of files with inotify.
+///
+/// The directories of the files are watched instead of the files themselves, since many editors save a file by
+/// writing a new one and renaming it over the old one, which would end a watch on the file.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(const FileWatcher&)            = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  /// @brief Watch the files at the given absolute paths, instead of those watched before.
+  /// Returns false if they can't be watched.
+  bool watch(const std::vector<std::string>& paths);
+
+  /// @brief Block until some of the watched files change and return their normalized paths. Changes that follow within
+  /// settleTime are returned along with them, since saving a file can take several steps.
+  /// Returns an empty vector if waiting failed.
+  std::vector<std::string> waitForChanges(const std::chrono::milliseconds settleTime = std::chrono::milliseconds(100));
+
+private:
+  /// Read the pending events and add the watched files they concern to changed. Returns false on errors.
+  bool readEvents(std::unordered_set<std::string>& changed);
+
+  int                                  fd = -1;
+  std::unordered_map<int, std::string> directories; ///< Watched directories by their watch descriptors
+  std::unordered_set<std::string>      files;       ///< Watched files
+};
+} // namespace hdoc::utils
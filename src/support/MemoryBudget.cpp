@@ -0,0 +1,88 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/MemoryBudget.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+/// How often a file that waits for the RSS to go down checks it again
+static constexpr std::chrono::milliseconds kRSSPollInterval(100);
+
+uint64_t hdoc::indexer::getResidentSetSize() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t      size = 0, resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+std::unordered_map<std::string, uint64_t> hdoc::indexer::MemoryBudget::estimate(
+    const std::vector<std::string>& files, const TUDurations* durations, const uint64_t fallback) {
+  // Like durations, peak memory roughly grows with the size of a file
+  std::vector<uint64_t> sizes(files.size(), 0);
+  double                totalMemory = 0;
+  double                totalSize   = 0;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    std::error_code ec;
+    sizes[i] = std::filesystem::file_size(files[i], ec);
+    if (ec) {
+      sizes[i] = 0;
+    }
+    if (const auto peak = durations ? durations->getPeakMemory(files[i]) : std::nullopt) {
+      totalMemory += *peak;
+      totalSize += sizes[i];
+    }
+  }
+
+  std::unordered_map<std::string, uint64_t> estimates;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    if (const auto peak = durations ? durations->getPeakMemory(files[i]) : std::nullopt) {
+      estimates[files[i]] = *peak;
+    } else if (totalMemory > 0 && totalSize > 0 && sizes[i] > 0) {
+      estimates[files[i]] = static_cast<uint64_t>(sizes[i] * (totalMemory / totalSize));
+    } else {
+      estimates[files[i]] = fallback;
+    }
+  }
+  return estimates;
+}
+
+void hdoc::indexer::MemoryBudget::acquire(const uint64_t bytes) {
+  // A file that needs more than the whole budget runs on its own
+  const uint64_t               needed = std::min(bytes, this->budget);
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (this->numRunning > 0) {
+    if (this->reserved + needed <= this->budget) {
+      const uint64_t rss = getResidentSetSize();
+      if (rss + needed <= this->budget) {
+        break;
+      }
+      if (!this->warnedAboutRSS) {
+        this->warnedAboutRSS = true;
+        spdlog::warn("hdoc uses {} MB of its memory budget of {} MB, so files wait for memory to be freed before "
+                     "they're parsed. Estimates of the memory that files need may be too low.",
+                     rss / (1024 * 1024),
+                     this->budget / (1024 * 1024));
+      }
+    }
+    // The RSS can go down without a file being released, so it isn't only checked when one is
+    this->released.wait_for(lock, kRSSPollInterval);
+  }
+  this->reserved += needed;
+  this->numRunning++;
+}
+
+void hdoc::indexer::MemoryBudget::release(const uint64_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->reserved -= std::min(bytes, this->budget);
+    this->numRunning--;
+  }
+  this->released.notify_all();
+}
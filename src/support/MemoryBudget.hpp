@@ -0,0 +1,54 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "support/TUScheduler.hpp"
+
+namespace hdoc::indexer {
+/// @brief Resident set size of the calling process in bytes, or 0 if it's unknown
+uint64_t getResidentSetSize();
+
+/// @brief Admits files to be parsed at the same time as long as the memory they're expected to need fits into
+/// a budget for the whole process.
+///
+/// A file that doesn't fit waits until others are done, so that files which need a lot of memory run with less
+/// concurrency while small ones fill the remaining threads. Estimates can be wrong, so a file also waits until the
+/// RSS of the process leaves room for it, which is checked again periodically since memory can be returned to the
+/// system without any file finishing. A warning is logged the first time a file waits for the RSS. A file is always
+/// admitted if no other is running.
+///
+/// The recorded peak memory of a file is the size of clang's data structures for it, not the RSS it caused, and is
+/// only available if durations are kept, which needs the index cache.
+class MemoryBudget {
+public:
+  MemoryBudget(const uint64_t budget) : budget(budget) {}
+
+  /// @brief Estimate the peak memory of every file. Files are estimated from their size if they have no recorded
+  /// peak memory, scaled by the files that have one, and fallback is used if no file has one, like in every run
+  /// without an index cache.
+  static std::unordered_map<std::string, uint64_t>
+  estimate(const std::vector<std::string>& files, const TUDurations* durations, const uint64_t fallback);
+
+  /// @brief Block until a file that needs the given number of bytes may start parsing
+  void acquire(const uint64_t bytes);
+
+  /// @brief Return the bytes of a file that finished parsing
+  void release(const uint64_t bytes);
+
+private:
+  const uint64_t          budget;
+  uint64_t                reserved       = 0;     ///< Sum of the estimates of the files that are being parsed
+  std::size_t             numRunning     = 0;
+  bool                    warnedAboutRSS = false; ///< Set once a file waited for the RSS to leave room for it
+  std::mutex              mutex;
+  std::condition_variable released;
+};
+} // namespace hdoc::indexer
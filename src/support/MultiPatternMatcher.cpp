@@ -0,0 +1,70 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/MultiPatternMatcher.hpp"
+
+#include <deque>
+
+/// Marks transitions that aren't part of the trie of patterns yet
+static constexpr uint32_t kNone = UINT32_MAX;
+
+hdoc::utils::MultiPatternMatcher::MultiPatternMatcher(const std::vector<std::string>& patterns)
+    : numPatterns(patterns.size()) {
+  // Build a trie of all patterns
+  this->states.emplace_back();
+  this->states[0].next.fill(kNone);
+  for (const auto& pattern : patterns) {
+    uint32_t state = 0;
+    for (const unsigned char c : pattern) {
+      if (this->states[state].next[c] == kNone) {
+        this->states[state].next[c] = static_cast<uint32_t>(this->states.size());
+        this->states.emplace_back();
+        this->states.back().next.fill(kNone);
+      }
+      state = this->states[state].next[c];
+    }
+    this->states[state].match = true;
+  }
+
+  // Turn the trie into a DFA by filling in the missing transitions with those of the longest proper suffix that is
+  // also in the trie, in breadth-first order so that the suffix's transitions are complete already
+  std::deque<std::pair<uint32_t, uint32_t>> queue; // A state and the state of its longest proper suffix
+  for (auto& next : this->states[0].next) {
+    if (next == kNone) {
+      next = 0;
+    } else {
+      queue.emplace_back(next, 0);
+    }
+  }
+  while (!queue.empty()) {
+    const auto [state, suffix] = queue.front();
+    queue.pop_front();
+    this->states[state].match |= this->states[suffix].match;
+    for (std::size_t c = 0; c < 256; c++) {
+      uint32_t& next = this->states[state].next[c];
+      if (next == kNone) {
+        next = this->states[suffix].next[c];
+      } else {
+        queue.emplace_back(next, this->states[suffix].next[c]);
+      }
+    }
+  }
+}
+
+bool hdoc::utils::MultiPatternMatcher::matches(const std::string_view text) const {
+  if (this->numPatterns == 0) {
+    return false;
+  }
+
+  uint32_t state = 0;
+  if (this->states[state].match) {
+    return true;
+  }
+  for (const unsigned char c : text) {
+    state = this->states[state].next[c];
+    if (this->states[state].match) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,37 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hdoc::utils {
+/// @brief Checks whether a string contains any of a set of patterns, in a single pass over the string.
+///
+/// The patterns are compiled into an Aho-Corasick automaton, so the cost of a check only depends on the length
+/// of the string and not on the number of patterns.
+class MultiPatternMatcher {
+public:
+  MultiPatternMatcher(const std::vector<std::string>& patterns);
+
+  /// @brief Does text contain any of the patterns as a substring?
+  bool matches(const std::string_view text) const;
+
+  /// @brief Is the set of patterns empty?
+  bool empty() const { return this->numPatterns == 0; }
+
+private:
+  /// A state of the automaton, with a transition for every byte
+  struct State {
+    std::array<uint32_t, 256> next  = {};
+    bool                      match = false; ///< Does a pattern end here, or in a suffix of this state?
+  };
+
+  std::vector<State> states;          ///< The root is the first state
+  std::size_t        numPatterns = 0;
+};
+} // namespace hdoc::utils
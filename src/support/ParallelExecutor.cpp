@@ -2,61 +2,842 @@
 // SPDX-License-Identifier: AGPL-3.0-only
 
 #include "support/ParallelExecutor.hpp"
+#include "support/MemoryBudget.hpp"
+#include "support/TUScheduler.hpp"
 #include "spdlog/spdlog.h"
 
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/VirtualFileSystem.h"
 
-void hdoc::indexer::ParallelExecutor::execute(std::unique_ptr<clang::tooling::FrontendActionFactory> action) {
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <poll.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+/// A file is retried once in a fresh worker if its worker dies, and skipped after that
+static constexpr uint32_t kMaxAttempts = 2;
+
+/// Workers get this many seconds past the timeout to abandon a file on their own before they're killed, since
+/// parsing can only be stopped between top-level declarations
+static constexpr double kTimeoutGraceSeconds = 5;
+
+namespace {
+/// Stops parsing at the next top-level declaration once the deadline has passed. Since the parser then never
+/// finishes the TU, the other consumers of the action don't see it either.
+class DeadlineConsumer : public clang::ASTConsumer {
+public:
+  DeadlineConsumer(const std::chrono::steady_clock::time_point deadline, bool& timedOut)
+      : deadline(deadline), timedOut(timedOut) {}
+
+  bool HandleTopLevelDecl(clang::DeclGroupRef) override {
+    if (std::chrono::steady_clock::now() > this->deadline) {
+      this->timedOut = true;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  const std::chrono::steady_clock::time_point deadline;
+  bool&                                       timedOut;
+};
+
+/// The compile commands [begin, end) of each file of another compilation database
+class CommandRangeDatabase : public clang::tooling::CompilationDatabase {
+public:
+  CommandRangeDatabase(const clang::tooling::CompilationDatabase& cmpdb, const std::size_t begin, const std::size_t end)
+      : cmpdb(cmpdb), begin(begin), end(end) {}
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef path) const override {
+    std::vector<clang::tooling::CompileCommand> commands = this->cmpdb.getCompileCommands(path);
+    commands.resize(std::min(commands.size(), this->end));
+    commands.erase(commands.begin(), commands.begin() + std::min(commands.size(), this->begin));
+    return commands;
+  }
+
+private:
+  const clang::tooling::CompilationDatabase& cmpdb;
+  const std::size_t                          begin;
+  const std::size_t                          end;
+};
+
+/// What InstrumentedActions measure and enforce for all compile commands of a file
+struct Instrumentation {
+  uint64_t*                                            peakMemory = nullptr; ///< Measured if not nullptr
+  std::optional<std::chrono::steady_clock::time_point> deadline;             ///< Enforced if set
+  bool                                                 timedOut = false;
+};
+
+/// Runs another action, records how much memory clang's data structures took once it's done, which is when
+/// they're largest, and abandons the file once its deadline passes
+class InstrumentedAction : public clang::WrapperFrontendAction {
+public:
+  InstrumentedAction(std::unique_ptr<clang::FrontendAction> action, Instrumentation& instrumentation)
+      : clang::WrapperFrontendAction(std::move(action)), instrumentation(instrumentation) {}
+
+protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance& CI, llvm::StringRef file) override {
+    auto consumer = clang::WrapperFrontendAction::CreateASTConsumer(CI, file);
+    if (consumer == nullptr || !this->instrumentation.deadline) {
+      return consumer;
+    }
+    std::vector<std::unique_ptr<clang::ASTConsumer>> consumers;
+    consumers.emplace_back(std::move(consumer));
+    consumers.emplace_back(
+        std::make_unique<DeadlineConsumer>(*this->instrumentation.deadline, this->instrumentation.timedOut));
+    return std::make_unique<clang::MultiplexConsumer>(std::move(consumers));
+  }
+
+  void EndSourceFileAction() override {
+    if (this->instrumentation.peakMemory != nullptr) {
+      clang::CompilerInstance& CI     = this->getCompilerInstance();
+      uint64_t                 memory = 0;
+      if (CI.hasASTContext()) {
+        memory += CI.getASTContext().getASTAllocatedMemory() + CI.getASTContext().getSideTableAllocatedMemory();
+      }
+      if (CI.hasPreprocessor()) {
+        memory += CI.getPreprocessor().getTotalMemory();
+      }
+      if (CI.hasSourceManager()) {
+        const clang::SourceManager& SM = CI.getSourceManager();
+        memory += SM.getContentCacheSize() + SM.getDataStructureSizes() + SM.getMemoryBufferSizes().malloc_bytes;
+      }
+      *this->instrumentation.peakMemory = std::max(*this->instrumentation.peakMemory, memory);
+    }
+    clang::WrapperFrontendAction::EndSourceFileAction();
+  }
+
+private:
+  Instrumentation& instrumentation;
+};
+
+/// Wraps the actions of another factory in InstrumentedActions
+class InstrumentedActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+  InstrumentedActionFactory(clang::tooling::FrontendActionFactory& factory, Instrumentation& instrumentation)
+      : factory(factory), instrumentation(instrumentation) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    return std::make_unique<InstrumentedAction>(this->factory.create(), this->instrumentation);
+  }
+
+private:
+  clang::tooling::FrontendActionFactory& factory;
+  Instrumentation&                       instrumentation;
+};
+} // namespace
+
+/// Everything clang needs to parse a file that doesn't depend on the file itself. It's kept alive across all files
+/// that a single thread or worker process parses, so that each file only pays for its own parse.
+struct hdoc::indexer::ParallelExecutor::FrontendState {
+  /// Has the working directory of this thread alone, and stats and reads files through the shared cache
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs;
+
+  /// Files and directories that earlier files looked up, by the working directory they were looked up from
+  std::map<std::string, llvm::IntrusiveRefCntPtr<clang::FileManager>> fileManagers;
+
+  /// Absolute paths of the files that each of fileManagers looked up, if lookups are recorded
+  std::map<std::string, std::unordered_set<std::string>> lookups;
+
+  /// Record the paths that fs looks up for the FileManager of the given working directory, or for none if it's empty
+  void recordLookupsFor(const std::string& directory) {
+    static_cast<hdoc::indexer::CachingFileSystem&>(*this->fs).recordPathsInto(
+        directory.empty() ? nullptr : &this->lookups[directory]);
+  }
+
+  // Ignore all diagnostics that clang might throw. Clang often has weird diagnostic settings that don't
+  // match what's in compile_commands.json, resulting in spurious errors. Instead of trying to change clang's
+  // behavior, we'll ignore all diagnostics and assume that the user supplied a project that builds on their
+  // machine.
+  clang::IgnoringDiagConsumer diagnostics;
+
+  /// FileManager for the file at path, which remembers what earlier files looked up. The same relative path means
+  /// different files in different working directories, so files whose commands don't agree on one get a new one.
+  /// If record is true, the paths that the FileManager looks up are recorded in lookups.
+  llvm::IntrusiveRefCntPtr<clang::FileManager> getFileManager(const clang::tooling::CompilationDatabase& cmpdb,
+                                                              const std::string&                         path,
+                                                              const bool                                 record) {
+    const std::vector<clang::tooling::CompileCommand> commands = cmpdb.getCompileCommands(path);
+    if (commands.empty() || std::any_of(commands.begin(), commands.end(), [&](const auto& cmd) {
+          return cmd.Directory != commands.front().Directory;
+        })) {
+      // The tool creates a FileManager of its own, which is gone once the file is parsed
+      this->recordLookupsFor("");
+      return nullptr;
+    }
+    auto& fileManager = this->fileManagers[commands.front().Directory];
+    if (fileManager == nullptr) {
+      fileManager = new clang::FileManager(clang::FileSystemOptions(), this->fs);
+    }
+    this->recordLookupsFor(record ? commands.front().Directory : "");
+    return fileManager;
+  }
+};
+
+hdoc::indexer::ParallelExecutor::ParallelExecutor(const clang::tooling::CompilationDatabase&     cmpdb,
+                                                  const std::vector<std::string>&                includePaths,
+                                                  llvm::ThreadPool&                              pool,
+                                                  std::shared_ptr<clang::PCHContainerOperations> pchOps,
+                                                  const SharedPCH*                               pch,
+                                                  const hdoc::types::SchedulingPolicy            policy,
+                                                  TUDurations*                                   durations)
+    : cmpdb(cmpdb), includePaths(includePaths), pool(pool), pchOps(pchOps), pch(pch), policy(policy),
+      durations(durations) {}
+
+// FrontendState is only complete here
+hdoc::indexer::ParallelExecutor::~ParallelExecutor() = default;
+
+void hdoc::indexer::ParallelExecutor::invalidate(const std::vector<std::string>& paths) {
+  std::unordered_set<std::string> keys;
+  for (const auto& path : paths) {
+    // Paths are normalized like the keys of the shared cache
+    llvm::SmallString<256> key(path);
+    llvm::sys::path::remove_dots(key, /*remove_dot_dot=*/false);
+    keys.emplace(key.str().str());
+    this->fileSystemCache.invalidate(key.str().str());
+  }
+
+  for (const auto& frontend : this->frontends) {
+    for (auto it = frontend->fileManagers.begin(); it != frontend->fileManagers.end();) {
+      const auto& lookups = frontend->lookups[it->first];
+      if (this->recordingLookups &&
+          std::none_of(keys.begin(), keys.end(), [&](const std::string& key) { return lookups.count(key) > 0; })) {
+        ++it;
+        continue;
+      }
+      frontend->lookups.erase(it->first);
+      it = frontend->fileManagers.erase(it);
+    }
+  }
+}
+
+std::unique_ptr<hdoc::indexer::ParallelExecutor::FrontendState>
+hdoc::indexer::ParallelExecutor::createFrontendState() {
+  auto frontend = std::make_unique<FrontendState>();
+  frontend->fs  = new hdoc::indexer::CachingFileSystem(llvm::vfs::createPhysicalFileSystem().release(),
+                                                      this->fileSystemCache);
+  return frontend;
+}
+
+void hdoc::indexer::ParallelExecutor::execute(const std::vector<std::string>& files,
+                                              const TUActionFactoryCreator&   createFactory) {
+  if (this->numProcesses > 0) {
+    this->executeInProcesses(files, createFactory);
+    return;
+  }
+
+  // Every thread of the pool runs a worker that asks the scheduler for files until there are none left
+  const std::size_t numWorkers = std::min<std::size_t>(this->pool.getThreadCount(), files.size());
+  TUScheduler       scheduler(files, this->policy, this->durations, numWorkers);
+
+  // Files without an estimate get an equal share of the budget, which admits as many of them as without one
+  std::unordered_map<std::string, uint64_t> estimates;
+  if (this->memoryBudget > 0 && numWorkers > 0) {
+    estimates = MemoryBudget::estimate(files, this->durations, this->memoryBudget / numWorkers);
+  }
+  this->runWorkers(scheduler, numWorkers, estimates, createFactory);
+}
+
+void hdoc::indexer::ParallelExecutor::executeWhileLoading(const FileLoader&             load,
+                                                          const TUActionFactoryCreator& createFactory) {
+  // A file is in the scheduler at most once. Commands that are found while it's there are parsed along with the earlier
+  // ones, and those found after a worker took it put it back in, for the commands that no worker took yet.
+  std::mutex                                   mutex;
+  std::unordered_set<std::string>              queued;   ///< Files in the scheduler that no worker took yet
+  std::unordered_map<std::string, std::size_t> numTaken; ///< Number of commands of each file that workers took
+
+  const std::size_t numWorkers = this->pool.getThreadCount();
+  TUScheduler       scheduler(numWorkers);
+  std::thread       loader([&]() {
+    load([&](const std::string& path) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (queued.insert(path).second) {
+        scheduler.add(path);
+      }
+    });
+    scheduler.close();
+  });
+
+  // Commands are added to the database before the loader is told about them, so counting them while holding the lock
+  // takes every command that the loader didn't put the file back in for
+  const auto claim = [&](const std::string& path) -> std::optional<CommandRange> {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.erase(path);
+    const std::size_t numCommands = this->cmpdb.getCompileCommands(path).size();
+    const std::size_t begin       = std::exchange(numTaken[path], numCommands);
+    if (begin >= numCommands) {
+      return std::nullopt;
+    }
+    return CommandRange{begin, numCommands};
+  };
+  this->runWorkers(scheduler, numWorkers, {}, createFactory, claim);
+  loader.join();
+}
+
+void hdoc::indexer::ParallelExecutor::runWorkers(TUScheduler&                                     scheduler,
+                                                 const std::size_t                                numWorkers,
+                                                 const std::unordered_map<std::string, uint64_t>& estimates,
+                                                 const TUActionFactoryCreator&                    createFactory,
+                                                 const CommandClaimer&                            claim) {
   std::mutex mutex;
 
   // Add a counter to track progress
-  uint32_t    i                = 0;
-  std::string totalNumFiles    = std::to_string(this->cmpdb.getAllFiles().size());
-  auto        incrementCounter = [&]() {
+  uint32_t i                = 0;
+  auto     incrementCounter = [&]() {
     std::unique_lock<std::mutex> lock(mutex);
     return ++i;
   };
 
-  std::vector<std::string> allFilesInCmpdb = this->cmpdb.getAllFiles();
-
-  if (this->debugLimitNumIndexedFiles > 0) {
-    allFilesInCmpdb.resize(this->debugLimitNumIndexedFiles);
-    totalNumFiles = std::to_string(this->debugLimitNumIndexedFiles);
-  }
-
-  for (const std::string& file : allFilesInCmpdb) {
-    this->pool.async(
-        [&](const std::string path) {
-          spdlog::info("[{}/{}] processing {}", incrementCounter(), totalNumFiles, path);
-
-          // Each thread gets an independent copy of a VFS to allow different concurrent working directories
-          llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS = llvm::vfs::createPhysicalFileSystem().release();
-          clang::tooling::ClangTool Tool(this->cmpdb, {path}, std::make_shared<clang::PCHContainerOperations>(), FS);
-
-          // Append argument adjusters so that system includes and others are picked up on
-          // TODO: determine if the -fsyntax-only flag actually does anything
-          Tool.appendArgumentsAdjuster(clang::tooling::getClangStripOutputAdjuster());
-          Tool.appendArgumentsAdjuster(clang::tooling::getClangStripDependencyFileAdjuster());
-          Tool.appendArgumentsAdjuster(clang::tooling::getClangSyntaxOnlyAdjuster());
-          Tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
-              this->includePaths, clang::tooling::ArgumentInsertPosition::END));
-
-          // Ignore all diagnostics that clang might throw. Clang often has weird diagnostic settings that don't
-          // match what's in compile_commands.json, resulting in spurious errors. Instead of trying to change clang's
-          // behavior, we'll ignore all diagnostics and assume that the user supplied a project that builds on their
-          // machine.
-          clang::IgnoringDiagConsumer ignore;
-          Tool.setDiagnosticConsumer(&ignore);
-
-          // Run the tool and print an error message if something goes wrong
-          if (Tool.run(action.get())) {
-            spdlog::error(
-                "Clang failed to parse source file: {}. Information from this file may be missing from hdoc's output",
-                path);
+  // Without a budget, every worker parses a file at all times
+  std::unique_ptr<MemoryBudget> budget;
+  if (this->memoryBudget > 0 && numWorkers > 0) {
+    budget = std::make_unique<MemoryBudget>(this->memoryBudget);
+  }
+
+  // Workers keep their frontend state across calls, so that later calls still know what earlier ones looked up
+  while (this->frontends.size() < numWorkers) {
+    this->frontends.emplace_back(this->createFrontendState());
+  }
+  for (std::size_t worker = 0; worker < numWorkers; worker++) {
+    this->pool.async([&, worker]() {
+      FrontendState* frontend = this->frontends[worker].get();
+      while (const std::optional<std::string> path = scheduler.next(worker)) {
+        std::optional<CommandRange> commands;
+        if (claim) {
+          commands = claim(*path);
+          if (!commands) {
+            continue;
           }
-        },
-        file);
+        }
+
+        uint64_t estimate = 0;
+        if (budget) {
+          const auto it = estimates.find(*path);
+          estimate      = it != estimates.end() ? it->second : this->memoryBudget / numWorkers;
+          budget->acquire(estimate);
+        }
+        spdlog::info("[{}/{}] processing {}", incrementCounter(), scheduler.getNumFiles(), *path);
+
+        const auto start      = std::chrono::steady_clock::now();
+        uint64_t   peakMemory = 0;
+        this->runOnFile(*path, createFactory, *frontend, &peakMemory, commands);
+        if (budget) {
+          budget->release(estimate);
+        }
+        if (this->durations != nullptr) {
+          const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+          this->durations->record(*path, elapsed.count(), peakMemory);
+        }
+      }
+    });
   }
   // Make sure all tasks have finished before resetting the working directory
   this->pool.wait();
 }
+
+void hdoc::indexer::ParallelExecutor::runOnFile(const std::string&                 path,
+                                               const TUActionFactoryCreator&      createFactory,
+                                               FrontendState&                     frontend,
+                                               uint64_t*                          peakMemory,
+                                               const std::optional<CommandRange>& commands) {
+  const std::unique_ptr<TUActionFactory> factory = createFactory(path);
+  if (commands && commands->begin > 0) {
+    factory->prepareForLaterCommands();
+  }
+  const ParseResult result = this->parseFile(path, *factory, frontend, peakMemory, commands);
+  if (result == ParseResult::TimedOut) {
+    this->recordTimeout(path);
+  }
+  factory->finish(result == ParseResult::Succeeded);
+}
+
+void hdoc::indexer::ParallelExecutor::recordTimeout(const std::string& path) {
+  std::lock_guard<std::mutex> lock(this->timedOutMutex);
+  this->timedOutFiles.emplace_back(path);
+}
+
+std::unique_ptr<clang::tooling::ClangTool>
+hdoc::indexer::ParallelExecutor::createTool(const std::string&                         path,
+                                            FrontendState&                             frontend,
+                                            const ArgumentProfile*                     profile,
+                                            const bool                                 usePCH,
+                                            const clang::tooling::CompilationDatabase& cmpdb) const {
+  // Each thread has an independent VFS to allow different concurrent working directories, and keeps the files that
+  // earlier files looked up
+  auto tool = std::make_unique<clang::tooling::ClangTool>(
+      cmpdb,
+      std::vector<std::string>{path},
+      this->pchOps,
+      frontend.fs,
+      frontend.getFileManager(cmpdb, path, this->recordingLookups));
+  for (const auto& [file, contents] : this->virtualFiles) {
+    tool->mapVirtualFile(file, contents);
+  }
+
+  // Arguments that hdoc doesn't need are removed first, so that they can't remove any of the arguments hdoc adds.
+  // Before that, stale artifacts of the build are replaced. Commands that keep a PCH of the build aren't profiled,
+  // since a PCH only loads with the arguments it was built with.
+  if (this->prebuilt != nullptr || profile != nullptr) {
+    tool->appendArgumentsAdjuster(
+        [prebuilt = this->prebuilt, adjust = profile ? profile->getAdjuster() : nullptr, fs = frontend.fs](
+            const clang::tooling::CommandLineArguments& args, const llvm::StringRef file) {
+          clang::tooling::CommandLineArguments adjusted = args;
+          if (prebuilt != nullptr) {
+            // The tool changes into the directory of the command before adjusting its arguments
+            const llvm::ErrorOr<std::string> directory = fs->getCurrentWorkingDirectory();
+            adjusted = prebuilt->apply(args, directory ? *directory : "");
+          }
+          if (adjust && (prebuilt == nullptr || !PrebuiltArtifacts::usesPCH(adjusted))) {
+            adjusted = adjust(adjusted, file);
+          }
+          return adjusted;
+        });
+  }
+
+  // Append argument adjusters so that system includes and others are picked up on
+  // TODO: determine if the -fsyntax-only flag actually does anything
+  tool->appendArgumentsAdjuster(clang::tooling::getClangStripOutputAdjuster());
+  tool->appendArgumentsAdjuster(clang::tooling::getClangStripDependencyFileAdjuster());
+  tool->appendArgumentsAdjuster(clang::tooling::getClangSyntaxOnlyAdjuster());
+  tool->appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster(
+      this->includePaths, clang::tooling::ArgumentInsertPosition::END));
+  // A file can only be parsed with a single PCH, so files that keep a PCH of the build don't get the shared one. That
+  // includes files whose `-include` of a header was replaced with the header's PCH, which the build never passed as
+  // `-include-pch`. Their arguments also aren't profiled, while the shared PCH is built with profiled arguments.
+  if (usePCH && this->pch != nullptr) {
+    if (const std::string pchPath = this->pch->getPCHForFile(path); !pchPath.empty()) {
+      tool->appendArgumentsAdjuster(
+          [insert = clang::tooling::getInsertArgumentAdjuster({"-include-pch", pchPath},
+                                                              clang::tooling::ArgumentInsertPosition::END)](
+              const clang::tooling::CommandLineArguments& args, const llvm::StringRef file) {
+            return PrebuiltArtifacts::usesPCH(args) ? args : insert(args, file);
+          });
+    }
+  }
+
+  tool->setDiagnosticConsumer(&frontend.diagnostics);
+  return tool;
+}
+
+void hdoc::indexer::ParallelExecutor::compareArguments(const std::string& path, FrontendState& frontend) {
+  // Both parses only check the syntax, and neither uses the shared PCH, which is only valid with the profile's
+  // arguments. The file was just parsed, so both find its headers in the caches.
+  const auto timeParse = [&](const ArgumentProfile* profile) {
+    const auto tool    = this->createTool(path, frontend, profile, false, this->cmpdb);
+    const auto factory = clang::tooling::newFrontendActionFactory<clang::SyntaxOnlyAction>();
+    const auto start   = std::chrono::steady_clock::now();
+    tool->run(factory.get());
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+  const double original = timeParse(nullptr);
+  const double profiled = timeParse(this->profile);
+  spdlog::info("Parsed {} in {:.3f}s with the argument profile instead of {:.3f}s.", path, profiled, original);
+
+  std::lock_guard<std::mutex> lock(this->comparisonMutex);
+  this->numComparedFiles++;
+  this->originalParseTime += original;
+  this->profiledParseTime += profiled;
+}
+
+void hdoc::indexer::ParallelExecutor::printArgumentComparison() const {
+  std::lock_guard<std::mutex> lock(this->comparisonMutex);
+  if (this->numComparedFiles == 0) {
+    return;
+  }
+  spdlog::info("Parsing {} files took {:.2f}s with the argument profile instead of {:.2f}s ({:.1f}% less).",
+               this->numComparedFiles,
+               this->profiledParseTime,
+               this->originalParseTime,
+               this->originalParseTime > 0 ? 100 * (1 - this->profiledParseTime / this->originalParseTime) : 0.0);
+}
+
+hdoc::indexer::ParallelExecutor::ParseResult
+hdoc::indexer::ParallelExecutor::parseFile(const std::string&                 path,
+                                           TUActionFactory&                   factory,
+                                           FrontendState&                     frontend,
+                                           uint64_t*                          peakMemory,
+                                           const std::optional<CommandRange>& commands) {
+  // The deadline covers all compile commands of the file
+  Instrumentation instrumentation;
+  instrumentation.peakMemory = peakMemory;
+  if (this->timeout > 0) {
+    instrumentation.deadline = std::chrono::steady_clock::now() +
+                               std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(this->timeout));
+  }
+
+  // Files whose commands are parsed by more than one worker only see the ones this worker took
+  const clang::tooling::CompilationDatabase* cmpdb = &this->cmpdb;
+  std::optional<CommandRangeDatabase>        range;
+  if (commands) {
+    range.emplace(this->cmpdb, commands->begin, commands->end);
+    cmpdb = &*range;
+  }
+
+  // Run the tool and print an error message if something goes wrong
+  const std::unique_ptr<clang::tooling::ClangTool> tool = this->createTool(path, frontend, this->profile, true, *cmpdb);
+  bool                                             failed = false;
+  if (instrumentation.peakMemory != nullptr || instrumentation.deadline) {
+    InstrumentedActionFactory instrumented(factory, instrumentation);
+    failed = tool->run(&instrumented) != 0;
+  } else {
+    failed = tool->run(&factory) != 0;
+  }
+  if (this->compareProfile && this->profile != nullptr && !instrumentation.timedOut) {
+    this->compareArguments(path, frontend);
+  }
+  if (instrumentation.timedOut) {
+    spdlog::warn("Abandoned {} after it took longer than {} seconds. Information from this file will be missing "
+                 "from hdoc's output",
+                 path,
+                 this->timeout);
+    return ParseResult::TimedOut;
+  }
+  if (failed) {
+    spdlog::error(
+        "Clang failed to parse source file: {}. Information from this file may be missing from hdoc's output",
+        path);
+    return ParseResult::Failed;
+  }
+  return ParseResult::Succeeded;
+}
+
+/// Write all of data to fd. Returns false if the other end of the pipe is gone.
+static bool writeAll(const int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    const ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Fill all of data from fd. Returns false if the other end of the pipe was closed before that.
+static bool readAll(const int fd, char* data, std::size_t size) {
+  while (size > 0) {
+    const ssize_t n = ::read(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Messages in both directions are a size followed by that many bytes
+static bool writeMessage(const int fd, const std::string_view message) {
+  const uint64_t size = message.size();
+  return writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+         writeAll(fd, message.data(), message.size());
+}
+
+static bool readMessage(const int fd, std::string& message) {
+  uint64_t size = 0;
+  if (!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size))) {
+    return false;
+  }
+  message.resize(size);
+  return readAll(fd, message.data(), size);
+}
+
+/// A worker sends back two flags for every file, followed by the result of TUActionFactory::finishInWorker().
+/// The first is the ParseResult of the file, the second whether the worker exits because its RSS grew too large.
+static constexpr char kParseSucceeded = 'S';
+static constexpr char kParseFailed    = 'F';
+static constexpr char kParseTimedOut  = 'T';
+static constexpr char kWorkerExiting  = 'X';
+static constexpr char kWorkerStaying  = ' ';
+
+namespace {
+/// A worker process and the pipes to it, as seen by the parent
+struct Worker {
+  pid_t                                 pid        = -1;
+  int                                   toWorker   = -1;
+  int                                   fromWorker = -1;
+  std::optional<std::string>            path;  ///< File the worker is parsing, if any
+  std::chrono::steady_clock::time_point start; ///< When the worker was sent path
+};
+} // namespace
+
+/// Close the pipes to a worker and wait for it to exit. If kill is true, it's killed first since it may be stuck.
+/// Returns the exit status of the worker.
+static int stopWorker(Worker& worker, const bool kill) {
+  ::close(worker.toWorker);
+  if (kill) {
+    ::kill(worker.pid, SIGKILL);
+  }
+  int status = 0;
+  while (::waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  ::close(worker.fromWorker);
+  worker = Worker();
+  return status;
+}
+
+void hdoc::indexer::ParallelExecutor::executeInProcesses(const std::vector<std::string>& files,
+                                                         const TUActionFactoryCreator&   createFactory) {
+  // Writing to a worker that just died must not kill the parent
+  const auto previousHandler = std::signal(SIGPIPE, SIG_IGN);
+
+  const std::size_t   numWorkers = std::min<std::size_t>(this->numProcesses, files.size());
+  TUScheduler         scheduler(files, this->policy, this->durations, numWorkers);
+  std::vector<Worker> workers(numWorkers);
+
+  // Files that no worker process could take are parsed in this one
+  const std::unique_ptr<FrontendState> frontend = this->createFrontendState();
+
+  std::deque<std::string>                   retries;  ///< Files whose worker died, which are handed out first
+  std::unordered_map<std::string, uint32_t> attempts; ///< Number of times a file was handed to a worker
+  uint32_t                                  i             = 0;
+  const std::string                         totalNumFiles = std::to_string(files.size());
+
+  // Fork a worker into the given slot. The child has to close the pipes to all other workers, or they would
+  // never see their parent hang up.
+  const auto spawnWorker = [&](Worker& worker) {
+    int toWorker[2], fromWorker[2];
+    if (::pipe(toWorker) != 0) {
+      return false;
+    }
+    if (::pipe(fromWorker) != 0) {
+      ::close(toWorker[0]);
+      ::close(toWorker[1]);
+      return false;
+    }
+
+    // Anything still buffered would be written twice otherwise
+    std::fflush(nullptr);
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+      for (const Worker& other : workers) {
+        if (other.pid > 0) {
+          ::close(other.toWorker);
+          ::close(other.fromWorker);
+        }
+      }
+      ::close(toWorker[1]);
+      ::close(fromWorker[0]);
+      this->runWorker(toWorker[0], fromWorker[1], createFactory);
+      std::fflush(nullptr);
+      // Skip destructors and atexit handlers, everything in this process belongs to the parent
+      ::_exit(0);
+    }
+
+    ::close(toWorker[0]);
+    ::close(fromWorker[1]);
+    if (pid < 0) {
+      ::close(toWorker[1]);
+      ::close(fromWorker[0]);
+      return false;
+    }
+    worker.pid        = pid;
+    worker.toWorker   = toWorker[1];
+    worker.fromWorker = fromWorker[0];
+    return true;
+  };
+
+  // Record that a worker died while parsing its file, and retry the file unless it was tried too often
+  const auto handleCrash = [&](Worker& worker) {
+    const std::string path   = *worker.path;
+    const int         status = stopWorker(worker, /*kill=*/true);
+    const std::string reason = WIFSIGNALED(status) ? "was killed by signal " + std::to_string(WTERMSIG(status))
+                                                   : "exited with status " + std::to_string(WEXITSTATUS(status));
+    if (attempts[path] < kMaxAttempts) {
+      spdlog::warn("Worker process parsing {} {}, retrying it.", path, reason);
+      retries.emplace_back(path);
+    } else {
+      spdlog::error("Worker process parsing {} {}, skipping it. Information from this file will be missing from "
+                    "hdoc's output",
+                    path,
+                    reason);
+      createFactory(path)->finish(false);
+    }
+  };
+
+  // Hand the next file to the worker in the given slot, starting it if needed. Returns false if there are no files
+  // left for it.
+  const auto dispatch = [&](const std::size_t slot) {
+    Worker& worker = workers[slot];
+    while (true) {
+      std::optional<std::string> path;
+      if (!retries.empty()) {
+        path = std::move(retries.front());
+        retries.pop_front();
+      } else {
+        path = scheduler.next(slot);
+      }
+      if (!path) {
+        return false;
+      }
+
+      if (worker.pid < 0 && !spawnWorker(worker)) {
+        spdlog::error("Unable to start a worker process, parsing {} in this process instead.", *path);
+        spdlog::info("[{}/{}] processing {}", ++i, totalNumFiles, *path);
+        this->runOnFile(*path, createFactory, *frontend);
+        continue;
+      }
+      if (attempts[*path]++ == 0) {
+        spdlog::info("[{}/{}] processing {}", ++i, totalNumFiles, *path);
+      }
+      worker.path  = std::move(path);
+      worker.start = std::chrono::steady_clock::now();
+      if (!writeMessage(worker.toWorker, *worker.path)) {
+        handleCrash(worker);
+        continue;
+      }
+      return true;
+    }
+  };
+
+  for (std::size_t slot = 0; slot < numWorkers; slot++) {
+    dispatch(slot);
+  }
+
+  // Workers that are still busy with a file at its kill time are killed
+  const auto killTime = [&](const Worker& worker) {
+    return worker.start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(this->timeout + kTimeoutGraceSeconds));
+  };
+
+  std::vector<pollfd>      fds;
+  std::vector<std::size_t> slots;
+  std::string              result;
+  while (true) {
+    fds.clear();
+    slots.clear();
+    const auto now         = std::chrono::steady_clock::now();
+    int        pollTimeout = -1;
+    for (std::size_t slot = 0; slot < numWorkers; slot++) {
+      if (workers[slot].path) {
+        fds.push_back({workers[slot].fromWorker, POLLIN, 0});
+        slots.emplace_back(slot);
+        if (this->timeout > 0) {
+          const auto left = std::chrono::ceil<std::chrono::milliseconds>(killTime(workers[slot]) - now).count();
+          if (pollTimeout < 0 || left < pollTimeout) {
+            pollTimeout = static_cast<int>(std::clamp<decltype(left)>(left, 0, INT_MAX));
+          }
+        }
+      }
+    }
+    if (fds.empty()) {
+      break;
+    }
+    if (::poll(fds.data(), fds.size(), pollTimeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::error("Waiting for worker processes failed: {}", std::strerror(errno));
+      break;
+    }
+
+    for (std::size_t j = 0; j < fds.size(); j++) {
+      Worker& worker = workers[slots[j]];
+      if (fds[j].revents == 0) {
+        if (this->timeout > 0 && std::chrono::steady_clock::now() >= killTime(worker)) {
+          spdlog::warn("Killed the worker process parsing {} after it took longer than {} seconds. Information from "
+                       "this file will be missing from hdoc's output",
+                       *worker.path,
+                       this->timeout);
+          const std::string path = *worker.path;
+          stopWorker(worker, /*kill=*/true);
+          this->recordTimeout(path);
+          createFactory(path)->finish(false);
+          if (!dispatch(slots[j]) && worker.pid > 0) {
+            stopWorker(worker, /*kill=*/false);
+          }
+        }
+        continue;
+      }
+
+      if (!readMessage(worker.fromWorker, result) || result.size() < 2) {
+        handleCrash(worker);
+      } else {
+        const std::string path = std::move(*worker.path);
+        worker.path.reset();
+        if (this->durations != nullptr) {
+          const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - worker.start;
+          this->durations->record(path, elapsed.count());
+        }
+        if (result[0] == kParseTimedOut) {
+          this->recordTimeout(path);
+        }
+        createFactory(path)->finishFromWorker(result[0] == kParseSucceeded,
+                                              std::string_view(result).substr(2));
+        if (result[1] == kWorkerExiting) {
+          spdlog::debug("Worker process {} exceeded its memory limit, restarting it.", worker.pid);
+          stopWorker(worker, /*kill=*/false);
+        }
+      }
+
+      if (!dispatch(slots[j]) && worker.pid > 0) {
+        stopWorker(worker, /*kill=*/false);
+      }
+    }
+  }
+
+  // Only reached early if poll() failed, in which case the files of the remaining workers are lost
+  for (Worker& worker : workers) {
+    if (worker.pid > 0) {
+      if (worker.path) {
+        createFactory(*worker.path)->finish(false);
+      }
+      stopWorker(worker, /*kill=*/true);
+    }
+  }
+  std::signal(SIGPIPE, previousHandler);
+}
+
+void hdoc::indexer::ParallelExecutor::runWorker(const int                     in,
+                                                const int                     out,
+                                                const TUActionFactoryCreator& createFactory) {
+  const std::unique_ptr<FrontendState> frontend = this->createFrontendState();
+  std::string                          path;
+  while (readMessage(in, path)) {
+    const std::unique_ptr<TUActionFactory> factory = createFactory(path);
+    factory->prepareForWorker();
+    const ParseResult parsed  = this->parseFile(path, *factory, *frontend);
+    const std::string payload = factory->finishInWorker(parsed == ParseResult::Succeeded);
+
+    // Restart once the worker grew too large, rather than let it keep all the memory it has grabbed
+    const bool  exiting = this->maxRSS > 0 && getResidentSetSize() > this->maxRSS;
+    std::string result;
+    result.reserve(2 + payload.size());
+    result += parsed == ParseResult::Succeeded ? kParseSucceeded
+              : parsed == ParseResult::Failed  ? kParseFailed
+                                               : kParseTimedOut;
+    result += exiting ? kWorkerExiting : kWorkerStaying;
+    result += payload;
+    if (!writeMessage(out, result) || exiting) {
+      break;
+    }
+  }
+  ::close(in);
+  ::close(out);
+}
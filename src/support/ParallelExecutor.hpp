@@ -3,31 +3,239 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
+#include "clang/Serialization/PCHContainerOperations.h"
 #include "clang/Tooling/Execution.h"
 #include "llvm/Support/ThreadPool.h"
 
+#include "support/ArgumentProfile.hpp"
+#include "support/CachingFileSystem.hpp"
+#include "support/PrebuiltArtifacts.hpp"
+#include "support/SharedPCH.hpp"
+#include "support/TUScheduler.hpp"
+#include "types/Config.hpp"
+
 namespace hdoc::indexer {
+/// @brief Creates the FrontendActions for a single source file, and is notified once clang is done with it.
+/// A file with multiple entries in the compilation database is parsed once per entry.
+class TUActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+  /// Called after all of the compile commands of the file were run. success is false if any of them failed.
+  virtual void finish(const bool success) = 0;
+
+  /// @brief Called before any actions are created if the file is parsed in a worker process.
+  virtual void prepareForWorker() {}
+
+  /// @brief Called before any actions are created if the factory only parses the compile commands of the file that
+  /// were found after another factory already parsed its earlier ones. Its results add to the other's.
+  virtual void prepareForLaterCommands() {}
+
+  /// @brief Called in a worker process instead of finish(). Returns what the parent process needs to finish the
+  /// file with finishFromWorker(), since everything else is lost once the worker exits.
+  virtual std::string finishInWorker(const bool success) {
+    this->finish(success);
+    return "";
+  }
+
+  /// @brief Called in the parent process with the result of finishInWorker() for the same file, on a factory
+  /// that never created any actions.
+  virtual void finishFromWorker(const bool success, const std::string_view) { this->finish(success); }
+};
+
+/// Creates the TUActionFactory for the source file at the given path.
+using TUActionFactoryCreator = std::function<std::unique_ptr<TUActionFactory>(const std::string& path)>;
+
+/// Finds the files to parse, and passes a file to addFile every time one of its compile commands is found.
+using FileLoader = std::function<void(const std::function<void(const std::string& path)>& addFile)>;
+
 /// @brief A cut-down reimplementation of clang's AllTUsToolExecutor.
 /// Removes everything we don't need, leaving a simple mechanism that executes
-/// a frontend action over all files in the compilation database.
+/// a frontend action over files in the compilation database.
 class ParallelExecutor {
 public:
-  /// Creates a parallel executor that will run over all files in the compilation database.
+  /// Creates a parallel executor that will run over files in the compilation database.
   /// Args holds ArgumentAdjusters that will be applied to the parser, typically includes header search paths.
-  ParallelExecutor(const clang::tooling::CompilationDatabase& cmpdb,
-                   const std::vector<std::string>&            includePaths,
-                   llvm::ThreadPool&                          pool,
-                   const uint32_t                             debugLimitNumIndexedFiles)
-      : cmpdb(cmpdb), includePaths(includePaths), pool(pool), debugLimitNumIndexedFiles(debugLimitNumIndexedFiles) {}
+  /// Files that pch has a PCH for are parsed with it. pchOps are shared by all files, and must be the
+  /// ones that the PCHs were built with.
+  /// Files are scheduled according to policy, using and updating durations if given.
+  /// The threads of the pool keep the files that they looked up across calls to execute(), so files that changed in
+  /// between have to be passed to invalidate().
+  ParallelExecutor(const clang::tooling::CompilationDatabase&     cmpdb,
+                   const std::vector<std::string>&                includePaths,
+                   llvm::ThreadPool&                              pool,
+                   std::shared_ptr<clang::PCHContainerOperations> pchOps,
+                   const SharedPCH*                               pch,
+                   const hdoc::types::SchedulingPolicy            policy,
+                   TUDurations*                                   durations);
+  ~ParallelExecutor();
+
+  /// Parse files in numProcesses forked worker processes instead of the threads of the pool, so that a crash
+  /// in clang only loses a single file. Workers are restarted once their RSS exceeds maxRSS bytes (0 == never).
+  void useWorkerProcesses(const uint32_t numProcesses, const uint64_t maxRSS) {
+    this->numProcesses = numProcesses;
+    this->maxRSS       = maxRSS;
+  }
+
+  /// Only start parsing a file while the memory that the files being parsed are expected to need, and the RSS of
+  /// the process, stay below budget bytes. Has no effect with worker processes, which use maxRSS instead.
+  void useMemoryBudget(const uint64_t budget) { this->memoryBudget = budget; }
+
+  /// Abandon files that are still being parsed after the given number of seconds (0 == never). Parsing stops
+  /// at the next top-level declaration, and worker processes that don't get there in time are killed. Threads can't
+  /// be stopped inside of a declaration, so only worker processes are guaranteed to give up on a file.
+  void useTimeout(const double seconds) { this->timeout = seconds; }
+
+  /// Parse files with the arguments that profile leaves of their compile commands. If compare is true, every file is
+  /// also parsed with its original arguments and with the profile's, and the times both took are reported.
+  void useArgumentProfile(const ArgumentProfile* profile, const bool compare) {
+    this->profile        = profile;
+    this->compareProfile = compare;
+  }
+
+  /// Parse files with the PCHs and module files of the build that are up to date, and replace the others
+  void usePrebuiltArtifacts(PrebuiltArtifacts* prebuilt) { this->prebuilt = prebuilt; }
+
+  /// Parse contents instead of the file at path whenever it's read, like a buffer that an editor hasn't saved yet
+  void mapVirtualFile(const std::string& path, std::string contents) {
+    this->virtualFiles[path] = std::move(contents);
+  }
+
+  /// Run the actions created by createFactory over all of the given files.
+  void execute(const std::vector<std::string>& files, const TUActionFactoryCreator& createFactory);
+
+  /// Remember which files the threads of the pool looked up for which working directory, so that invalidate() only
+  /// has to forget the lookups that found a changed file. Only needed if files change between calls to execute().
+  void recordLookups() { this->recordingLookups = true; }
 
-  void execute(std::unique_ptr<clang::tooling::FrontendActionFactory> action);
+  /// Read the files at the given absolute paths from disk again the next time they're needed, since they changed
+  /// since the last call to execute(). Clang can't forget single files, so every FileManager that looked one of
+  /// them up is replaced, which only costs lookups in the shared cache. Without recordLookups(), that's all of them.
+  void invalidate(const std::vector<std::string>& paths);
+
+  /// Run the actions created by createFactory over the files that load finds, while it's still finding them.
+  /// Files are parsed in the order they're found, on the threads of the pool, and load runs on a thread of its own.
+  /// Worker processes aren't used, since they would have to be forked before load is done. A file that gets more
+  /// compile commands after a worker took it is handed out again, and only the commands that weren't parsed yet are
+  /// parsed then, by a factory that was prepared with TUActionFactory::prepareForLaterCommands().
+  void executeWhileLoading(const FileLoader& load, const TUActionFactoryCreator& createFactory);
+
+  /// Print how many file system calls were served from memory, over all calls to execute()
+  void printFileSystemStats() const { this->fileSystemCache.printStats(); }
+
+  /// Print how long parsing took with the original arguments and with the argument profile, over all files that
+  /// were compared in this process
+  void printArgumentComparison() const;
+
+  /// Files that were abandoned because of the timeout, over all calls to execute() since the last clearTimedOutFiles()
+  std::vector<std::string> getTimedOutFiles() const {
+    std::lock_guard<std::mutex> lock(this->timedOutMutex);
+    return this->timedOutFiles;
+  }
+
+  /// Forget the files that were abandoned because of the timeout so far
+  void clearTimedOutFiles() {
+    std::lock_guard<std::mutex> lock(this->timedOutMutex);
+    this->timedOutFiles.clear();
+  }
 
 private:
-  const clang::tooling::CompilationDatabase& cmpdb;
-  const std::vector<std::string>&            includePaths;
-  llvm::ThreadPool&                          pool;
-  const uint32_t                             debugLimitNumIndexedFiles = 0;
+  /// Outcome of parsing a single file
+  enum class ParseResult {
+    Succeeded,
+    Failed,   ///< Clang failed to parse the file
+    TimedOut, ///< The file was abandoned because of the timeout
+  };
+
+  /// Frontend state that a thread or worker process keeps across the files it parses
+  struct FrontendState;
+
+  /// The compile commands [begin, end) of a file, in the order they're in the compilation database
+  struct CommandRange {
+    std::size_t begin = 0;
+    std::size_t end   = 0;
+  };
+
+  /// Claims the compile commands of a file that no worker took yet, or returns std::nullopt if there are none
+  using CommandClaimer = std::function<std::optional<CommandRange>(const std::string& path)>;
+
+  /// Create the frontend state of a thread or worker process that's about to parse files
+  std::unique_ptr<FrontendState> createFrontendState();
+
+  /// Run a worker on numWorkers threads of the pool that parses files from scheduler until there are none left.
+  /// Files are admitted within the memory budget using estimates, or an equal share of it if they have none.
+  /// If claim is given, only the compile commands it claims are parsed, and files it claims none of are skipped.
+  void runWorkers(TUScheduler&                                     scheduler,
+                  const std::size_t                                numWorkers,
+                  const std::unordered_map<std::string, uint64_t>& estimates,
+                  const TUActionFactoryCreator&                    createFactory,
+                  const CommandClaimer&                            claim = nullptr);
+
+  /// execute() with worker processes
+  void executeInProcesses(const std::vector<std::string>& files, const TUActionFactoryCreator& createFactory);
+
+  /// Serve files sent by the parent process over in until it closes it, writing the results to out
+  void runWorker(const int in, const int out, const TUActionFactoryCreator& createFactory);
+
+  /// Create the tool that parses the file at path with its compile commands in cmpdb, adjusted by profile if it's not
+  /// nullptr, the arguments that hdoc adds, and the shared PCH if usePCH is true
+  std::unique_ptr<clang::tooling::ClangTool> createTool(const std::string&                         path,
+                                                        FrontendState&                             frontend,
+                                                        const ArgumentProfile*                     profile,
+                                                        const bool                                 usePCH,
+                                                        const clang::tooling::CompilationDatabase& cmpdb) const;
+
+  /// Parse the file at path with its original arguments and with the argument profile, and report the time each took
+  void compareArguments(const std::string& path, FrontendState& frontend);
+
+  /// Parse a single file with the actions created by createFactory, only with the given compile commands if any
+  void runOnFile(const std::string&                 path,
+                 const TUActionFactoryCreator&      createFactory,
+                 FrontendState&                     frontend,
+                 uint64_t*                          peakMemory = nullptr,
+                 const std::optional<CommandRange>& commands   = std::nullopt);
+
+  /// Run the actions of factory over a single file, only with the given compile commands if any.
+  /// If peakMemory is given, it receives the largest memory clang's data structures took for any compile command.
+  ParseResult parseFile(const std::string&                 path,
+                        TUActionFactory&                   factory,
+                        FrontendState&                     frontend,
+                        uint64_t*                          peakMemory = nullptr,
+                        const std::optional<CommandRange>& commands   = std::nullopt);
+
+  /// Remember that a file was abandoned because of the timeout
+  void recordTimeout(const std::string& path);
+
+  const clang::tooling::CompilationDatabase&     cmpdb;
+  const std::vector<std::string>&                includePaths;
+  llvm::ThreadPool&                              pool;
+  std::shared_ptr<clang::PCHContainerOperations> pchOps;
+  const SharedPCH*                               pch;
+  const hdoc::types::SchedulingPolicy            policy;
+  TUDurations*                                   durations;
+  uint32_t                                       numProcesses = 0;
+  uint64_t                                       maxRSS       = 0;
+  uint64_t                                       memoryBudget = 0;
+  double                                         timeout      = 0;
+  std::vector<std::string>                       timedOutFiles;
+  mutable std::mutex                             timedOutMutex;
+  PrebuiltArtifacts*                             prebuilt          = nullptr;
+  const ArgumentProfile*                         profile           = nullptr;
+  bool                                           compareProfile    = false;
+  uint32_t                                       numComparedFiles  = 0; ///< Files parsed by compareArguments()
+  double                                         originalParseTime = 0; ///< Seconds they took with original arguments
+  double                                         profiledParseTime = 0; ///< Seconds they took with the profile
+  mutable std::mutex                             comparisonMutex;
+  std::map<std::string, std::string>             virtualFiles;    ///< Contents that replace files on disk
+  SharedFileSystemCache                          fileSystemCache; ///< Shared by all files parsed by this executor
+  std::vector<std::unique_ptr<FrontendState>>    frontends;       ///< Of the workers on the threads of the pool
+  bool                                           recordingLookups = false;
 };
 } // namespace hdoc::indexer
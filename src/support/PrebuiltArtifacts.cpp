@@ -0,0 +1,326 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/PrebuiltArtifacts.hpp"
+#include "spdlog/spdlog.h"
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Serialization/ASTReader.h"
+#include "clang/Serialization/InMemoryModuleCache.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <tuple>
+
+/// Absolute and normalized version of path, which may be relative to dir
+static std::string getAbsolutePath(const llvm::StringRef dir, const llvm::StringRef path) {
+  llvm::SmallString<128> absPath(path);
+  llvm::sys::fs::make_absolute(dir, absPath);
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/true);
+  return absPath.str().str();
+}
+
+/// PCH that clang's driver uses instead of the header at path when it's included with -include, or an empty string
+static std::string getImplicitPCH(const std::string& path) {
+  for (const char* extension : {".pch", ".gch"}) {
+    if (llvm::sys::fs::exists(path + extension)) {
+      return path + extension;
+    }
+  }
+  return "";
+}
+
+/// Does args include the header at path with -include or -Xclang -include?
+static bool
+includesHeader(const std::vector<std::string>& args, const std::string& directory, const std::string& path) {
+  for (std::size_t i = 0; i + 1 < args.size(); i++) {
+    if (args[i] == "-include" && getAbsolutePath(directory, args[i + 1]) == path) {
+      return true;
+    }
+    if (args[i] == "-Xclang" && args[i + 1] == "-include" && i + 3 < args.size() && args[i + 2] == "-Xclang" &&
+        getAbsolutePath(directory, args[i + 3]) == path) {
+      return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+/// Finds out whether the inputs of an AST file changed after it was written, and which module files it imports.
+/// AST files that another version of clang wrote are already rejected by ASTReaderListener.
+class ArtifactListener : public clang::ASTReaderListener {
+public:
+  ArtifactListener(const llvm::sys::TimePoint<> written) : written(written) {}
+
+  bool needsInputFileVisitation() override { return true; }
+  bool needsSystemInputFileVisitation() override { return true; }
+  bool visitInputFile(llvm::StringRef filename, bool, bool isOverridden, bool) override {
+    llvm::sys::fs::file_status status;
+    if (!isOverridden &&
+        (llvm::sys::fs::status(filename, status) || status.getLastModificationTime() > this->written)) {
+      this->stale = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool needsImportVisitation() const override { return true; }
+  void visitImport(llvm::StringRef, llvm::StringRef filename) override {
+    // C++20 modules don't record the files of the modules they import, which are checked where they're imported
+    if (!filename.empty()) {
+      this->imports.emplace_back(filename.str());
+    }
+  }
+
+  const llvm::sys::TimePoint<> written;
+  bool                         stale = false;
+  std::vector<std::string>     imports;
+};
+} // namespace
+
+hdoc::indexer::PrebuiltArtifacts::PrebuiltArtifacts(const clang::tooling::CompilationDatabase&     cmpdb,
+                                                    const std::vector<std::string>&                includePaths,
+                                                    std::shared_ptr<clang::PCHContainerOperations> pchOps)
+    : cmpdb(cmpdb), includePaths(includePaths), pchOps(pchOps),
+      dir(std::filesystem::temp_directory_path() / "hdoc-prebuilt") {}
+
+hdoc::indexer::PrebuiltArtifacts::~PrebuiltArtifacts() {
+  for (const auto& rebuiltFile : this->rebuiltFiles) {
+    llvm::sys::fs::remove(rebuiltFile);
+  }
+}
+
+void hdoc::indexer::PrebuiltArtifacts::prepare(const std::vector<std::string>& files, llvm::ThreadPool& pool) {
+  for (const auto& file : files) {
+    pool.async([&, file]() {
+      for (const auto& cmd : this->cmpdb.getCompileCommands(file)) {
+        this->apply(cmd.CommandLine, cmd.Directory);
+      }
+    });
+  }
+  pool.wait();
+}
+
+std::vector<std::string> hdoc::indexer::PrebuiltArtifacts::apply(const std::vector<std::string>& args,
+                                                                 const std::string&              directory) {
+  if (args.empty()) {
+    return args;
+  }
+
+  std::vector<std::string> result = {args[0]};
+  for (std::size_t i = 1; i < args.size(); i++) {
+    const std::string& arg  = args[i];
+    const std::string  next = i + 1 < args.size() ? args[i + 1] : "";
+
+    // The build might pick up module files that clang writes as a side effect of parsing
+    if (arg.starts_with("-fmodule-output")) {
+      continue;
+    }
+
+    // Stale PCHs are replaced by the header they were built from, unless the header is included anyway
+    const bool isDriverPCH = arg == "-include-pch" && !next.empty();
+    const bool isFrontendPCH =
+        arg == "-Xclang" && next == "-include-pch" && i + 3 < args.size() && args[i + 2] == "-Xclang";
+    if (isDriverPCH || isFrontendPCH) {
+      const std::size_t last     = isDriverPCH ? i + 1 : i + 3;
+      const Artifact&   artifact = this->resolve(getAbsolutePath(directory, args[last]), Kind::PCH);
+      if (artifact.usable) {
+        result.insert(result.end(), args.begin() + i, args.begin() + last + 1);
+      } else if (!artifact.replacement.empty() && !includesHeader(args, directory, artifact.replacement)) {
+        result.insert(result.end(), {"-include", artifact.replacement});
+      }
+      i = last;
+      continue;
+    }
+
+    // Everything else that's passed on to clang's frontend is kept as it is
+    if (arg == "-Xclang" && !next.empty()) {
+      result.insert(result.end(), {arg, next});
+      i++;
+      continue;
+    }
+
+    // Clang's driver parses a header with the PCH next to it if there is one. Stale ones are bypassed by passing the
+    // header directly to clang's frontend.
+    if (arg == "-include" && !next.empty()) {
+      const std::string pch = getImplicitPCH(getAbsolutePath(directory, next));
+      if (pch.empty()) {
+        result.insert(result.end(), {arg, next});
+      } else if (this->resolve(pch, Kind::PCH, getAbsolutePath(directory, next)).usable) {
+        result.insert(result.end(), {"-include-pch", pch});
+      } else {
+        result.insert(result.end(), {"-Xclang", "-include", "-Xclang", next});
+      }
+      i++;
+      continue;
+    }
+
+    // Module files are -fmodule-file=<path> or -fmodule-file=<module name>=<path>
+    if (arg.starts_with("-fmodule-file=")) {
+      const llvm::StringRef value = llvm::StringRef(arg).split('=').second;
+      llvm::StringRef       name;
+      llvm::StringRef       path = value;
+      if (value.contains('=')) {
+        std::tie(name, path) = value.split('=');
+      }
+
+      const Artifact& artifact = this->resolve(getAbsolutePath(directory, path), Kind::Module);
+      if (artifact.usable || artifact.replacement.empty()) {
+        result.emplace_back(arg);
+      } else {
+        result.emplace_back("-fmodule-file=" + (name.empty() ? "" : name.str() + "=") + artifact.replacement);
+      }
+      continue;
+    }
+
+    result.emplace_back(arg);
+  }
+  return result;
+}
+
+bool hdoc::indexer::PrebuiltArtifacts::usesPCH(const std::vector<std::string>& args) {
+  return std::find(args.begin(), args.end(), "-include-pch") != args.end();
+}
+
+const hdoc::indexer::PrebuiltArtifacts::Artifact&
+hdoc::indexer::PrebuiltArtifacts::resolve(const std::string& path, const Kind kind, const std::string& header) {
+  Artifact* artifact = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    artifact = &this->artifacts[path];
+  }
+
+  // Modules are only checked after the modules they import, which may have to be rebuilt first. Importing a module
+  // can't be cyclic, so this always ends.
+  std::call_once(artifact->checked, [&]() {
+    std::vector<std::string> imports;
+    artifact->usable = this->isUpToDate(path, imports) &&
+                       std::all_of(imports.begin(), imports.end(), [&](const std::string& import) {
+                         return this->resolve(import, Kind::Module).usable;
+                       });
+    if (artifact->usable) {
+      this->numReused++;
+      return;
+    }
+
+    if (kind == Kind::PCH) {
+      llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(new clang::FileManager(clang::FileSystemOptions()));
+      clang::IgnoringDiagConsumer                  ignore;
+      clang::DiagnosticsEngine diags(new clang::DiagnosticIDs(), new clang::DiagnosticOptions(), &ignore, false);
+      artifact->replacement =
+          clang::ASTReader::getOriginalSourceFile(path, *fileManager, this->pchOps->getRawReader(), diags);
+      if (artifact->replacement.empty() || !llvm::sys::fs::exists(artifact->replacement)) {
+        artifact->replacement = header;
+      }
+    } else {
+      artifact->replacement = this->rebuildModule(path);
+    }
+
+    if (artifact->replacement.empty()) {
+      this->numFailed++;
+      spdlog::warn("{} is stale or was built by another compiler, and hdoc is unable to replace it. Files that use it "
+                   "may fail to parse.",
+                   path);
+    } else if (kind == Kind::PCH) {
+      this->numReplaced++;
+    } else {
+      this->numRebuilt++;
+    }
+  });
+  return *artifact;
+}
+
+bool hdoc::indexer::PrebuiltArtifacts::isUpToDate(const std::string& path, std::vector<std::string>& imports) const {
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(path, status)) {
+    return false;
+  }
+
+  // readASTFileControlBlock() returns true if the file can't be read, or the listener rejects it
+  ArtifactListener                             listener(status.getLastModificationTime());
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(new clang::FileManager(clang::FileSystemOptions()));
+  llvm::IntrusiveRefCntPtr<clang::InMemoryModuleCache> moduleCache(new clang::InMemoryModuleCache());
+  const bool failed = clang::ASTReader::readASTFileControlBlock(path,
+                                                                *fileManager,
+                                                                *moduleCache,
+                                                                this->pchOps->getRawReader(),
+                                                                /*FindModuleFileExtensions=*/false,
+                                                                listener,
+                                                                /*ValidateDiagnosticOptions=*/false);
+  imports = std::move(listener.imports);
+  return !failed && !listener.stale;
+}
+
+std::string hdoc::indexer::PrebuiltArtifacts::rebuildModule(const std::string& path) {
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(new clang::FileManager(clang::FileSystemOptions()));
+  clang::IgnoringDiagConsumer                  ignore;
+  clang::DiagnosticsEngine diags(new clang::DiagnosticIDs(), new clang::DiagnosticOptions(), &ignore, false);
+  const std::string        source =
+      clang::ASTReader::getOriginalSourceFile(path, *fileManager, this->pchOps->getRawReader(), diags);
+  const auto cmds = source.empty() ? std::vector<clang::tooling::CompileCommand>()
+                                   : this->cmpdb.getCompileCommands(source);
+  if (cmds.empty()) {
+    return "";
+  }
+  const auto& cmd = cmds[0];
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->dir, ec);
+  llvm::SmallString<128> modulePath;
+  if (ec || llvm::sys::fs::createUniqueFile(
+                (this->dir / (llvm::sys::path::stem(path).str() + "-%%%%%%%%.pcm")).string(), modulePath)) {
+    return "";
+  }
+
+  // The interface unit is precompiled with its own command, whose imports are resolved first. Precompiling replaces
+  // compiling it, and it's always parsed as a module interface unit.
+  std::vector<std::string> args = this->apply(cmd.CommandLine, cmd.Directory);
+  args = clang::tooling::getClangStripOutputAdjuster()(args, cmd.Filename);
+  args = clang::tooling::getClangStripDependencyFileAdjuster()(args, cmd.Filename);
+  for (auto it = args.begin() + 1; it != args.end();) {
+    if (*it == "-x" && it + 1 != args.end()) {
+      it = args.erase(it, it + 2);
+    } else if (*it == "-c" || it->starts_with("-x")) {
+      it = args.erase(it);
+    } else {
+      it++;
+    }
+  }
+  args.insert(args.begin() + 1, {"-x", "c++-module"});
+  args.insert(args.end(), this->includePaths.begin(), this->includePaths.end());
+  args.insert(args.end(), {"--precompile", "-o", modulePath.str().str()});
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS = llvm::vfs::createPhysicalFileSystem().release();
+  FS->setCurrentWorkingDirectory(cmd.Directory);
+  llvm::IntrusiveRefCntPtr<clang::FileManager> toolFileManager(new clang::FileManager(clang::FileSystemOptions(), FS));
+
+  clang::tooling::ToolInvocation invocation(
+      args, std::make_unique<clang::GenerateModuleInterfaceAction>(), toolFileManager.get(), this->pchOps);
+  invocation.setDiagnosticConsumer(&ignore);
+  if (!invocation.run()) {
+    llvm::sys::fs::remove(modulePath);
+    return "";
+  }
+
+  spdlog::info("Rebuilt module file {} from {}.", path, source);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->rebuiltFiles.emplace_back(modulePath.str().str());
+  return modulePath.str().str();
+}
+
+void hdoc::indexer::PrebuiltArtifacts::printStats() const {
+  if (this->numReused + this->numReplaced + this->numRebuilt + this->numFailed == 0) {
+    return;
+  }
+  spdlog::info("Reused {} PCHs and module files of the build, replaced {} stale PCHs by their headers, and rebuilt {} "
+               "stale module files.",
+               this->numReused.load(),
+               this->numReplaced.load(),
+               this->numRebuilt.load());
+}
@@ -0,0 +1,89 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+namespace hdoc::indexer {
+/// @brief PCHs and C++20 module files that the project's build wrote, and that compile commands refer to.
+///
+/// Files are parsed with the artifacts that this version of clang wrote and that are newer than all of their inputs,
+/// instead of parsing the same code from source again. References to stale or incompatible artifacts are rewritten:
+///  - PCHs are replaced by including the header they were built from.
+///  - Module files are rebuilt into a temporary directory from the compile command of their module interface unit,
+///    since a module can't be imported from source.
+///
+/// PCHs are found through `-include-pch`, `-Xclang -include-pch`, and `-include` of a header with a `.pch` or `.gch`
+/// file next to it, and module files through `-fmodule-file=`. Arguments that would make clang write module files
+/// next to the build's are removed.
+class PrebuiltArtifacts {
+public:
+  /// Module files are rebuilt with the commands in cmpdb, with includePaths added to them
+  PrebuiltArtifacts(const clang::tooling::CompilationDatabase&     cmpdb,
+                    const std::vector<std::string>&                includePaths,
+                    std::shared_ptr<clang::PCHContainerOperations> pchOps);
+  ~PrebuiltArtifacts();
+
+  /// @brief Check the artifacts that the compile commands of files refer to, and rebuild stale module files, on
+  /// the threads of pool. Artifacts are checked by apply() otherwise, on the thread that parses the first file using
+  /// them.
+  void prepare(const std::vector<std::string>& files, llvm::ThreadPool& pool);
+
+  /// @brief args with references to stale or incompatible artifacts rewritten. Relative paths are relative to
+  /// directory, the working directory of the compile command.
+  std::vector<std::string> apply(const std::vector<std::string>& args, const std::string& directory);
+
+  /// @brief Does args, as returned by apply(), parse the file with a PCH of the build?
+  static bool usesPCH(const std::vector<std::string>& args);
+
+  /// @brief Print how many artifacts were reused, replaced, and rebuilt
+  void printStats() const;
+
+private:
+  enum class Kind {
+    PCH,
+    Module,
+  };
+
+  struct Artifact {
+    std::once_flag checked;
+    bool           usable = false;
+    std::string    replacement; ///< Header a PCH was built from, or rebuilt module file. Empty if there is none.
+  };
+
+  /// The artifact at the absolute path, which is checked and possibly rebuilt the first time it's needed. A PCH is
+  /// replaced by header if the header it was built from can't be found.
+  const Artifact& resolve(const std::string& path, const Kind kind, const std::string& header = "");
+
+  /// Was the artifact at path written by this version of clang, after all of its inputs changed for the last time?
+  /// Module files it imports are added to imports.
+  bool isUpToDate(const std::string& path, std::vector<std::string>& imports) const;
+
+  /// Rebuild the module file at path from its interface unit, returning the path of the new one, or an empty string
+  /// if it can't be rebuilt
+  std::string rebuildModule(const std::string& path);
+
+  const clang::tooling::CompilationDatabase&     cmpdb;
+  const std::vector<std::string>&                includePaths;
+  std::shared_ptr<clang::PCHContainerOperations> pchOps;
+  std::filesystem::path                          dir;          ///< Where rebuilt module files are written
+  std::unordered_map<std::string, Artifact>      artifacts;    ///< By absolute path
+  std::vector<std::string>                       rebuiltFiles; ///< Removed when done
+  std::mutex                                     mutex;        ///< Guards artifacts and rebuiltFiles
+  std::atomic<uint32_t>                          numReused   = 0;
+  std::atomic<uint32_t>                          numReplaced = 0; ///< PCHs replaced by their headers
+  std::atomic<uint32_t>                          numRebuilt  = 0; ///< Module files rebuilt from source
+  std::atomic<uint32_t>                          numFailed   = 0; ///< Artifacts that couldn't be replaced or rebuilt
+};
+} // namespace hdoc::indexer
@@ -0,0 +1,292 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/SharedPCH.hpp"
+#include "spdlog/spdlog.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <optional>
+
+/// Upper bound on the number of leading #include directives considered for a prefix
+static constexpr std::size_t kMaxPrefixLength = 512;
+
+/// Prefix of the name of the temporary directory of every SharedPCH
+static constexpr char kDirPrefix[] = "hdoc-shared-pch";
+
+namespace {
+/// What a source file needs to share a PCH with other files
+struct PrefixCandidate {
+  std::string              groupKey; ///< Files can only share a PCH if their keys are identical
+  std::vector<std::string> args;     ///< Compile command without the source file
+  std::string              directory;
+  std::string              language;
+  std::vector<std::string> includes; ///< Leading #include directives of the file
+};
+
+/// A PCH to build for some group of files
+struct PrefixPCH {
+  const PrefixCandidate*   candidate; ///< Any of the files that use the PCH
+  std::size_t              length;    ///< Number of leading #include directives it covers
+  std::vector<std::size_t> users;     ///< Indices of the files that use the PCH
+  std::string              pchPath;
+};
+} // namespace
+
+/// Absolute and normalized version of path, which may be relative to dir
+static std::string getAbsolutePath(const llvm::StringRef dir, const llvm::StringRef path) {
+  llvm::SmallString<128> absPath(path);
+  llvm::sys::fs::make_absolute(dir, absPath);
+  llvm::sys::path::remove_dots(absPath, /*remove_dot_dot=*/true);
+  return absPath.str().str();
+}
+
+/// The #include directives at the very top of a source file, before any other code or preprocessor directive.
+/// Quoted includes are looked up relative to the including file, so they are tagged with its directory to keep
+/// files in different directories from sharing them.
+static std::vector<std::string> getLeadingIncludes(llvm::StringRef content, const llvm::StringRef dir) {
+  std::vector<std::string> includes;
+  bool                     inComment = false;
+  while (!content.empty() && includes.size() < kMaxPrefixLength) {
+    llvm::StringRef line;
+    std::tie(line, content) = content.split('\n');
+    line                    = line.trim();
+
+    // Skip comments, but stop at a line that has code after the end of a comment
+    if (inComment || line.startswith("/*")) {
+      const std::size_t end = line.find("*/");
+      inComment             = end == llvm::StringRef::npos;
+      if (!inComment && !line.substr(end + 2).trim().empty()) {
+        break;
+      }
+      continue;
+    }
+    if (line.empty() || line.startswith("//")) {
+      continue;
+    }
+
+    if (!line.consume_front("#")) {
+      break;
+    }
+    line = line.ltrim();
+    if (!line.consume_front("include")) {
+      break;
+    }
+    line = line.ltrim();
+
+    const bool        quoted = line.startswith("\"");
+    const std::size_t end    = quoted ? line.find('"', 1) : line.startswith("<") ? line.find('>') : line.npos;
+    if (end == line.npos) {
+      break;
+    }
+    std::string include = "#include " + line.substr(0, end + 1).str();
+    if (quoted) {
+      include += '\0' + dir.str();
+    }
+    includes.emplace_back(include);
+  }
+  return includes;
+}
+
+hdoc::indexer::SharedPCH::SharedPCH(const clang::tooling::CompilationDatabase&     cmpdb,
+                                    const std::vector<std::string>&                includePaths,
+                                    std::shared_ptr<clang::PCHContainerOperations> pchOps,
+                                    const ArgumentProfile*                         profile)
+    : cmpdb(cmpdb), includePaths(includePaths), pchOps(pchOps), profile(profile) {}
+
+hdoc::indexer::SharedPCH::~SharedPCH() {
+  if (!this->dir.empty()) {
+    std::error_code ec;
+    std::filesystem::remove_all(this->dir, ec);
+  }
+}
+
+bool hdoc::indexer::SharedPCH::isPrefixHeader(const llvm::StringRef path) {
+  return llvm::sys::path::filename(path).startswith("prefix-") && llvm::sys::path::extension(path) == ".h" &&
+         llvm::sys::path::filename(llvm::sys::path::parent_path(path)).startswith(kDirPrefix);
+}
+
+std::string hdoc::indexer::SharedPCH::getPCHForFile(const std::string& path) const {
+  if (const auto it = this->pchForFile.find(path); it != this->pchForFile.end()) {
+    return it->second;
+  }
+  return "";
+}
+
+void hdoc::indexer::SharedPCH::build(const std::vector<std::string>& files, llvm::ThreadPool& pool) {
+  llvm::SmallString<128> tempDir;
+  if (const std::error_code ec = llvm::sys::fs::createUniqueDirectory(kDirPrefix, tempDir)) {
+    spdlog::warn("Unable to create a directory for shared PCHs: {}", ec.message());
+    return;
+  }
+  this->dir = tempDir.str().str();
+
+  // Reading the leading includes of every file is I/O bound, so it's done in parallel
+  std::vector<std::optional<PrefixCandidate>> candidates(files.size());
+  for (std::size_t i = 0; i < files.size(); i++) {
+    pool.async([&, i]() {
+      // Files with multiple compile commands are parsed once per command, which one PCH can't serve
+      const auto cmds = this->cmpdb.getCompileCommands(files[i]);
+      if (cmds.size() != 1) {
+        return;
+      }
+      const auto& cmd  = cmds[0];
+      const auto  path = getAbsolutePath(cmd.Directory, cmd.Filename);
+
+      // A file can only be parsed with a single PCH, so files that the build parses with one of its own keep that one
+      if (std::find(cmd.CommandLine.begin(), cmd.CommandLine.end(), "-include-pch") != cmd.CommandLine.end()) {
+        return;
+      }
+
+      auto buf = llvm::MemoryBuffer::getFile(path, /*IsText=*/true);
+      if (!buf) {
+        return;
+      }
+
+      PrefixCandidate c;
+      c.directory = cmd.Directory;
+      c.language  = llvm::sys::path::extension(path) == ".c" ? "c-header" : "c++-header";
+      c.includes  = getLeadingIncludes(buf->get()->getBuffer(), llvm::sys::path::parent_path(path));
+      if (c.includes.empty()) {
+        return;
+      }
+
+      // The command has to be identical apart from the source file and its outputs
+      c.args = this->profile != nullptr ? this->profile->apply(cmd.CommandLine) : cmd.CommandLine;
+      c.args = clang::tooling::getClangStripOutputAdjuster()(c.args, path);
+      c.args = clang::tooling::getClangStripDependencyFileAdjuster()(c.args, path);
+      c.args.erase(std::remove_if(c.args.begin() + 1,
+                                  c.args.end(),
+                                  [&](const std::string& arg) { return getAbsolutePath(cmd.Directory, arg) == path; }),
+                   c.args.end());
+
+      c.groupKey = c.directory + '\0' + c.language;
+      for (const auto& arg : c.args) {
+        c.groupKey += '\0' + arg;
+      }
+      candidates[i] = std::move(c);
+    });
+  }
+  pool.wait();
+
+  std::unordered_map<std::string, std::vector<std::size_t>> groups;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    if (candidates[i]) {
+      groups[candidates[i]->groupKey].emplace_back(i);
+    }
+  }
+
+  // In each group, pick the prefix that saves parsing the most #include directives over all of its users
+  std::vector<PrefixPCH> pchs;
+  for (const auto& [groupKey, indices] : groups) {
+    if (indices.size() < 2) {
+      continue;
+    }
+
+    std::unordered_map<std::string, std::size_t> counts;
+    std::string                                  bestPrefix;
+    std::size_t                                  bestLength = 0;
+    std::size_t                                  bestSaved  = 0;
+    for (const auto i : indices) {
+      std::string prefix;
+      for (std::size_t k = 0; k < candidates[i]->includes.size(); k++) {
+        prefix += candidates[i]->includes[k] + '\n';
+        const std::size_t count = ++counts[prefix];
+        if (count >= 2 && count * (k + 1) > bestSaved) {
+          bestPrefix = prefix;
+          bestLength = k + 1;
+          bestSaved  = count * (k + 1);
+        }
+      }
+    }
+    if (bestLength == 0) {
+      continue;
+    }
+
+    PrefixPCH pch{nullptr, bestLength, {}, ""};
+    for (const auto i : indices) {
+      std::string prefix;
+      for (std::size_t k = 0; k < bestLength && k < candidates[i]->includes.size(); k++) {
+        prefix += candidates[i]->includes[k] + '\n';
+      }
+      if (prefix == bestPrefix) {
+        pch.users.emplace_back(i);
+      }
+    }
+    pch.candidate = &*candidates[pch.users[0]];
+    pchs.emplace_back(std::move(pch));
+  }
+
+  for (std::size_t i = 0; i < pchs.size(); i++) {
+    pool.async([&, i]() {
+      PrefixPCH& pch = pchs[i];
+      // Quoted includes in the prefix are resolved relative to the directory of the files that share it
+      std::string header;
+      std::string quoteDir;
+      for (std::size_t k = 0; k < pch.length; k++) {
+        const auto [include, includeDir] = llvm::StringRef(pch.candidate->includes[k]).split('\0');
+        header += include.str() + "\n";
+        if (!includeDir.empty()) {
+          quoteDir = includeDir.str();
+        }
+      }
+
+      // The directory belongs to this run, so the prefix header and its PCH are simply named after their index
+      const std::filesystem::path headerPath = this->dir / ("prefix-" + std::to_string(i) + ".h");
+      const std::string           pchPath    = (this->dir / ("prefix-" + std::to_string(i) + ".pch")).string();
+      {
+        std::error_code      ec;
+        llvm::raw_fd_ostream out(headerPath.string(), ec);
+        if (ec) {
+          spdlog::warn("Unable to write shared PCH header {}: {}", headerPath.string(), ec.message());
+          return;
+        }
+        out << header;
+      }
+
+      std::vector<std::string> args = pch.candidate->args;
+      args.insert(args.end(), this->includePaths.begin(), this->includePaths.end());
+      if (!quoteDir.empty()) {
+        args.insert(args.end(), {"-iquote", quoteDir});
+      }
+      args.insert(args.end(), {"-x", pch.candidate->language, headerPath.string(), "-o", pchPath});
+
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS = llvm::vfs::createPhysicalFileSystem().release();
+      FS->setCurrentWorkingDirectory(pch.candidate->directory);
+      llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(new clang::FileManager(clang::FileSystemOptions(), FS));
+
+      clang::tooling::ToolInvocation invocation(
+          args, std::make_unique<clang::GeneratePCHAction>(), fileManager.get(), this->pchOps);
+      clang::IgnoringDiagConsumer ignore;
+      invocation.setDiagnosticConsumer(&ignore);
+      if (!invocation.run()) {
+        spdlog::warn("Unable to build shared PCH {}, {} files will be parsed without it.", pchPath, pch.users.size());
+        return;
+      }
+      pch.pchPath = pchPath;
+    });
+  }
+  pool.wait();
+
+  std::size_t numFiles = 0;
+  for (const auto& pch : pchs) {
+    if (pch.pchPath.empty()) {
+      continue;
+    }
+    for (const auto i : pch.users) {
+      this->pchForFile.emplace(files[i], pch.pchPath);
+    }
+    numFiles += pch.users.size();
+    spdlog::info("Built shared PCH of {} headers for {} files.", pch.length, pch.users.size());
+  }
+  spdlog::info("{} of {} files will be parsed with a shared PCH.", numFiles, files.size());
+}
@@ -0,0 +1,55 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clang/Serialization/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "support/ArgumentProfile.hpp"
+
+namespace hdoc::indexer {
+/// @brief Precompiled headers for the include prefixes that many source files share.
+///
+/// Source files are grouped by compile command. Within each group, the run of #include directives at the top of
+/// the file that saves the most parsing is precompiled once, and every file of the group that starts with it is
+/// parsed with that PCH instead of parsing the same headers again.
+/// Declarations from a PCH are deserialized when the TU is traversed, so the matchers see them just like
+/// declarations parsed from source.
+/// Prefix headers and PCHs are written to a temporary directory of this run, which is removed along with it.
+class SharedPCH {
+public:
+  /// PCHs are built with the arguments that profile leaves of the compile commands if it's not nullptr, which
+  /// have to match the arguments that files are parsed with
+  SharedPCH(const clang::tooling::CompilationDatabase&     cmpdb,
+            const std::vector<std::string>&                includePaths,
+            std::shared_ptr<clang::PCHContainerOperations> pchOps,
+            const ArgumentProfile*                         profile);
+  ~SharedPCH();
+
+  /// @brief Find the include prefixes shared by files and build a PCH for each of them.
+  void build(const std::vector<std::string>& files, llvm::ThreadPool& pool);
+
+  /// @brief Path of the PCH that path should be parsed with, or an empty string if there is none.
+  std::string getPCHForFile(const std::string& path) const;
+
+  /// @brief Whether path is a prefix header that some SharedPCH built a PCH from. Prefix headers only exist
+  /// during a run, so they aren't dependencies of the files parsed with them, unlike the headers they include.
+  static bool isPrefixHeader(llvm::StringRef path);
+
+private:
+  const clang::tooling::CompilationDatabase&     cmpdb;
+  const std::vector<std::string>&                includePaths;
+  std::shared_ptr<clang::PCHContainerOperations> pchOps;
+  const ArgumentProfile*                         profile;
+  std::filesystem::path                          dir;        ///< Where prefix headers and PCHs are written
+  std::unordered_map<std::string, std::string>   pchForFile; ///< Source file -> PCH to parse it with
+};
+} // namespace hdoc::indexer
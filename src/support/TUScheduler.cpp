@@ -0,0 +1,189 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "support/TUScheduler.hpp"
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+void hdoc::indexer::TUDurations::load(const std::filesystem::path& path) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::ifstream               in(path);
+  Entry                       entry;
+  std::string                 file;
+  while (in >> entry.seconds >> entry.peakMemory && in.get() == ' ' && std::getline(in, file)) {
+    this->durations[file] = entry;
+  }
+}
+
+void hdoc::indexer::TUDurations::save(const std::filesystem::path& path) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::ofstream               out(path);
+  for (const auto& [file, entry] : this->durations) {
+    out << entry.seconds << ' ' << entry.peakMemory << ' ' << file << '\n';
+  }
+  if (!out) {
+    spdlog::warn("Unable to save indexing durations to {}", path.string());
+  }
+}
+
+std::optional<double> hdoc::indexer::TUDurations::get(const std::string& file) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (const auto it = this->durations.find(file); it != this->durations.end()) {
+    return it->second.seconds;
+  }
+  return std::nullopt;
+}
+
+std::optional<uint64_t> hdoc::indexer::TUDurations::getPeakMemory(const std::string& file) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (const auto it = this->durations.find(file); it != this->durations.end() && it->second.peakMemory > 0) {
+    return it->second.peakMemory;
+  }
+  return std::nullopt;
+}
+
+void hdoc::indexer::TUDurations::record(const std::string& file, const double seconds, const uint64_t peakMemory) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  Entry& entry  = this->durations[file];
+  entry.seconds = seconds;
+  if (peakMemory > 0) {
+    entry.peakMemory = peakMemory;
+  }
+}
+
+void hdoc::indexer::TUQuarantine::load(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  std::string   file;
+  while (std::getline(in, file)) {
+    if (!file.empty()) {
+      this->files.insert(file);
+    }
+  }
+}
+
+void hdoc::indexer::TUQuarantine::save(const std::filesystem::path& path) const {
+  std::ofstream out(path);
+  for (const auto& file : this->files) {
+    out << file << '\n';
+  }
+  if (!out) {
+    spdlog::warn("Unable to save the quarantined files to {}", path.string());
+  }
+}
+
+hdoc::indexer::TUScheduler::TUScheduler(const std::vector<std::string>&     files,
+                                        const hdoc::types::SchedulingPolicy policy,
+                                        const TUDurations*                  durations,
+                                        const std::size_t                   numWorkers)
+    : currentGroup(numWorkers, SIZE_MAX), numFiles(files.size()) {
+  if (policy == hdoc::types::SchedulingPolicy::Database) {
+    Group g;
+    for (const auto& file : files) {
+      g.files.emplace_back(file, 0);
+    }
+    this->groups.emplace_back(std::move(g));
+    return;
+  }
+
+  // Files without a recorded duration are estimated from their size. Durations and sizes of files that have both
+  // give the conversion factor, so that estimates and recorded durations can be compared.
+  std::vector<double> sizes(files.size(), 0);
+  std::vector<double> costs(files.size(), -1);
+  double              totalSeconds = 0;
+  double              totalSize    = 0;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    std::error_code ec;
+    sizes[i] = static_cast<double>(std::filesystem::file_size(files[i], ec));
+    if (ec) {
+      sizes[i] = 0;
+    }
+    if (const auto seconds = durations ? durations->get(files[i]) : std::nullopt) {
+      costs[i] = *seconds;
+      totalSeconds += *seconds;
+      totalSize += sizes[i];
+    }
+  }
+  const double secondsPerByte = totalSeconds > 0 && totalSize > 0 ? totalSeconds / totalSize : 1;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    if (costs[i] < 0) {
+      costs[i] = sizes[i] * secondsPerByte;
+    }
+  }
+
+  // Group by directory if requested, otherwise all files are in one group
+  std::map<std::string, Group> groupsByDir;
+  for (std::size_t i = 0; i < files.size(); i++) {
+    const std::string dir = policy == hdoc::types::SchedulingPolicy::Directory
+                                ? std::filesystem::path(files[i]).parent_path().string()
+                                : std::string();
+    Group& g = groupsByDir[dir];
+    g.files.emplace_back(files[i], costs[i]);
+    g.cost += costs[i];
+  }
+
+  // Longest first, both within groups and across groups
+  for (auto& [dir, g] : groupsByDir) {
+    std::stable_sort(
+        g.files.begin(), g.files.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    this->groups.emplace_back(std::move(g));
+  }
+  std::stable_sort(
+      this->groups.begin(), this->groups.end(), [](const Group& a, const Group& b) { return a.cost > b.cost; });
+}
+
+hdoc::indexer::TUScheduler::TUScheduler(const std::size_t numWorkers)
+    : groups(1), currentGroup(numWorkers, SIZE_MAX), open(true) {}
+
+void hdoc::indexer::TUScheduler::add(const std::string& file) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->groups.front().files.emplace_back(file, 0);
+    this->numFiles++;
+  }
+  this->added.notify_one();
+}
+
+void hdoc::indexer::TUScheduler::close() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->open = false;
+  }
+  this->added.notify_all();
+}
+
+std::optional<std::string> hdoc::indexer::TUScheduler::next(const std::size_t worker) {
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  // Files that are still being added all go into the only group
+  this->added.wait(lock, [&]() { return !this->open || !this->groups.front().files.empty(); });
+
+  // Keep working on the current group for locality, then start the most expensive group nobody has started yet.
+  // Once every group has been started, help out with whichever group has the most work left.
+  std::size_t& current = this->currentGroup[worker];
+  if (current == SIZE_MAX || this->groups[current].files.empty()) {
+    if (this->nextGroup < this->groups.size()) {
+      current = this->nextGroup++;
+    } else {
+      const auto remaining = [](const Group& g) { return g.files.empty() ? -1.0 : g.cost; };
+      const auto it        = std::max_element(this->groups.begin(),
+                                           this->groups.end(),
+                                           [&](const Group& a, const Group& b) { return remaining(a) < remaining(b); });
+      if (it == this->groups.end() || it->files.empty()) {
+        return std::nullopt;
+      }
+      current = it - this->groups.begin();
+    }
+  }
+
+  Group& g = this->groups[current];
+  if (g.files.empty()) {
+    return std::nullopt;
+  }
+  auto [file, cost] = std::move(g.files.front());
+  g.files.pop_front();
+  g.cost -= cost;
+  return file;
+}
@@ -0,0 +1,114 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types/Config.hpp"
+
+namespace hdoc::indexer {
+/// @brief How long each source file took to index and how much memory clang needed for it, recorded so that the next
+/// run can schedule files by cost and admit them within a memory budget.
+class TUDurations {
+public:
+  /// @brief Load the durations saved at path. A missing or malformed file leaves the durations empty.
+  void load(const std::filesystem::path& path);
+
+  /// @brief Save all durations to path
+  void save(const std::filesystem::path& path) const;
+
+  /// @brief Duration of indexing a file in seconds, if known
+  std::optional<double> get(const std::string& file) const;
+
+  /// @brief Peak memory of clang's data structures while indexing a file in bytes, if known
+  std::optional<uint64_t> getPeakMemory(const std::string& file) const;
+
+  /// @brief Record how long indexing a file took in seconds, and its peak memory in bytes if it was measured
+  void record(const std::string& file, const double seconds, const uint64_t peakMemory = 0);
+
+private:
+  struct Entry {
+    double   seconds    = 0;
+    uint64_t peakMemory = 0; ///< 0 if it was never measured
+  };
+
+  std::unordered_map<std::string, Entry> durations;
+  mutable std::mutex                     mutex;
+};
+
+/// @brief Files that were abandoned because they took too long, so that later runs can index them last or skip them.
+class TUQuarantine {
+public:
+  /// @brief Load the files saved at path. A missing file leaves the quarantine empty.
+  void load(const std::filesystem::path& path);
+
+  /// @brief Save all files to path
+  void save(const std::filesystem::path& path) const;
+
+  /// @brief Is the file in quarantine?
+  bool contains(const std::string& file) const { return this->files.count(file) > 0; }
+
+  /// @brief Put a file into quarantine
+  void add(const std::string& file) { this->files.insert(file); }
+
+  /// @brief Release a file from quarantine
+  void remove(const std::string& file) { this->files.erase(file); }
+
+private:
+  std::set<std::string> files;
+};
+
+/// @brief Decides which source file each worker thread indexes next.
+class TUScheduler {
+public:
+  /// @brief Prepare the order of files according to policy, using durations (if given) to estimate their cost.
+  TUScheduler(const std::vector<std::string>&     files,
+              const hdoc::types::SchedulingPolicy policy,
+              const TUDurations*                  durations,
+              const std::size_t                   numWorkers);
+
+  /// @brief Hand out files in the order they're added with add(), while they're still being added. next() waits
+  /// for more files until close() is called.
+  explicit TUScheduler(const std::size_t numWorkers);
+
+  /// @brief Add a file after all files that were added before it
+  void add(const std::string& file);
+
+  /// @brief Let next() return std::nullopt once all added files are taken
+  void close();
+
+  /// @brief The next file that worker should index, or std::nullopt once all files are taken.
+  std::optional<std::string> next(const std::size_t worker);
+
+  /// @brief Number of files that were handed to the scheduler so far
+  std::size_t getNumFiles() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->numFiles;
+  }
+
+private:
+  /// Files from the same directory (or all files), in the order they should be indexed
+  struct Group {
+    std::deque<std::pair<std::string, double>> files;    ///< Files and their estimated costs
+    double                                     cost = 0; ///< Estimated cost of the files that are left
+  };
+
+  std::vector<Group>       groups;
+  std::size_t              nextGroup = 0; ///< Groups before this one have been started by some worker
+  std::vector<std::size_t> currentGroup;  ///< Group that each worker is taking files from
+  std::size_t              numFiles = 0;
+  bool                     open     = false; ///< Are files still being added?
+  std::condition_variable  added;
+  mutable std::mutex       mutex;
+};
+} // namespace hdoc::indexer
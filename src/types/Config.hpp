@@ -17,15 +17,60 @@ enum class BinaryType {
   Server, ///< For internal hdoc usage.
 };
 
+/// @brief Order in which source files are indexed
+enum class SchedulingPolicy {
+  Database,     ///< In the order of the compilation database
+  LongestFirst, ///< Files that take longest first, so that they don't hold up the end of indexing
+  Directory,    ///< Longest first, but threads keep indexing files from the same directory while they can
+};
+
+/// @brief Whether hdoc indexes synthetic files that include the project's headers instead of its source files
+enum class HeaderOnlyMode {
+  Disabled,     ///< Index the source files of the compilation database
+  PerHeader,    ///< One synthetic file per header
+  PerDirectory, ///< One synthetic file per directory, which includes all headers in it
+};
+
+/// @brief What hdoc does with files that took longer than the timeout on an earlier run
+enum class QuarantinePolicy {
+  Deprioritize, ///< Index them after all other files
+  Skip,         ///< Don't index them
+};
+
+/// @brief What hdoc does when it's run, selected by its subcommand
+enum class Command {
+  Generate, ///< Index the project and generate its documentation (no subcommand)
+  Index,    ///< `hdoc index`: index a shard of the project's files and save the partial index
+  Merge,    ///< `hdoc merge`: merge partial indexes and generate documentation from them
+  Update,   ///< `hdoc update`: reindex the files affected by changes over partial indexes and generate documentation
+  Watch,    ///< `hdoc watch`: generate documentation and update it whenever project files change
+  Serve,    ///< `hdoc serve`: index the project and serve its documentation over HTTP, rendering pages on demand
+  Preview,  ///< `hdoc preview`: index a single file and print the pages of its symbols
+};
+
 /// @brief Stores configuration data that hdoc uses for indexing and serialization
 struct Config {
   bool                     initialized       = false; ///< Is this object initialized?
   bool                     useSystemIncludes = true;  ///< Use system compiler include paths by default
   uint32_t                 numThreads        = 0; ///< Number of threads to be used during indexing (0 == all available)
   BinaryType               binaryType        = hdoc::types::BinaryType::Full; ///< What type of hdoc is this?
+  Command                  command           = hdoc::types::Command::Generate; ///< What is hdoc run for?
+  uint32_t                 shardIndex        = 0; ///< Zero-based index of the shard of files to index
+  uint32_t                 numShards         = 1; ///< Number of shards the files are split into
+  std::filesystem::path    partialIndexPath;      ///< Where `hdoc index` saves its partial index
+  std::vector<std::filesystem::path> partialIndexPaths; ///< Partial indexes merged by `hdoc merge` or `hdoc update`
+  std::string              changedSinceRef;       ///< Git ref that `hdoc update` finds changed files relative to
+  std::vector<std::string> changedFiles;          ///< Changed files `hdoc update` reindexes for, relative to rootDir
+  std::string              serveHost      = "localhost";       ///< Host `hdoc serve` listens on
+  uint32_t                 servePort      = 8000;              ///< Port `hdoc serve` listens on
+  uint64_t                 serveCacheSize = 256 * 1024 * 1024; ///< Bytes of rendered pages `hdoc serve` keeps
+  std::filesystem::path    previewPath;              ///< Absolute path of the file `hdoc preview` indexes
+  std::vector<std::string> previewFlags;             ///< Flags `hdoc preview` uses instead of its compile command
+  bool                     previewFromStdin = false; ///< Does `hdoc preview` read the file from stdin?
   std::filesystem::path    rootDir;                      ///< Path to the root of the repo directory where .hdoc.toml is
   std::filesystem::path    compileCommandsJSON;          ///< Path to compile_commands.json
   std::filesystem::path    outputDir;                    ///< Path of where documentation is saved
+  std::filesystem::path    cacheDir;                     ///< Path of the index cache (empty == caching disabled)
   std::string              projectName;                  ///< Name of the project
   std::string              projectVersion;               ///< Project version
   std::string              timestamp;                    ///< Timestamp of this run
@@ -37,11 +82,31 @@ struct Config {
   std::vector<std::string> ignoreNamespaces;             ///< Namespaces from which matches should be ignored
   std::vector<std::string> detailNamespaces;             ///< Namespaces which should be considered "detail" namespaces
   bool                     ignorePrivateMembers = false; ///< Should private members of records be ignored?
+  bool                     skipIndexedFiles     = true;  ///< Skip decls from files another TU already indexed?
+  bool                     useSharedPCH         = false; ///< Precompile include prefixes shared by many files?
+  bool                     skipFunctionBodies   = false; ///< Let clang skip parsing function bodies where possible?
+  bool                     reusePrebuilt        = true;  ///< Reuse the up-to-date PCHs and module files of the build?
+  bool                     deduplicateCommands  = false; ///< Only parse a file once per distinct set of its flags?
+  SchedulingPolicy         schedulingPolicy = SchedulingPolicy::LongestFirst; ///< Order in which files are indexed
+  bool                     minimalTUSet     = false; ///< Only index files needed to cover every project header?
+  HeaderOnlyMode           headerOnlyMode   = HeaderOnlyMode::Disabled; ///< Index synthetic files of headers?
+  std::vector<std::string> headerDirs;                   ///< Directories with the headers to index in header-only mode
+  uint32_t                 numProcesses = 0; ///< Index in this many worker processes (0 == index with threads)
+  uint64_t                 maxWorkerRSS = 0; ///< Restart a worker once its RSS exceeds this many bytes (0 == never)
+  uint64_t                 memoryBudget = 0; ///< Bytes that files parsed at the same time may use (0 == unlimited)
+  double                   tuTimeout    = 0; ///< Abandon files that take longer than this many seconds (0 == never)
+  QuarantinePolicy quarantinePolicy = QuarantinePolicy::Deprioritize; ///< What to do with files that timed out before
+  std::filesystem::path    quarantinePath; ///< File that remembers the files that timed out (empty == not remembered)
+  bool                     stripArguments = false; ///< Remove compiler arguments that don't affect declarations?
+  std::vector<std::string> keepArguments;          ///< Patterns of arguments that are never removed
+  std::vector<std::string> extraStripArguments;    ///< Patterns of arguments that are removed in any case
   std::filesystem::path    homepage;                     ///< Path to "homepage" markdown file
   std::vector<std::filesystem::path> mdPaths;            ///< Paths to markdown pages
 
-  uint32_t debugLimitNumIndexedFiles;    ///< Limit the number of files to index (0 == index all files)
-  bool     debugDumpJSONPayload = false; ///< Dump JSON payload to current working directory
+  uint32_t debugLimitNumIndexedFiles;       ///< Limit the number of files to index (0 == index all files)
+  bool     debugDumpJSONPayload    = false; ///< Dump JSON payload to current working directory
+  bool     debugVerifyMinimalTUSet = false; ///< Also index files left out by minimalTUSet, report missing symbols
+  bool     debugCompareArguments   = false; ///< Also parse files with their original arguments, report parse times
 
   /// @brief Returns a string with the form "PROJECT_NAME PROJECT_VERSION documentation"
   /// if this->projectVersion has a value, otherwise returns "PROJECT_NAME documentation".
@@ -3,45 +3,78 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "types/Symbols.hpp"
 
 namespace hdoc::types {
-/// @brief Stores values for a given type of Symbol
+/// @brief Thread-safe set of SymbolIDs shared by several Databases, so that only the first one to claim a symbol
+/// builds it. The set is split into independently locked stripes so that threads rarely wait on each other.
+class SymbolClaims {
+public:
+  /// @brief Claim the given SymbolID. Returns false if it was already claimed.
+  bool claim(const hdoc::types::SymbolID& id) {
+    Stripe&                     stripe = this->stripes[id.raw() % kNumStripes];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    return stripe.ids.insert(id.raw()).second;
+  }
+
+private:
+  static constexpr std::size_t kNumStripes = 64;
+
+  /// Aligned to a cache line so that threads locking neighboring stripes don't contend either
+  struct alignas(64) Stripe {
+    std::mutex                   mutex;
+    std::unordered_set<uint64_t> ids;
+  };
+  std::array<Stripe, kNumStripes> stripes;
+};
+
+/// @brief Stores values for a given type of Symbol.
+/// A Database is only ever used by one thread at a time. Threads that index in parallel each use their own
+/// Database and share a SymbolClaims between them, and their Databases are merged once they're done.
 template <typename T> struct Database {
-  std::atomic<uint32_t>                        numMatches = 0; ///< Number of matches
-  std::unordered_map<hdoc::types::SymbolID, T> entries;        ///< Hashmap that stores the entries
+  std::atomic<uint32_t>                        numMatches = 0;       ///< Number of matches
+  std::unordered_map<hdoc::types::SymbolID, T> entries;              ///< Hashmap that stores the entries
+  SymbolClaims*                                claims     = nullptr; ///< Claims shared with other Databases, if any
 
-  /// @brief Reserve a space for the given SymbolID, to be updated later
-  T& reserve(const hdoc::types::SymbolID& id) {
-    this->mutex.lock();
-    this->entries.insert(std::make_pair(id, T()));
-    this->mutex.unlock();
-    return this->entries[id];
+  /// @brief Claim the given SymbolID for this Database, to be updated later.
+  /// Returns false if it's already in this Database or was claimed through the shared claims.
+  bool claim(const hdoc::types::SymbolID& id) {
+    if (this->contains(id)) {
+      return false;
+    }
+    return this->claims == nullptr || this->claims->claim(id);
   }
 
   /// @brief Update the entry for a given SymbolID
-  void update(const hdoc::types::SymbolID& id, const T& symbol) {
-    this->mutex.lock();
-    this->entries[id] = symbol;
-    this->mutex.unlock();
+  void update(const hdoc::types::SymbolID& id, T symbol) {
+    this->entries.insert_or_assign(id, std::move(symbol));
   }
 
   /// @brief Check if the Database contains a key
   bool contains(const hdoc::types::SymbolID& id) const {
-    this->mutex.lock();
-    bool res = !(this->entries.find(id) == this->entries.end());
-    this->mutex.unlock();
-    return res;
+    return this->entries.find(id) != this->entries.end();
+  }
+
+  /// @brief Move all entries from other that aren't already in this Database into it.
+  /// Entries that are already present are kept as-is, so the first writer of a symbol wins.
+  void merge(Database<T>&& other) {
+    this->numMatches += other.numMatches;
+    this->entries.merge(other.entries);
   }
 
-  /// Locks the database during operations that may cause mutations
-  mutable std::mutex mutex;
+  /// @brief Replace all entries with copies of the entries in other. The claims aren't copied.
+  void assign(const Database<T>& other) {
+    this->numMatches = other.numMatches.load();
+    this->entries    = other.entries;
+  }
 };
 
 /// @brief hdoc's index, aggregating information for all of the symbols in a codebase
@@ -51,5 +84,32 @@ struct Index {
   Database<hdoc::types::EnumSymbol>      enums;
   Database<hdoc::types::NamespaceSymbol> namespaces;
   Database<hdoc::types::AliasSymbol>     aliases;
+
+  /// @brief Make all Databases claim symbols through claims, which other Indexes may share
+  void shareClaims(SymbolClaims* claims) {
+    this->functions.claims  = claims;
+    this->records.claims    = claims;
+    this->enums.claims      = claims;
+    this->namespaces.claims = claims;
+    this->aliases.claims    = claims;
+  }
+
+  /// @brief Move all of the symbols from other into this Index, keeping existing symbols on conflicts.
+  void merge(Index&& other) {
+    this->functions.merge(std::move(other.functions));
+    this->records.merge(std::move(other.records));
+    this->enums.merge(std::move(other.enums));
+    this->namespaces.merge(std::move(other.namespaces));
+    this->aliases.merge(std::move(other.aliases));
+  }
+
+  /// @brief Replace all symbols with copies of the symbols in other.
+  void assign(const Index& other) {
+    this->functions.assign(other.functions);
+    this->records.assign(other.records);
+    this->enums.assign(other.enums);
+    this->namespaces.assign(other.namespaces);
+    this->aliases.assign(other.aliases);
+  }
 };
 } // namespace hdoc::types
@@ -3,27 +3,35 @@
 
 #include "tests/TestUtils.hpp"
 
-#include "clang/ASTMatchers/ASTMatchFinder.h"
-#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/FrontendAction.h"
 #include "clang/Tooling/Tooling.h"
 
-#include "indexer/Matchers.hpp"
+#include "indexer/IndexConsumer.hpp"
+#include "serde/BinarySerializer.hpp"
 #include "types/Symbols.hpp"
 
-void runOverCode(const std::string_view code, hdoc::types::Index& index, const hdoc::types::Config cfg) {
-  clang::ast_matchers::MatchFinder          Finder;
-  hdoc::indexer::matchers::FunctionMatcher  FunctionFinder(&index, &cfg);
-  hdoc::indexer::matchers::RecordMatcher    RecordFinder(&index, &cfg);
-  hdoc::indexer::matchers::EnumMatcher      EnumFinder(&index, &cfg);
-  hdoc::indexer::matchers::NamespaceMatcher NamespaceFinder(&index, &cfg);
+namespace {
+/// Indexes the code with the same consumer hdoc uses for every TU
+class TestIndexAction : public clang::ASTFrontendAction {
+public:
+  TestIndexAction(hdoc::types::Index* index, const hdoc::types::Config* cfg) : index(index), cfg(cfg) {}
 
-  Finder.addMatcher(FunctionFinder.getMatcher(), &FunctionFinder);
-  Finder.addMatcher(RecordFinder.getMatcher(), &RecordFinder);
-  Finder.addMatcher(EnumFinder.getMatcher(), &EnumFinder);
-  Finder.addMatcher(NamespaceFinder.getMatcher(), &NamespaceFinder);
+protected:
+  std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance&, llvm::StringRef) override {
+    return std::make_unique<hdoc::indexer::IndexConsumer>(this->index, this->cfg, nullptr, nullptr);
+  }
 
-  std::unique_ptr<clang::tooling::FrontendActionFactory> Factory(clang::tooling::newFrontendActionFactory(&Finder));
-  clang::tooling::runToolOnCode(Factory->create(), code);
+private:
+  hdoc::types::Index*        index;
+  const hdoc::types::Config* cfg;
+};
+} // namespace
+
+void runOverCode(const std::string_view          code,
+                 hdoc::types::Index&             index,
+                 const hdoc::types::Config       cfg,
+                 const std::vector<std::string>& args) {
+  clang::tooling::runToolOnCodeWithArgs(std::make_unique<TestIndexAction>(&index, &cfg), code, args);
 }
 
 void checkIndexSizes(const hdoc::types::Index& index,
@@ -36,3 +44,28 @@ void checkIndexSizes(const hdoc::types::Index& index,
   CHECK(index.enums.entries.size() == enumsSize);
   CHECK(index.namespaces.entries.size() == namespacesSize);
 }
+
+/// Check that every symbol in db has an identical counterpart in db2.
+/// Symbols are compared by serializing each of them on its own, which covers every field.
+template <typename T>
+static void checkDatabasesEqual(const hdoc::types::Database<T>& db,
+                                const hdoc::types::Database<T>& db2,
+                                hdoc::types::Database<T> hdoc::types::Index::*member) {
+  CHECK(db.entries.size() == db2.entries.size());
+  for (const auto& [k, v] : db.entries) {
+    REQUIRE(db2.contains(k));
+    hdoc::types::Index a;
+    hdoc::types::Index b;
+    (a.*member).entries.emplace(k, v);
+    (b.*member).entries.emplace(k, db2.entries.at(k));
+    CHECK(hdoc::serde::serializeToBinary(a) == hdoc::serde::serializeToBinary(b));
+  }
+}
+
+void checkIndexesEqual(const hdoc::types::Index& index, const hdoc::types::Index& index2) {
+  checkDatabasesEqual(index.functions, index2.functions, &hdoc::types::Index::functions);
+  checkDatabasesEqual(index.records, index2.records, &hdoc::types::Index::records);
+  checkDatabasesEqual(index.enums, index2.enums, &hdoc::types::Index::enums);
+  checkDatabasesEqual(index.namespaces, index2.namespaces, &hdoc::types::Index::namespaces);
+  checkDatabasesEqual(index.aliases, index2.aliases, &hdoc::types::Index::aliases);
+}
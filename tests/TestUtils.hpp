@@ -9,10 +9,12 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
-void runOverCode(const std::string_view    code,
-                 hdoc::types::Index&       index,
-                 const hdoc::types::Config cfg = hdoc::types::Config());
+void runOverCode(const std::string_view          code,
+                 hdoc::types::Index&             index,
+                 const hdoc::types::Config       cfg  = hdoc::types::Config(),
+                 const std::vector<std::string>& args = {});
 
 void checkIndexSizes(const hdoc::types::Index& index,
                      const uint32_t            recordsSize,
@@ -20,6 +22,9 @@ void checkIndexSizes(const hdoc::types::Index& index,
                      const uint32_t            enumsSize,
                      const uint32_t            namespacesSize);
 
+/// Check that both indexes contain identical symbols. Match counts aren't compared.
+void checkIndexesEqual(const hdoc::types::Index& index, const hdoc::types::Index& index2);
+
 /// Get an element in the database by its name, used in the unit tests when we have multiple symbols.
 /// This obviously doesn't work when you have multiple items in the database with the same name.
 /// Don't use this for anything outside of the tests, which are a strictly-controlled environment.
@@ -0,0 +1,71 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "serde/BinarySerializer.hpp"
+#include "tests/TestUtils.hpp"
+
+#include <string>
+#include <vector>
+
+#include "doctest.h"
+
+TEST_CASE("Check if the Index is the same after binary serde roundtrip") {
+  std::vector<std::string> inputs = {
+      R"(
+        /// @brief A namespace
+        namespace ns {
+          /// @brief Foo is a class
+          /// @tparam T some type
+          template <typename T, int N = 3>
+          class Foo : public Bar {
+          public:
+            /// The value
+            T value = T();
+            static int count;
+            /// @brief Get the value
+            /// @param scale how much to scale by
+            /// @returns the scaled value
+            [[nodiscard]] T get(int scale = 2) const & noexcept { return value; }
+            virtual ~Foo();
+          private:
+            int secret;
+          };
+        }
+      )",
+      R"(
+        enum class Color : int {
+          Red = -1, ///< red
+          Green,    ///< green
+          Blue = 42,
+        };
+        struct Base {};
+        struct Derived : protected Base {
+          using Alias = Base;
+          friend void hidden(Derived&) {}
+        };
+        static constexpr int square(const int x) { return x * x; }
+        auto trailing(int a, ...) -> int;
+      )",
+  };
+
+  for (const std::string_view testCase : inputs) {
+    hdoc::types::Index index;
+    runOverCode(testCase, index);
+
+    const std::string  serialized = hdoc::serde::serializeToBinary(index);
+    hdoc::types::Index index2;
+    REQUIRE(hdoc::serde::deserializeFromBinary(serialized, index2));
+
+    checkIndexesEqual(index, index2);
+    CHECK(index.functions.numMatches == index2.functions.numMatches);
+    CHECK(index.records.numMatches == index2.records.numMatches);
+    CHECK(index.enums.numMatches == index2.enums.numMatches);
+    CHECK(index.namespaces.numMatches == index2.namespaces.numMatches);
+    CHECK(index.aliases.numMatches == index2.aliases.numMatches);
+
+    // Truncated payloads must be rejected rather than producing partially filled symbols
+    hdoc::types::Index index3;
+    CHECK(hdoc::serde::deserializeFromBinary(std::string_view(serialized).substr(0, serialized.size() - 1), index3) ==
+          false);
+  }
+}
@@ -0,0 +1,140 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/HeaderOnlyDatabase.hpp"
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+/// A project with two header directories, an ignored header, and a source file that defines FEATURE
+static std::unique_ptr<clang::tooling::CompilationDatabase> createProject(const std::filesystem::path& dir) {
+  std::filesystem::create_directories(dir / "include" / "sub");
+  std::filesystem::create_directories(dir / "include" / "detail");
+  std::filesystem::create_directories(dir / "src");
+  std::ofstream(dir / "include" / "a.hpp") << "#pragma once\n#ifdef FEATURE\nclass A {};\n#endif\n";
+  std::ofstream(dir / "include" / "b.hpp") << "#pragma once\n#include \"a.hpp\"\nvoid useA(A& a);\n";
+  std::ofstream(dir / "include" / "sub" / "c.hpp") << "#pragma once\nenum class C { X };\n";
+  std::ofstream(dir / "include" / "detail" / "d.hpp") << "#pragma once\nvoid detailOnly();\n";
+  std::ofstream(dir / "src" / "main.cpp") << "#include \"b.hpp\"\nvoid sourceOnly() {}\n";
+
+  const std::string json = "[{\"directory\": \"" + dir.string() +
+                           "\", \"command\": \"clang++ -std=c++17 -DFEATURE -Iinclude -c src/main.cpp -o main.o\", "
+                           "\"file\": \"src/main.cpp\"}]";
+  std::string err;
+  return clang::tooling::JSONCompilationDatabase::loadFromBuffer(
+      json, err, clang::tooling::JSONCommandLineSyntax::Gnu);
+}
+
+TEST_CASE("Header-only mode creates one synthetic file per header or per directory") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-header-only-files";
+  const auto                  cmpdb = createProject(dir);
+  REQUIRE(cmpdb != nullptr);
+
+  hdoc::types::Config cfg;
+  cfg.rootDir     = dir;
+  cfg.headerDirs  = {"include"};
+  cfg.ignorePaths = {"detail"};
+
+  cfg.headerOnlyMode   = hdoc::types::HeaderOnlyMode::PerHeader;
+  const auto perHeader = hdoc::indexer::HeaderOnlyDatabase::create(*cmpdb, &cfg);
+  REQUIRE(perHeader != nullptr);
+  CHECK(perHeader->getAllFiles().size() == 3);
+
+  cfg.headerOnlyMode      = hdoc::types::HeaderOnlyMode::PerDirectory;
+  const auto perDirectory = hdoc::indexer::HeaderOnlyDatabase::create(*cmpdb, &cfg);
+  REQUIRE(perDirectory != nullptr);
+  CHECK(perDirectory->getAllFiles().size() == 2);
+
+  // Synthetic files borrow the flags of the source file, without its input and output
+  for (const auto& file : perDirectory->getAllFiles()) {
+    const auto cmds = perDirectory->getCompileCommands(file);
+    REQUIRE(cmds.size() == 1);
+    const auto& args = cmds[0].CommandLine;
+    CHECK(std::find(args.begin(), args.end(), "-DFEATURE") != args.end());
+    CHECK(std::find(args.begin(), args.end(), "src/main.cpp") == args.end());
+    CHECK(std::find(args.begin(), args.end(), "main.o") == args.end());
+    CHECK(args.back() == file);
+  }
+
+  cfg.headerDirs = {"does-not-exist"};
+  CHECK(hdoc::indexer::HeaderOnlyDatabase::create(*cmpdb, &cfg) == nullptr);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Synthetic files are removed with the database unless the index cache keeps them") {
+  const std::filesystem::path dir   = std::filesystem::temp_directory_path() / "hdoc-test-header-only-cleanup";
+  const auto                  cmpdb = createProject(dir);
+  REQUIRE(cmpdb != nullptr);
+
+  hdoc::types::Config cfg;
+  cfg.rootDir        = dir;
+  cfg.headerDirs     = {"include"};
+  cfg.headerOnlyMode = hdoc::types::HeaderOnlyMode::PerDirectory;
+
+  auto temporary = hdoc::indexer::HeaderOnlyDatabase::create(*cmpdb, &cfg);
+  REQUIRE(temporary != nullptr);
+  const std::filesystem::path tempDir = std::filesystem::path(temporary->getAllFiles().front()).parent_path();
+  CHECK(std::filesystem::is_directory(tempDir));
+  temporary.reset();
+  CHECK(!std::filesystem::exists(tempDir));
+
+  cfg.cacheDir = dir / "cache";
+  auto cached  = hdoc::indexer::HeaderOnlyDatabase::create(*cmpdb, &cfg);
+  REQUIRE(cached != nullptr);
+  const std::string file = cached->getAllFiles().front();
+  CHECK(std::filesystem::path(file).parent_path() == cfg.cacheDir / "header-only");
+  cached.reset();
+  CHECK(std::filesystem::exists(file));
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Header-only mode indexes headers but not source files") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-header-only-index";
+  const auto                  jsonCmpdb = createProject(dir);
+  REQUIRE(jsonCmpdb != nullptr);
+
+  hdoc::types::Config cfg;
+  cfg.rootDir        = dir;
+  cfg.headerDirs     = {"include"};
+  cfg.ignorePaths    = {"detail"};
+  cfg.headerOnlyMode = hdoc::types::HeaderOnlyMode::PerHeader;
+  const auto cmpdb   = hdoc::indexer::HeaderOnlyDatabase::create(*jsonCmpdb, &cfg);
+  REQUIRE(cmpdb != nullptr);
+
+  const std::vector<std::string>  includePaths = {};
+  llvm::ThreadPool                pool;
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(*cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.execute(cmpdb->getAllFiles(), [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+  });
+
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+
+  // A only exists with the flags of the source file
+  checkIndexSizes(index, 1, 1, 1, 0);
+  CHECK(findByName(index.records, "A").has_value());
+  CHECK(findByName(index.functions, "useA").has_value());
+  CHECK(findByName(index.enums, "C").has_value());
+  CHECK(!findByName(index.functions, "sourceOnly").has_value());
+  CHECK(!findByName(index.functions, "detailOnly").has_value());
+
+  std::filesystem::remove_all(dir);
+}
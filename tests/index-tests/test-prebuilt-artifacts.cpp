@@ -0,0 +1,89 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+#include "support/PrebuiltArtifacts.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+using Args = std::vector<std::string>;
+
+/// Precompile header into pch, like a build would
+static bool buildPCH(const std::filesystem::path& header, const std::filesystem::path& pch) {
+  auto pchOps = std::make_shared<clang::PCHContainerOperations>();
+  llvm::IntrusiveRefCntPtr<clang::FileManager> fileManager(new clang::FileManager(clang::FileSystemOptions()));
+  clang::tooling::ToolInvocation               invocation(
+      {"clang++", "-std=c++17", "-x", "c++-header", header.string(), "-o", pch.string()},
+      std::make_unique<clang::GeneratePCHAction>(),
+      fileManager.get(),
+      pchOps);
+  return invocation.run();
+}
+
+TEST_CASE("Up-to-date PCHs of the build are reused, stale ones are replaced by their headers") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-prebuilt";
+  std::filesystem::create_directories(dir);
+  const std::filesystem::path header = dir / "common.hpp";
+  const std::filesystem::path pch    = dir / "common.hpp.pch";
+  std::ofstream(header) << "#pragma once\n/// @brief A class from the PCH\nclass Shared {};\n";
+  std::ofstream(dir / "a.cpp") << "void fromA(Shared& s);\n";
+  std::ofstream(dir / "bogus.pch") << "not a PCH";
+  REQUIRE(buildPCH(header, pch));
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17", "-include-pch", pch.string()});
+  const std::vector<std::string>                 includePaths = {};
+  auto                                           pchOps       = std::make_shared<clang::PCHContainerOperations>();
+  {
+    hdoc::indexer::PrebuiltArtifacts prebuilt(cmpdb, includePaths, pchOps);
+    const Args args = prebuilt.apply({"clang++", "-include-pch", pch.string(), "a.cpp"}, dir.string());
+    CHECK(args == Args{"clang++", "-include-pch", pch.string(), "a.cpp"});
+    CHECK(hdoc::indexer::PrebuiltArtifacts::usesPCH(args));
+
+    // Headers that have a PCH next to them are parsed with it, like clang's driver would
+    CHECK(prebuilt.apply({"clang++", "-include", "common.hpp", "a.cpp"}, dir.string()) ==
+          Args{"clang++", "-include-pch", pch.string(), "a.cpp"});
+
+    // Files that aren't PCHs can't be replaced, and module files are never written next to the build's
+    CHECK(prebuilt.apply({"clang++", "-include-pch", "bogus.pch", "-fmodule-output=a.pcm", "a.cpp"}, dir.string()) ==
+          Args{"clang++", "a.cpp"});
+  }
+
+  // Changing the header makes the PCH stale
+  std::filesystem::last_write_time(header, std::filesystem::last_write_time(pch) + std::chrono::hours(1));
+  {
+    hdoc::indexer::PrebuiltArtifacts prebuilt(cmpdb, includePaths, pchOps);
+    const Args args = prebuilt.apply({"clang++", "-include-pch", pch.string(), "a.cpp"}, dir.string());
+    CHECK(args == Args{"clang++", "-include", header.string(), "a.cpp"});
+    CHECK(!hdoc::indexer::PrebuiltArtifacts::usesPCH(args));
+    CHECK(prebuilt.apply({"clang++", "-include", "common.hpp", "a.cpp"}, dir.string()) ==
+          Args{"clang++", "-Xclang", "-include", "-Xclang", "common.hpp", "a.cpp"});
+
+    // The file is still parsed with everything that was in the PCH
+    const hdoc::types::Config       cfg;
+    llvm::ThreadPool                pool;
+    hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+    hdoc::indexer::ParallelExecutor tool(
+        cmpdb, includePaths, pool, pchOps, nullptr, hdoc::types::SchedulingPolicy::Database, nullptr);
+    tool.usePrebuiltArtifacts(&prebuilt);
+    tool.execute({(dir / "a.cpp").string()}, [&](const std::string& path) {
+      return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+    });
+
+    hdoc::types::Index index;
+    shards.mergeInto(index, pool);
+    CHECK(findByName(index.records, "Shared").has_value());
+    CHECK(findByName(index.functions, "fromA").has_value());
+  }
+
+  std::filesystem::remove_all(dir);
+}
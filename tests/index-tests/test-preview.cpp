@@ -0,0 +1,78 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "llvm/Support/ThreadPool.h"
+
+#include "serde/Preview.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+/// A header without a compile command of its own, which includes a header whose symbols aren't previewed
+static hdoc::types::Config createProject(const std::filesystem::path& dir) {
+  std::filesystem::create_directories(dir / "include");
+  std::filesystem::create_directories(dir / "src");
+  std::ofstream(dir / "include" / "base.hpp") << "#pragma once\n/// A base\nstruct Base {};\n";
+  std::ofstream(dir / "include" / "api.hpp")
+      << "#pragma once\n#include \"base.hpp\"\n#ifdef FEATURE\n/// A record\nstruct Derived : Base {\n"
+         "  /// A method\n  void method();\n};\n#endif\n/// A function\ninline int twice(int x) { return x * 2; }\n"
+         "namespace detail_ns { void hidden(); }\n";
+  std::ofstream(dir / "src" / "main.cpp") << "#include \"api.hpp\"\n";
+  std::ofstream(dir / "compile_commands.json")
+      << "[{\"directory\": \"" << dir.string()
+      << "\", \"command\": \"clang++ -std=c++17 -DFEATURE -Iinclude -c src/main.cpp -o main.o\", "
+         "\"file\": \"src/main.cpp\"}]";
+
+  hdoc::types::Config cfg;
+  cfg.rootDir             = dir;
+  cfg.compileCommandsJSON = dir / "compile_commands.json";
+  cfg.ignoreNamespaces    = {"detail_ns"};
+  return cfg;
+}
+
+/// The HTML of the only page in pages whose name starts with prefix
+static std::string getPage(const std::map<std::string, std::string>& pages, const char prefix) {
+  std::string page;
+  for (const auto& [name, html] : pages) {
+    if (name[0] == prefix) {
+      CHECK(page.empty());
+      page = html;
+    }
+  }
+  return page;
+}
+
+TEST_CASE("Previews render the pages of the symbols declared in a header") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-preview";
+  const hdoc::types::Config   cfg = createProject(dir);
+  llvm::ThreadPool            pool;
+
+  // The header borrows the command of the source file, which defines FEATURE. Methods are shown on the page of their
+  // record, and the symbols of included headers and ignored namespaces don't get a page.
+  const auto pages = hdoc::serde::previewFile((dir / "include" / "api.hpp").string(), {}, std::nullopt, cfg, pool);
+  REQUIRE(pages);
+  CHECK(pages->size() == 2);
+  CHECK(getPage(*pages, 'r').find("Derived") != std::string::npos);
+  CHECK(getPage(*pages, 'r').find("A method") != std::string::npos);
+  CHECK(getPage(*pages, 'f').find("twice") != std::string::npos);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Previews of unsaved buffers use the given flags") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-preview-buffer";
+  const hdoc::types::Config   cfg = createProject(dir);
+  llvm::ThreadPool            pool;
+
+  // The buffer replaces what's on disk, and FEATURE isn't defined without the compile command
+  const std::string code =
+      "#include \"base.hpp\"\n#ifdef FEATURE\nstruct Hidden {};\n#endif\n/// An enum\nenum E { A };\n";
+  const auto pages = hdoc::serde::previewFile((dir / "include" / "api.hpp").string(), {"-std=c++17"}, code, cfg, pool);
+  REQUIRE(pages);
+  CHECK(pages->size() == 1);
+  CHECK(getPage(*pages, 'e').find("An enum") != std::string::npos);
+  std::filesystem::remove_all(dir);
+}
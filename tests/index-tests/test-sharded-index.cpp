@@ -0,0 +1,73 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/Indexer.hpp"
+#include "serde/BinarySerializer.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("Shards split the files into disjoint ranges that cover all of them") {
+  const std::vector<std::string> files = {"e.cpp", "a.cpp", "d.cpp", "c.cpp", "b.cpp", "g.cpp", "f.cpp"};
+  std::vector<std::string>       all;
+  for (uint32_t k = 0; k < 3; k++) {
+    const std::vector<std::string> shard = hdoc::indexer::selectShard(files, k, 3);
+    CHECK(shard.size() >= 2);
+    CHECK(shard.size() <= 3);
+    all.insert(all.end(), shard.begin(), shard.end());
+  }
+  CHECK(all == std::vector<std::string>{"a.cpp", "b.cpp", "c.cpp", "d.cpp", "e.cpp", "f.cpp", "g.cpp"});
+
+  // The order of the compilation database doesn't matter
+  std::vector<std::string> reversed(files.rbegin(), files.rend());
+  CHECK(hdoc::indexer::selectShard(reversed, 1, 3) == hdoc::indexer::selectShard(files, 1, 3));
+  CHECK(hdoc::indexer::selectShard(files, 0, 1).size() == files.size());
+}
+
+TEST_CASE("Merged partial indexes are postprocessed like a single index") {
+  const std::string_view codeA = R"(
+    namespace core {
+      /// @brief Declared by both shards
+      class Shared {};
+      class OnlyA {};
+    }
+  )";
+  const std::string_view codeB = R"(
+    namespace core {
+      /// @brief Declared by both shards
+      class Shared {};
+      enum class OnlyB { X };
+    }
+  )";
+
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-sharded-index";
+  std::filesystem::create_directories(dir);
+  const std::vector<std::string_view> codes = {codeA, codeB};
+  for (std::size_t i = 0; i < codes.size(); i++) {
+    hdoc::types::Index partial;
+    runOverCode(codes[i], partial);
+    std::ofstream(dir / std::to_string(i), std::ios::binary) << hdoc::serde::serializeToBinary(partial);
+  }
+
+  const hdoc::types::Config cfg;
+  llvm::ThreadPool          pool;
+  hdoc::indexer::Indexer    indexer(&cfg, pool);
+  CHECK(indexer.loadPartialIndex(dir / "0"));
+  CHECK(indexer.loadPartialIndex(dir / "1"));
+  CHECK(!indexer.loadPartialIndex(dir / "missing"));
+  indexer.resolveNamespaces();
+
+  const hdoc::types::Index* index = indexer.dump();
+  checkIndexSizes(*index, 2, 0, 1, 1);
+  const auto ns = findByName(index->namespaces, "core");
+  REQUIRE(ns.has_value());
+  CHECK(ns->records.size() == 2);
+  CHECK(ns->enums.size() == 1);
+
+  std::filesystem::remove_all(dir);
+}
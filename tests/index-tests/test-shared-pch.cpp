@@ -0,0 +1,70 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+#include "support/SharedPCH.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+TEST_CASE("Symbols from a shared PCH are indexed") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-shared-pch";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "common.hpp") << R"(
+    #pragma once
+    namespace core {
+      /// @brief A shared class
+      class Shared {
+      public:
+        void method();
+      };
+      enum class Kind { A, B };
+    }
+  )";
+  std::ofstream(dir / "a.cpp") << "#include \"common.hpp\"\nvoid fromA(core::Shared& s);\n";
+  std::ofstream(dir / "b.cpp") << "#include \"common.hpp\"\nvoid fromB(core::Kind k);\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17"});
+  const std::vector<std::string>                 files        = {(dir / "a.cpp").string(), (dir / "b.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  auto                     pchOps = std::make_shared<clang::PCHContainerOperations>();
+  auto                     pch    = std::make_unique<hdoc::indexer::SharedPCH>(cmpdb, includePaths, pchOps, nullptr);
+  pch->build(files, pool);
+  const std::string pchPath = pch->getPCHForFile(files[0]);
+  CHECK(pchPath != "");
+  CHECK(pchPath == pch->getPCHForFile(files[1]));
+
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(
+      cmpdb, includePaths, pool, pchOps, pch.get(), hdoc::types::SchedulingPolicy::Database, nullptr);
+  tool.execute(files, [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+  });
+
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+
+  // Shared, Shared::method, Kind, core, and both functions declared after the prefix
+  checkIndexSizes(index, 1, 3, 1, 1);
+  CHECK(findByName(index.records, "Shared").has_value());
+  CHECK(findByName(index.functions, "fromA").has_value());
+  CHECK(findByName(index.functions, "fromB").has_value());
+
+  // The PCH and its prefix header are removed along with their directory
+  const std::filesystem::path pchDir = std::filesystem::path(pchPath).parent_path();
+  CHECK(std::filesystem::is_directory(pchDir));
+  pch.reset();
+  CHECK(!std::filesystem::exists(pchDir));
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,65 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+static const std::vector<std::string> skipFunctionBodies = {"-Xclang", "-skip-function-bodies"};
+
+TEST_CASE("Skipping function bodies doesn't change the Index") {
+  const std::vector<std::string> inputs = {
+      R"(
+        namespace ns {
+          /// @brief Foo is a class
+          template <typename T>
+          class Foo {
+          public:
+            /// @brief Get the value
+            /// @param scale how much to scale by
+            T get(int scale = 2) const { T t = value; for (int i = 0; i < scale; i++) { t += value; } return t; }
+            Foo() : value() {}
+          private:
+            T value;
+          };
+
+          /// @brief A function with a body
+          inline int add(int a, int b = 3) { Foo<int> f; return a + b + f.get(); }
+        }
+      )",
+      R"(
+        struct Point {
+          int x;
+          int y;
+          /// Members whose bodies can't be skipped
+          constexpr int sum() const { return x + y; }
+          auto scaled(int s) const { return Point{x * s, y * s}; }
+          decltype(auto) ref() { return (x); }
+        };
+
+        /// @brief Deduced return types depend on the body
+        auto makePoint() { return Point{1, 2}; }
+        template <typename T> auto twice(T t) { return t + t; }
+        static_assert(Point{1, 2}.sum() == 3);
+      )",
+      R"(
+        enum class Color { Red, Green };
+        /// @brief A function with local variables and control flow in its body
+        Color pick(int n) {
+          Color c = Color::Red;
+          for (int i = 0; i < n; i++) {
+            c = c == Color::Red ? Color::Green : Color::Red;
+          }
+          return c;
+        }
+      )",
+  };
+
+  for (const std::string_view testCase : inputs) {
+    hdoc::types::Index index;
+    runOverCode(testCase, index);
+
+    hdoc::types::Index skippedIndex;
+    runOverCode(testCase, skippedIndex, hdoc::types::Config(), skipFunctionBodies);
+
+    checkIndexesEqual(index, skippedIndex);
+  }
+}
@@ -0,0 +1,152 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace {
+/// Gets stuck while parsing hang.cpp, like clang inside of a single pathological declaration, and indexes every other
+/// file with a TUIndexer
+class HangingIndexer : public hdoc::indexer::TUActionFactory {
+public:
+  HangingIndexer(const std::string& path, hdoc::indexer::IndexShards* shards, const hdoc::types::Config* cfg)
+      : path(path), indexer(path, shards, cfg, nullptr, nullptr, nullptr, nullptr) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    while (std::filesystem::path(this->path).filename() == "hang.cpp") {
+      std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+    return this->indexer.create();
+  }
+  void        finish(const bool success) override { this->indexer.finish(success); }
+  void        prepareForWorker() override { this->indexer.prepareForWorker(); }
+  std::string finishInWorker(const bool success) override { return this->indexer.finishInWorker(success); }
+  void        finishFromWorker(const bool success, const std::string_view result) override {
+    this->indexer.finishFromWorker(success, result);
+  }
+
+private:
+  std::string              path;
+  hdoc::indexer::TUIndexer indexer;
+};
+} // namespace
+
+TEST_CASE("Files that take longer than the timeout are abandoned") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-timeouts";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "a.cpp") << "void first();\nvoid second();\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17"});
+  const std::vector<std::string>                 files        = {(dir / "a.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  // The deadline has passed by the time the first declaration is parsed
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.useTimeout(1e-9);
+  tool.execute(files, [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+  });
+
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+  checkIndexSizes(index, 0, 0, 0, 0);
+  CHECK(tool.getTimedOutFiles() == files);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Files whose deadline passes while they're parsed are abandoned at the next declaration") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-timeouts-mid-parse";
+  std::filesystem::create_directories(dir);
+  // Evaluating the constant takes far longer than the timeout, after the first declaration was parsed in time
+  std::ofstream(dir / "slow.cpp") << "void first();\n"
+                                     "constexpr long spin(long n) {\n"
+                                     "  long s = 0;\n"
+                                     "  for (long i = 0; i < n; i++) { s += i; }\n"
+                                     "  return s;\n"
+                                     "}\n"
+                                     "constexpr long spun = spin(20000000);\n"
+                                     "void last();\n";
+  std::ofstream(dir / "fast.cpp") << "void fast();\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17", "-fconstexpr-steps=2147483647"});
+  const std::vector<std::string>                 files = {(dir / "slow.cpp").string(), (dir / "fast.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.useTimeout(0.5);
+  tool.execute(files, [&](const std::string& path) {
+    return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+  });
+
+  // The symbols that were found before the deadline are dropped along with the rest of the file
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+  checkIndexSizes(index, 0, 1, 0, 0);
+  CHECK(findByName(index.functions, "fast").has_value());
+  CHECK(tool.getTimedOutFiles() == std::vector<std::string>{files[0]});
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Worker processes that are stuck past the timeout are killed") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-timeouts-kill";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "hang.cpp") << "void fromHang();\n";
+  std::ofstream(dir / "a.cpp") << "void fromA();\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17"});
+  const std::vector<std::string>                 files = {(dir / "hang.cpp").string(), (dir / "a.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.useWorkerProcesses(2, /*maxRSS=*/0);
+  tool.useTimeout(0.1);
+  tool.execute(files, [&](const std::string& path) { return std::make_unique<HangingIndexer>(path, &shards, &cfg); });
+
+  // The stuck worker never reaches a declaration to stop at, so only killing it ends the run
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+  checkIndexSizes(index, 0, 1, 0, 0);
+  CHECK(findByName(index.functions, "fromA").has_value());
+  CHECK(tool.getTimedOutFiles() == std::vector<std::string>{files[0]});
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,61 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+TEST_CASE("An executor that is kept across updates sees the files that were invalidated change") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-update";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "common.hpp") << "#pragma once\nnamespace core { class Shared {}; }\n";
+  std::ofstream(dir / "a.cpp") << "#include \"common.hpp\"\nvoid fromA(core::Shared& s);\n";
+  std::ofstream(dir / "b.cpp") << "#include \"common.hpp\"\nvoid fromB(core::Shared& s);\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17"});
+  const std::vector<std::string>                 files = {(dir / "a.cpp").string(), (dir / "b.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  hdoc::indexer::ParallelExecutor tool(cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.recordLookups();
+  const auto indexInto = [&](hdoc::types::Index& index) {
+    hdoc::indexer::IndexShards shards(/*claimSymbols=*/true);
+    tool.execute(files, [&](const std::string& path) {
+      return std::make_unique<hdoc::indexer::TUIndexer>(path, &shards, &cfg, nullptr, nullptr, nullptr, nullptr);
+    });
+    shards.mergeInto(index, pool);
+  };
+
+  hdoc::types::Index before;
+  indexInto(before);
+  CHECK(findByName(before.records, "Shared").has_value());
+  CHECK(!findByName(before.records, "Added").has_value());
+
+  // The header is longer now, so a FileManager that still knew its old size would cut it off
+  std::ofstream(dir / "common.hpp") << "#pragma once\nnamespace core { class Shared {}; class Added {}; }\n";
+  tool.invalidate({(dir / "common.hpp").string()});
+
+  hdoc::types::Index after;
+  indexInto(after);
+  CHECK(findByName(after.records, "Shared").has_value());
+  CHECK(findByName(after.records, "Added").has_value());
+  CHECK(findByName(after.functions, "fromA").has_value());
+  CHECK(findByName(after.functions, "fromB").has_value());
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,83 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "tests/TestUtils.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include "indexer/IndexAction.hpp"
+#include "support/ParallelExecutor.hpp"
+
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+/// Kills its worker process while parsing crash.cpp, and indexes every other file with a TUIndexer
+class CrashingIndexer : public hdoc::indexer::TUActionFactory {
+public:
+  CrashingIndexer(const std::string& path, hdoc::indexer::IndexShards* shards, const hdoc::types::Config* cfg)
+      : path(path), indexer(path, shards, cfg, nullptr, nullptr, nullptr, nullptr) {}
+
+  std::unique_ptr<clang::FrontendAction> create() override {
+    if (std::filesystem::path(this->path).filename() == "crash.cpp") {
+      std::raise(SIGKILL);
+    }
+    return this->indexer.create();
+  }
+  void        finish(const bool success) override { this->indexer.finish(success); }
+  void        prepareForWorker() override { this->indexer.prepareForWorker(); }
+  std::string finishInWorker(const bool success) override { return this->indexer.finishInWorker(success); }
+  void        finishFromWorker(const bool success, const std::string_view result) override {
+    this->indexer.finishFromWorker(success, result);
+  }
+
+private:
+  std::string              path;
+  hdoc::indexer::TUIndexer indexer;
+};
+} // namespace
+
+TEST_CASE("Files parsed in worker processes are indexed, and crashing files are skipped") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-worker-processes";
+  std::filesystem::create_directories(dir);
+  std::ofstream(dir / "common.hpp") << "#pragma once\nnamespace core { class Shared {}; }\n";
+  std::ofstream(dir / "a.cpp") << "#include \"common.hpp\"\nvoid fromA(core::Shared& s);\n";
+  std::ofstream(dir / "b.cpp") << "#include \"common.hpp\"\nvoid fromB(core::Shared& s);\n";
+  std::ofstream(dir / "c.cpp") << "void fromC();\n";
+  std::ofstream(dir / "crash.cpp") << "void fromCrash();\n";
+
+  const clang::tooling::FixedCompilationDatabase cmpdb(dir.string(), {"-std=c++17"});
+  const std::vector<std::string>                 files = {(dir / "a.cpp").string(),
+                                                          (dir / "crash.cpp").string(),
+                                                          (dir / "b.cpp").string(),
+                                                          (dir / "c.cpp").string()};
+  const std::vector<std::string>                 includePaths = {};
+  const hdoc::types::Config                      cfg;
+  llvm::ThreadPool                               pool;
+
+  hdoc::indexer::IndexShards      shards(/*claimSymbols=*/true);
+  hdoc::indexer::ParallelExecutor tool(cmpdb,
+                                       includePaths,
+                                       pool,
+                                       std::make_shared<clang::PCHContainerOperations>(),
+                                       nullptr,
+                                       hdoc::types::SchedulingPolicy::Database,
+                                       nullptr);
+  tool.useWorkerProcesses(2, /*maxRSS=*/1);
+  tool.execute(files, [&](const std::string& path) { return std::make_unique<CrashingIndexer>(path, &shards, &cfg); });
+
+  hdoc::types::Index index;
+  shards.mergeInto(index, pool);
+
+  // Shared is indexed by both workers, but only kept once
+  checkIndexSizes(index, 1, 3, 0, 1);
+  CHECK(findByName(index.records, "Shared").has_value());
+  CHECK(findByName(index.functions, "fromA").has_value());
+  CHECK(findByName(index.functions, "fromB").has_value());
+  CHECK(findByName(index.functions, "fromC").has_value());
+  CHECK(!findByName(index.functions, "fromCrash").has_value());
+
+  std::filesystem::remove_all(dir);
+}
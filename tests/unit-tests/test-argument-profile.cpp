@@ -0,0 +1,46 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/ArgumentProfile.hpp"
+
+using Args = std::vector<std::string>;
+
+TEST_CASE("Arguments that don't affect declarations are removed") {
+  const hdoc::indexer::ArgumentProfile profile(/*useBuiltinRules=*/true, {}, {});
+  CHECK(profile.apply({"clang++", "-O3", "-g", "-ggdb3", "-Wall", "-Werror", "-pedantic", "-fsanitize=address",
+                       "-fprofile-instr-generate", "-flto=thin", "-fplugin=check.so", "-DNDEBUG", "-c", "a.cpp"}) ==
+        Args{"clang++", "-DNDEBUG", "-c", "a.cpp"});
+}
+
+TEST_CASE("Arguments that look like removed ones are kept") {
+  const hdoc::indexer::ArgumentProfile profile(/*useBuiltinRules=*/true, {}, {});
+  const Args args = {"clang", "-ObjC", "-gcc-toolchain", "/opt/gcc", "-Wp,-D_FORTIFY_SOURCE=2", "-Wl,--as-needed",
+                     "-Xlinker", "-O1", "-mllvm", "-debug-only=x", "-Xclang", "-fno-pch-timestamp", "a.m"};
+  CHECK(profile.apply(args) == args);
+}
+
+TEST_CASE("Prebuilt PCHs and plugins are removed along with their values") {
+  const hdoc::indexer::ArgumentProfile profile(/*useBuiltinRules=*/true, {}, {});
+  CHECK(profile.apply({"clang++", "-include-pch", "build/pch.pch", "-include", "build/cmake_pch.hxx.gch", "-include",
+                       "config.h", "-Xclang", "-include-pch", "-Xclang", "build/cmake_pch.hxx.pch", "-Xclang", "-load",
+                       "-Xclang", "plugin.so", "-Xclang", "-plugin-arg-check", "-Xclang", "strict", "a.cpp"}) ==
+        Args{"clang++", "-include", "config.h", "a.cpp"});
+}
+
+TEST_CASE("Keep patterns override the other rules, and strip patterns work without the built-in rules") {
+  const hdoc::indexer::ArgumentProfile profile(/*useBuiltinRules=*/true, {"-O2", "-Wno-*"}, {"-march=*"});
+  CHECK(profile.apply({"clang++", "-O2", "-O3", "-Wno-unused", "-Wextra", "-march=native", "a.cpp"}) ==
+        Args{"clang++", "-O2", "-Wno-unused", "a.cpp"});
+
+  const hdoc::indexer::ArgumentProfile onlyStrip(/*useBuiltinRules=*/false, {}, {"-march=*", "-fcolor-diagnostics"});
+  CHECK(onlyStrip.apply({"clang++", "-O3", "-march=native", "-fcolor-diagnostics", "a.cpp"}) ==
+        Args{"clang++", "-O3", "a.cpp"});
+}
+
+TEST_CASE("The adjuster applies the profile to every command it's given") {
+  const hdoc::indexer::ArgumentProfile profile(/*useBuiltinRules=*/true, {}, {});
+  const clang::tooling::ArgumentsAdjuster adjust = profile.getAdjuster();
+  CHECK(adjust({"clang++", "-O2", "-g", "a.cpp"}, "a.cpp") == Args{"clang++", "a.cpp"});
+  CHECK(adjust({"clang++", "b.cpp"}, "b.cpp") == Args{"clang++", "b.cpp"});
+}
@@ -0,0 +1,108 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/CachingFileSystem.hpp"
+
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace {
+/// Counts the calls that reach the file system below the cache
+class CountingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+  CountingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs) : ProxyFileSystem(std::move(fs)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine& path) override {
+    this->numStats++;
+    return ProxyFileSystem::status(path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(const llvm::Twine& path) override {
+    this->numOpens++;
+    if (this->openError) {
+      return this->openError;
+    }
+    return ProxyFileSystem::openFileForRead(path);
+  }
+
+  uint32_t        numStats = 0;
+  uint32_t        numOpens = 0;
+  std::error_code openError; ///< Returned by every open if set
+};
+} // namespace
+
+TEST_CASE("Stat calls and headers are served from memory to every TU") {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> files(new llvm::vfs::InMemoryFileSystem());
+  files->addFile("/project/include/a.hpp", 0, llvm::MemoryBuffer::getMemBuffer("struct A {};"));
+  files->addFile("/project/src/main.cpp", 0, llvm::MemoryBuffer::getMemBuffer("int main() {}"));
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> counter(new CountingFileSystem(files));
+
+  hdoc::indexer::SharedFileSystemCache cache;
+  hdoc::indexer::CachingFileSystem     tu1(counter, cache);
+  hdoc::indexer::CachingFileSystem     tu2(counter, cache);
+
+  // Missing files are cached as well, and relative paths are resolved against the working directory
+  CHECK(!tu1.status("/project/missing.hpp"));
+  CHECK(!tu2.status("/project/missing.hpp"));
+  CHECK(tu1.status("/project/include/a.hpp")->getSize() == 12);
+  CHECK(tu2.setCurrentWorkingDirectory("/project/include") == std::error_code());
+  const auto status = tu2.status("a.hpp");
+  REQUIRE(status);
+  CHECK(status->getName() == "a.hpp");
+  CHECK(counter->numStats == 2);
+
+  // Contents are kept once a file was read twice
+  for (int i = 0; i < 3; i++) {
+    auto file = tu1.openFileForRead("/project/include/a.hpp");
+    REQUIRE(file);
+    auto buffer = (*file)->getBuffer("a.hpp");
+    REQUIRE(buffer);
+    CHECK((*buffer)->getBuffer() == "struct A {};");
+  }
+  CHECK(tu2.openFileForRead("./a.hpp"));
+  CHECK(tu1.openFileForRead("/project/src/main.cpp"));
+  CHECK(counter->numOpens == 3);
+}
+
+TEST_CASE("Only files that are missing are cached when opening them fails") {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> files(new llvm::vfs::InMemoryFileSystem());
+  files->addFile("/project/a.hpp", 0, llvm::MemoryBuffer::getMemBuffer("struct A {};"));
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> counter(new CountingFileSystem(files));
+
+  hdoc::indexer::SharedFileSystemCache cache;
+  hdoc::indexer::CachingFileSystem     tu(counter, cache);
+
+  // Running out of file descriptors doesn't make the file missing for the rest of the run
+  counter->openError = std::make_error_code(std::errc::too_many_files_open);
+  CHECK(!tu.openFileForRead("/project/a.hpp"));
+  counter->openError = std::error_code();
+  CHECK(tu.status("/project/a.hpp"));
+  CHECK(tu.openFileForRead("/project/a.hpp"));
+
+  CHECK(!tu.openFileForRead("/project/missing.hpp"));
+  CHECK(!tu.status("/project/missing.hpp"));
+  CHECK(counter->numStats == 1);
+}
+
+TEST_CASE("Invalidated files are read from disk again") {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> files(new llvm::vfs::InMemoryFileSystem());
+  files->addFile("/project/a.hpp", 0, llvm::MemoryBuffer::getMemBuffer("struct A {};"));
+  files->addFile("/project/b.hpp", 0, llvm::MemoryBuffer::getMemBuffer("struct B {};"));
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> counter(new CountingFileSystem(files));
+
+  hdoc::indexer::SharedFileSystemCache cache;
+  hdoc::indexer::CachingFileSystem     tu(counter, cache);
+  std::unordered_set<std::string>      paths;
+  tu.recordPathsInto(&paths);
+  CHECK(tu.status("/project/./a.hpp"));
+  CHECK(tu.status("/project/b.hpp"));
+  tu.recordPathsInto(nullptr);
+  CHECK(!tu.status("/project/missing.hpp"));
+  CHECK(paths == std::unordered_set<std::string>{"/project/a.hpp", "/project/b.hpp"});
+
+  // Only the invalidated file is stat-ed again
+  cache.invalidate("/project/a.hpp");
+  CHECK(tu.status("/project/a.hpp"));
+  CHECK(tu.status("/project/b.hpp"));
+  CHECK(counter->numStats == 4);
+}
@@ -0,0 +1,133 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "indexer/CompileCommandsDatabase.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using Args = std::vector<std::string>;
+
+/// Write json to a temporary compile_commands.json and return its path
+static std::string writeDatabase(const std::string& json) {
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "hdoc-test-compile-commands.json";
+  std::ofstream(path) << json;
+  return path.string();
+}
+
+TEST_CASE("Compile commands are read in order, with commands split into arguments") {
+  const std::string path = writeDatabase(R"([
+    {"directory": "/build", "file": "../src/b.cpp", "command": "ccache clang++ -DNAME=\"a b\" -c ../src/b.cpp"},
+    {"directory": "/build", "file": "/src/a.cpp", "arguments": ["clang++", "-DX", "/src/a.cpp"], "output": "a.o"},
+    {"directory": "/other", "file": "/src/b.cpp", "arguments": ["clang++", "-DY", "/src/b.cpp"], "extra": [1, {}]}
+  ])");
+
+  hdoc::indexer::CompileCommandsDatabase cmpdb;
+  std::vector<std::string>               found;
+  std::string                            err;
+  REQUIRE(cmpdb.load(path, err, nullptr, 0, [&](const std::string& file) { found.emplace_back(file); }));
+  CHECK(found == Args{"/src/b.cpp", "/src/a.cpp", "/src/b.cpp"});
+  CHECK(cmpdb.getAllFiles() == Args{"/src/b.cpp", "/src/a.cpp"});
+  CHECK(cmpdb.getAllCompileCommands().size() == 3);
+
+  const auto b = cmpdb.getCompileCommands("/src/../src/b.cpp");
+  REQUIRE(b.size() == 2);
+  CHECK(b[0].Directory == "/build");
+  CHECK(b[0].Filename == "../src/b.cpp");
+  CHECK(b[0].CommandLine == Args{"clang++", "-DNAME=a b", "-c", "../src/b.cpp"});
+  CHECK(b[1].CommandLine == Args{"clang++", "-DY", "/src/b.cpp"});
+
+  const auto a = cmpdb.getCompileCommands("/src/a.cpp");
+  REQUIRE(a.size() == 1);
+  CHECK(a[0].Output == "a.o");
+  CHECK(cmpdb.getCompileCommands("/src/c.cpp").empty());
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Files are filtered while reading, which stops once enough files were found") {
+  const std::string path = writeDatabase(R"([
+    {"directory": "/", "file": "/tests/t.cpp", "command": "clang++ /tests/t.cpp"},
+    {"directory": "/", "file": "/src/a.cpp", "command": "clang++ /src/a.cpp"},
+    {"directory": "/", "file": "/src/b.cpp", "command": "clang++ /src/b.cpp"},
+    {"directory": "/", "file": "/src/c.cpp", "command": "clang++ /src/c.cpp"}
+  ])");
+
+  hdoc::indexer::CompileCommandsDatabase cmpdb;
+  std::string                            err;
+  const auto filter = [](const std::string& file) { return file.find("/tests/") == std::string::npos; };
+  REQUIRE(cmpdb.load(path, err, filter, 2));
+  CHECK(cmpdb.getAllFiles() == Args{"/src/a.cpp", "/src/b.cpp"});
+  CHECK(cmpdb.getNumFilteredCommands() == 1);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Commands that parse a file the same way are only kept once") {
+  const std::string path = writeDatabase(R"([
+    {"directory": "/debug", "file": "/src/a.cpp", "command": "clang++ -O2 -g -I../include -DFEATURE -c ../src/a.cpp"},
+    {"directory": "/release", "file": "/src/a.cpp", "command": "clang++ -O2 -Wall -I /include -D FEATURE /src/a.cpp"},
+    {"directory": "/nofeature", "file": "/src/a.cpp", "command": "clang++ -O2 -I/include /src/a.cpp"},
+    {"directory": "/cxx20", "file": "/src/a.cpp", "command": "clang++ -std=c++20 -I/include -DFEATURE /src/a.cpp"},
+    {"directory": "/release", "file": "/src/b.cpp", "command": "clang++ -O2 -I/include -DFEATURE /src/b.cpp"}
+  ])");
+
+  hdoc::indexer::CompileCommandsDatabase cmpdb;
+  std::string                            err;
+  cmpdb.useDeduplication(true);
+  REQUIRE(cmpdb.load(path, err));
+  const auto a = cmpdb.getCompileCommands("/src/a.cpp");
+  REQUIRE(a.size() == 3);
+  CHECK(a[0].Directory == "/debug");
+  CHECK(a[1].Directory == "/nofeature");
+  CHECK(a[2].Directory == "/cxx20");
+  CHECK(cmpdb.getCompileCommands("/src/b.cpp").size() == 1);
+  CHECK(cmpdb.getNumDuplicateCommands() == 1);
+  CHECK(cmpdb.getNumDeduplicatedFiles() == 1);
+  CHECK(cmpdb.getNumCommands() == 4);
+
+  // Without deduplication, every command is kept
+  cmpdb.useDeduplication(false);
+  REQUIRE(cmpdb.load(path, err));
+  CHECK(cmpdb.getCompileCommands("/src/a.cpp").size() == 4);
+  CHECK(cmpdb.getNumDuplicateCommands() == 0);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Commands that differ in arguments that can change declarations are all kept") {
+  const std::string path = writeDatabase(R"([
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 -mavx2 /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O0 /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 -fno-exceptions /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 -Xclang -include-pch -Xclang /a.pch /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 -Xclang -include-pch -Xclang /b.pch /a.cpp"},
+    {"directory": "/", "file": "/a.cpp", "command": "clang++ -O2 -mavx2 -Wextra -gline-tables-only -MD -o a.o /a.cpp"}
+  ])");
+
+  hdoc::indexer::CompileCommandsDatabase cmpdb;
+  std::string                            err;
+  cmpdb.useDeduplication(true);
+  REQUIRE(cmpdb.load(path, err));
+  const auto a = cmpdb.getCompileCommands("/a.cpp");
+  REQUIRE(a.size() == 6);
+  CHECK(a[1].CommandLine == Args{"clang++", "-O2", "-mavx2", "/a.cpp"});
+  CHECK(cmpdb.getNumDuplicateCommands() == 1);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Malformed compilation databases are reported") {
+  hdoc::indexer::CompileCommandsDatabase cmpdb;
+  std::string                            err;
+  for (const std::string json : {R"({"directory": "/"})",
+                                 R"([{"directory": "/", "file": "/a.cpp"}])",
+                                 R"([{"directory": "/", "file": "/a.cpp", "command": "clang++ /a.cpp"})"}) {
+    const std::string path = writeDatabase(json);
+    CHECK(!cmpdb.load(path, err));
+    CHECK(!err.empty());
+    err.clear();
+    std::filesystem::remove(path);
+  }
+  CHECK(!cmpdb.load("/nonexistent/compile_commands.json", err));
+}
@@ -0,0 +1,50 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "indexer/DependencyMap.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+TEST_CASE("Files are affected by changes to themselves and the files they included") {
+  hdoc::indexer::DependencyMap map;
+  map.add("/src/a.cpp", {"/src/a.cpp", "/include/a.hpp", "/include/common.hpp"});
+  map.add("/src/b.cpp", {"/src/b.cpp", "/include/b.hpp", "/include/common.hpp"});
+  map.add("/src/c.cpp", {"/src/c.cpp"});
+
+  const std::vector<std::string> files = {"/src/a.cpp", "/src/b.cpp", "/src/c.cpp", "/src/new.cpp"};
+  CHECK(map.getAffectedFiles(files, {"/include/common.hpp"}) == std::vector<std::string>{"/src/a.cpp", "/src/b.cpp"});
+  CHECK(map.getAffectedFiles(files, {"/include/b.hpp", "/src/c.cpp"}) ==
+        std::vector<std::string>{"/src/b.cpp", "/src/c.cpp"});
+  CHECK(map.getAffectedFiles(files, {"/README.md"}).empty());
+
+  // Files that weren't indexed before are only affected if they changed themselves
+  CHECK(map.getAffectedFiles(files, {"/src/new.cpp"}) == std::vector<std::string>{"/src/new.cpp"});
+
+  // Later commands of a file add to what its earlier ones included, while indexing it again replaces it
+  map.extend("/src/c.cpp", {"/src/c.cpp", "/include/c.hpp"});
+  CHECK(map.getAffectedFiles(files, {"/include/c.hpp"}) == std::vector<std::string>{"/src/c.cpp"});
+  map.add("/src/c.cpp", {"/src/c.cpp"});
+  CHECK(map.getAffectedFiles(files, {"/include/c.hpp"}).empty());
+}
+
+TEST_CASE("Dependency maps are saved and loaded") {
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "hdoc-test-dependency-map";
+  {
+    hdoc::indexer::DependencyMap map;
+    map.add("/src/a.cpp", {"/src/a.cpp", "/include/a.hpp"});
+    map.add("/src/b.cpp", {"/src/b.cpp"});
+    CHECK(map.save(path));
+  }
+
+  hdoc::indexer::DependencyMap map;
+  CHECK(map.load(path));
+  const std::vector<std::string> files = {"/src/a.cpp", "/src/b.cpp"};
+  CHECK(map.getAffectedFiles(files, {"/include/a.hpp"}) == std::vector<std::string>{"/src/a.cpp"});
+  CHECK(map.getAffectedFiles(files, {"/src/b.cpp"}) == std::vector<std::string>{"/src/b.cpp"});
+  std::filesystem::remove(path);
+
+  CHECK(!map.load(path));
+}
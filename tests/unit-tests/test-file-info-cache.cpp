@@ -0,0 +1,29 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "indexer/FileInfoCache.hpp"
+
+TEST_CASE("Shared file info classifies paths relative to the root directory") {
+  hdoc::types::Config cfg;
+  cfg.rootDir     = "/project";
+  cfg.ignorePaths = {"third_party/"};
+
+  hdoc::indexer::SharedFileInfoCache files(&cfg);
+
+  const hdoc::indexer::FileInfo& header = files.get("/project/include/a.hpp");
+  CHECK(header.hasPath);
+  CHECK(header.relPath == "include/a.hpp");
+  CHECK(!header.outsideRootDir);
+  CHECK(!header.ignored);
+
+  const hdoc::indexer::FileInfo& ignored = files.get("/project/third_party/lib/b.hpp");
+  CHECK(!ignored.outsideRootDir);
+  CHECK(ignored.ignored);
+
+  const hdoc::indexer::FileInfo& outside = files.get("/usr/include/stdio.h");
+  CHECK(outside.outsideRootDir);
+
+  // Every file is only classified once
+  CHECK(&files.get("/project/include/a.hpp") == &header);
+}
@@ -0,0 +1,31 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/FileWatcher.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+TEST_CASE("Changes to watched files are reported, and changes to other files are not") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-file-watcher";
+  std::filesystem::create_directories(dir);
+  const std::string watched   = (dir / "watched.hpp").string();
+  const std::string unwatched = (dir / "unwatched.hpp").string();
+  std::ofstream(watched) << "int a;";
+
+  hdoc::utils::FileWatcher watcher;
+  CHECK(watcher.watch({watched}));
+
+  // Editors often save by renaming a new file over the old one
+  std::ofstream(unwatched) << "int b;";
+  std::ofstream(dir / "watched.hpp.tmp") << "int c;";
+  std::filesystem::rename(dir / "watched.hpp.tmp", watched);
+  CHECK(watcher.waitForChanges() == std::vector<std::string>{watched});
+
+  std::ofstream(watched) << "int d;";
+  CHECK(watcher.waitForChanges() == std::vector<std::string>{watched});
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,95 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/MemoryBudget.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+TEST_CASE("Peak memory is recorded and saved along with durations") {
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "hdoc-test-durations";
+  {
+    hdoc::indexer::TUDurations durations;
+    durations.record("/src/a.cpp", 1.0, 1000);
+    durations.record("/src/b.cpp", 2.0);
+    durations.record("/src/a.cpp", 3.0); // Unmeasured peaks don't replace measured ones
+    durations.save(path);
+  }
+
+  hdoc::indexer::TUDurations durations;
+  durations.load(path);
+  CHECK(durations.get("/src/a.cpp") == 3.0);
+  CHECK(durations.getPeakMemory("/src/a.cpp") == 1000);
+  CHECK(durations.get("/src/b.cpp") == 2.0);
+  CHECK(durations.getPeakMemory("/src/b.cpp") == std::nullopt);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Files without a recorded peak are estimated from their size") {
+  const std::filesystem::path dir = std::filesystem::temp_directory_path() / "hdoc-test-memory-budget";
+  std::filesystem::create_directories(dir);
+  const std::vector<std::string> files = {(dir / "a.cpp").string(), (dir / "b.cpp").string()};
+  std::ofstream(files[0]) << std::string(100, 'a');
+  std::ofstream(files[1]) << std::string(300, 'b');
+
+  const auto fallback = hdoc::indexer::MemoryBudget::estimate(files, nullptr, 42);
+  CHECK(fallback.at(files[0]) == 42);
+  CHECK(fallback.at(files[1]) == 42);
+
+  hdoc::indexer::TUDurations durations;
+  durations.record(files[0], 1.0, 1000);
+  const auto estimates = hdoc::indexer::MemoryBudget::estimate(files, &durations, 42);
+  CHECK(estimates.at(files[0]) == 1000);
+  CHECK(estimates.at(files[1]) == 3000);
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Files only start once their estimate fits into the budget") {
+  // Leave enough room above the current RSS that only the reservations decide
+  const uint64_t              budget = hdoc::indexer::getResidentSetSize() + (uint64_t(1) << 32);
+  hdoc::indexer::MemoryBudget memoryBudget(budget);
+  memoryBudget.acquire(budget / 2);
+  memoryBudget.acquire(budget / 4);
+
+  std::atomic<bool> started = false;
+  std::thread       large([&]() {
+    memoryBudget.acquire(budget / 2);
+    started = true;
+    memoryBudget.release(budget / 2);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!started);
+
+  memoryBudget.release(budget / 2);
+  large.join();
+  CHECK(started);
+  memoryBudget.release(budget / 4);
+
+  // A file that needs more than the whole budget still runs on its own
+  memoryBudget.acquire(budget * 2);
+  memoryBudget.release(budget * 2);
+}
+
+TEST_CASE("Files wait for the RSS to leave room for them") {
+  // The process already uses more than the budget, so only files that run on their own are admitted
+  hdoc::indexer::MemoryBudget memoryBudget(1000);
+  REQUIRE(hdoc::indexer::getResidentSetSize() > 1000);
+  memoryBudget.acquire(400);
+
+  std::atomic<bool> started = false;
+  std::thread       other([&]() {
+    memoryBudget.acquire(400);
+    started = true;
+    memoryBudget.release(400);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  CHECK(!started);
+
+  memoryBudget.release(400);
+  other.join();
+  CHECK(started);
+}
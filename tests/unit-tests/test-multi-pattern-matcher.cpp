@@ -0,0 +1,33 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/MultiPatternMatcher.hpp"
+
+TEST_CASE("Multi-pattern matcher finds any pattern as a substring") {
+  const hdoc::utils::MultiPatternMatcher matcher({"detail", "impl", "internal_", "tail"});
+  CHECK(matcher.matches("detail"));
+  CHECK(matcher.matches("my_detail_ns"));
+  CHECK(matcher.matches("pimpl"));
+  CHECK(matcher.matches("internal_v2"));
+  CHECK(matcher.matches("cocktail"));
+  CHECK(!matcher.matches("internal"));
+  CHECK(!matcher.matches("deta_il_of_imp"));
+  CHECK(!matcher.matches(""));
+}
+
+TEST_CASE("Multi-pattern matcher follows overlapping prefixes") {
+  // "aab" has to fall back to the state for "a" after failing to continue "aa" with "b"
+  const hdoc::utils::MultiPatternMatcher matcher({"aac", "ab"});
+  CHECK(matcher.matches("aab"));
+  CHECK(matcher.matches("xaacx"));
+  CHECK(!matcher.matches("aaa"));
+}
+
+TEST_CASE("Multi-pattern matcher edge cases") {
+  const hdoc::utils::MultiPatternMatcher none(std::vector<std::string>{});
+  CHECK(none.empty());
+  CHECK(!none.matches("anything"));
+  // Like std::string::find, an empty pattern is contained in every string
+  CHECK(hdoc::utils::MultiPatternMatcher({""}).matches("anything"));
+}
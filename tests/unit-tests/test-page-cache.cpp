@@ -0,0 +1,38 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "serde/PageCache.hpp"
+
+TEST_CASE("Least recently used pages are evicted once the cache is full") {
+  hdoc::serde::PageCache cache(10);
+  cache.put("a.html", "aaaa");
+  cache.put("b.html", "bbbb");
+  CHECK(cache.get("a.html") != nullptr); // b.html is now the least recently used page
+  cache.put("c.html", "cccc");
+
+  CHECK(cache.get("a.html") != nullptr);
+  CHECK(cache.get("b.html") == nullptr);
+  CHECK(cache.get("c.html")->content == "cccc");
+  CHECK(cache.size() == 8);
+}
+
+TEST_CASE("Pages larger than the cache are returned without being cached") {
+  hdoc::serde::PageCache cache(4);
+  const auto             page = cache.put("a.html", "aaaaa");
+  CHECK(page->content == "aaaaa");
+  CHECK(cache.get("a.html") == nullptr);
+  CHECK(cache.size() == 0);
+}
+
+TEST_CASE("ETags only depend on the content of pages") {
+  hdoc::serde::PageCache cache(100);
+  const auto             a = cache.put("a.html", "same");
+  const auto             b = cache.put("b.html", "same");
+  const auto             c = cache.put("a.html", "different");
+  CHECK(a->etag == b->etag);
+  CHECK(a->etag != c->etag);
+  CHECK(a->etag.front() == '"');
+  CHECK(cache.get("a.html")->content == "different");
+  CHECK(cache.size() == 13);
+}
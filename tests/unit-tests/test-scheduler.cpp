@@ -0,0 +1,97 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "support/TUScheduler.hpp"
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Take every file from the scheduler with a single worker
+static std::vector<std::string> drain(hdoc::indexer::TUScheduler& scheduler, const std::size_t worker = 0) {
+  std::vector<std::string> order;
+  while (const auto file = scheduler.next(worker)) {
+    order.emplace_back(*file);
+  }
+  return order;
+}
+
+TEST_CASE("Database scheduling keeps the order of the compilation database") {
+  const std::vector<std::string> files = {"/src/c.cpp", "/src/a.cpp", "/src/b.cpp"};
+  hdoc::indexer::TUScheduler     scheduler(files, hdoc::types::SchedulingPolicy::Database, nullptr, 1);
+  CHECK(drain(scheduler) == files);
+}
+
+TEST_CASE("Longest-first scheduling orders files by their previous durations") {
+  hdoc::indexer::TUDurations durations;
+  durations.record("/src/a.cpp", 1.0);
+  durations.record("/src/b.cpp", 30.0);
+  durations.record("/src/c.cpp", 4.0);
+
+  hdoc::indexer::TUScheduler scheduler(
+      {"/src/a.cpp", "/src/b.cpp", "/src/c.cpp"}, hdoc::types::SchedulingPolicy::LongestFirst, &durations, 2);
+  CHECK(scheduler.next(0) == "/src/b.cpp");
+  CHECK(scheduler.next(1) == "/src/c.cpp");
+  CHECK(scheduler.next(1) == "/src/a.cpp");
+  CHECK(scheduler.next(0) == std::nullopt);
+}
+
+TEST_CASE("Directory scheduling keeps workers in the same directory") {
+  hdoc::indexer::TUDurations durations;
+  durations.record("/x/1.cpp", 5.0);
+  durations.record("/x/2.cpp", 4.0);
+  durations.record("/y/1.cpp", 3.0);
+  durations.record("/y/2.cpp", 2.0);
+  durations.record("/y/3.cpp", 1.0);
+
+  hdoc::indexer::TUScheduler scheduler({"/y/3.cpp", "/x/2.cpp", "/y/1.cpp", "/x/1.cpp", "/y/2.cpp"},
+                                       hdoc::types::SchedulingPolicy::Directory,
+                                       &durations,
+                                       2);
+  // /x has the most work left, so the first worker starts there and the second one gets /y
+  CHECK(scheduler.next(0) == "/x/1.cpp");
+  CHECK(scheduler.next(1) == "/y/1.cpp");
+  CHECK(scheduler.next(1) == "/y/2.cpp");
+  CHECK(scheduler.next(0) == "/x/2.cpp");
+
+  // Once its own directory is done, a worker helps out with the one that has work left
+  CHECK(scheduler.next(0) == "/y/3.cpp");
+  CHECK(scheduler.next(1) == std::nullopt);
+}
+
+TEST_CASE("Files are handed out while they're still being added") {
+  hdoc::indexer::TUScheduler scheduler(2);
+  scheduler.add("/src/a.cpp");
+  CHECK(scheduler.next(0) == "/src/a.cpp");
+
+  // Workers wait for more files until the scheduler is closed
+  std::thread adder([&]() {
+    scheduler.add("/src/b.cpp");
+    scheduler.add("/src/c.cpp");
+    scheduler.close();
+  });
+  std::vector<std::string> order = drain(scheduler, 1);
+  adder.join();
+  CHECK(order == std::vector<std::string>{"/src/b.cpp", "/src/c.cpp"});
+  CHECK(scheduler.getNumFiles() == 3);
+  CHECK(scheduler.next(0) == std::nullopt);
+}
+
+TEST_CASE("Quarantined files are saved and loaded") {
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "hdoc-test-quarantine";
+  {
+    hdoc::indexer::TUQuarantine quarantine;
+    quarantine.add("/src/slow.cpp");
+    quarantine.add("/src/fixed.cpp");
+    quarantine.remove("/src/fixed.cpp");
+    quarantine.save(path);
+  }
+
+  hdoc::indexer::TUQuarantine quarantine;
+  quarantine.load(path);
+  CHECK(quarantine.contains("/src/slow.cpp"));
+  CHECK(!quarantine.contains("/src/fixed.cpp"));
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,32 @@
+// Copyright 2019-2023 hdoc
+// SPDX-License-Identifier: AGPL-3.0-only
+
+#include "doctest.h"
+#include "indexer/TUSetPlanner.hpp"
+
+#include <string>
+#include <vector>
+
+static bool isHeader(const std::string& path) {
+  return path.size() > 4 && path.substr(path.size() - 4) == ".hpp";
+}
+
+TEST_CASE("Minimal TU set covers every header with as few files as possible") {
+  const std::vector<std::vector<std::string>> dependencies = {
+      {"a.cpp", "a.hpp", "common.hpp"},
+      {"b.cpp", "a.hpp", "b.hpp", "common.hpp"},
+      {"c.cpp", "c.hpp"},
+      {"d.cpp", "common.hpp"},
+      {"e.cpp"},
+  };
+  CHECK(hdoc::indexer::planMinimalTUSet(dependencies, isHeader) == std::vector<std::size_t>{1, 2});
+}
+
+TEST_CASE("Minimal TU set prefers one file over several that cover the same headers") {
+  const std::vector<std::vector<std::string>> dependencies = {
+      {"1.hpp", "2.hpp"},
+      {"3.hpp", "4.hpp"},
+      {"1.hpp", "2.hpp", "3.hpp", "4.hpp"},
+  };
+  CHECK(hdoc::indexer::planMinimalTUSet(dependencies, isHeader) == std::vector<std::size_t>{2});
+}